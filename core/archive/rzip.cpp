@@ -21,10 +21,11 @@
 
 const u8 RZipHeader[8] = { '#', 'R', 'Z', 'I', 'P', 'v', 1, '#' };
 
-bool RZipFile::Open(const std::string& path, bool write)
+bool RZipFile::Open(const std::string& path, bool write, int level)
 {
 	verify(file == nullptr);
 	this->write = write;
+	this->level = level;
 
 	file = nowide::fopen(path.c_str(), write ? "wb" : "rb");
 	if (file == nullptr)
@@ -142,7 +143,7 @@ size_t RZipFile::Write(const void *data, size_t length)
 	{
 		uLongf zippedSize = maxZippedSize;
 		uLongf uncompressedSize = std::min(maxChunkSize, (u32)(length - rv));
-		u32 rc = compress(zipped, &zippedSize, p, uncompressedSize);
+		u32 rc = compress2(zipped, &zippedSize, p, uncompressedSize, level);
 		if (rc != Z_OK)
 		{
 			WARN_LOG(SAVESTATE, "Compression error: %d", rc);
@@ -27,7 +27,8 @@ class RZipFile
 public:
 	~RZipFile() { Close(); }
 
-	bool Open(const std::string& path, bool write);
+	// level is the zlib compression level used when writing
+	bool Open(const std::string& path, bool write, int level = -1);
 	void Close();
 	size_t Size() const { return size; }
 	size_t Read(void *data, size_t length);
@@ -42,4 +43,5 @@ private:
 	u32 chunkSize = 0;
 	u32 chunkIndex = 0;
 	bool write = false;
+	int level = -1;
 };
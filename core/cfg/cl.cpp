@@ -81,6 +81,8 @@ static int showhelp()
 	printf("-config	section:key=value     add a virtual config value;\n");
 	printf("                              virtual config values won't be saved to the .cfg file\n");
 	printf("                              unless a different value is written to them\n");
+	printf("-bench [OPTION]... CONTENT    run CONTENT headless and print performance statistics;\n");
+	printf("                              must be the first option, see -bench -help\n");
 	printf("-help                         display this help\n");
 
 	exit(0);
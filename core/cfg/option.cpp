@@ -26,6 +26,9 @@ namespace config {
 
 Option<bool> DynarecEnabled("Dynarec.Enabled", true);
 Option<bool> DynarecIdleSkip("Dynarec.idleskip", true);
+Option<bool> DynarecAsyncCompile("Dynarec.AsyncCompile");
+Option<bool> DynarecPersistentCache("Dynarec.PersistentCache");
+Option<bool> DynarecSuperblocks("Dynarec.Superblocks");
 
 // General
 
@@ -59,6 +62,8 @@ Option<bool> AutoLatency("aica.AutoLatency",
 		);
 
 OptionString AudioBackend("backend", "auto", "audio");
+Option<bool> AudioSyncToVideo("aica.SyncToVideo", false);
+Option<bool> ThreadedAica("aica.Threaded", false);
 AudioVolumeOption AudioVolume;
 
 // Rendering
@@ -102,6 +107,7 @@ Option<int64_t> PixelBufferSize("rend.PixelBufferSize", 512 * 1024 * 1024);
 Option<int> AnisotropicFiltering("rend.AnisotropicFiltering", 1);
 Option<int> TextureFiltering("rend.TextureFiltering", 0); // Default
 Option<bool> ThreadedRendering("rend.ThreadedRendering", true);
+Option<bool> ParallelTAParsing("rend.ParallelTAParsing");
 Option<bool> DupeFrames("rend.DupeFrames", false);
 Option<int> PerPixelLayers("rend.PerPixelLayers", 32);
 Option<bool> NativeDepthInterpolation("rend.NativeDepthInterpolation", false);
@@ -116,6 +122,7 @@ Option<int> GDBPort("Debug.GDBPort", debugger::DEFAULT_PORT);
 Option<bool> GDBWaitForConnection("Debug.GDBWaitForConnection");
 Option<bool> UseReios("UseReios");
 Option<bool> FastGDRomLoad("FastGDRomLoad", false);
+Option<int> ChdHunkCacheSize("ChdHunkCacheSize", 64);
 
 Option<bool> OpenGlChecks("OpenGlChecks", false, "validate");
 
@@ -360,6 +360,9 @@ using OptionString = Option<std::string>;
 
 extern Option<bool> DynarecEnabled;
 extern Option<bool> DynarecIdleSkip;
+extern Option<bool> DynarecAsyncCompile;
+extern Option<bool> DynarecPersistentCache;
+extern Option<bool> DynarecSuperblocks;
 constexpr bool DynarecSafeMode = false;
 
 // General
@@ -385,6 +388,8 @@ extern Option<int> AudioBufferSize;	//In samples ,*4 for bytes
 extern Option<bool> AutoLatency;
 
 extern OptionString AudioBackend;
+extern Option<bool> AudioSyncToVideo;
+extern Option<bool> ThreadedAica;
 
 class AudioVolumeOption : public Option<int> {
 public:
@@ -464,6 +469,7 @@ extern Option<int64_t> PixelBufferSize;
 extern Option<int> AnisotropicFiltering;
 extern Option<int> TextureFiltering; // 0: default, 1: force nearest, 2: force linear
 extern Option<bool> ThreadedRendering;
+extern Option<bool> ParallelTAParsing;
 extern Option<bool> DupeFrames;
 extern Option<bool> NativeDepthInterpolation;
 extern Option<bool> EmulateFramebuffer;
@@ -477,6 +483,7 @@ extern Option<int> GDBPort;
 extern Option<bool> GDBWaitForConnection;
 extern Option<bool> UseReios;
 extern Option<bool> FastGDRomLoad;
+extern Option<int> ChdHunkCacheSize;
 
 extern Option<bool> OpenGlChecks;
 
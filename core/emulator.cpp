@@ -378,7 +378,7 @@ void dc_reset(bool hard)
 static void setPlatform(int platform)
 {
 	if (VRAM_SIZE != 0)
-		_vmem_unprotect_vram(0, VRAM_SIZE);
+		VramLockedWriteRange(0, VRAM_SIZE);
 	elan::ERAM_SIZE = 0;
 	switch (platform)
 	{
@@ -857,11 +857,13 @@ void Emulator::start()
 						if (!ggpo::nextFrame())
 							break;
 					}
+					libAICA_Sync();
 					TermAudio();
 				} catch (...) {
 					setNetworkState(false);
 					state = Error;
 					sh4_cpu.Stop();
+					libAICA_Sync();
 					TermAudio();
 					throw;
 				}
@@ -906,6 +908,7 @@ bool Emulator::render()
 		if (stopRequested)
 		{
 			stopRequested = false;
+			libAICA_Sync();
 			TermAudio();
 			SaveRomFiles();
 			EventManager::event(Event::Pause);
@@ -7,6 +7,12 @@
 #include "hw/sh4/sh4_sched.h"
 #include "hw/arm7/arm7.h"
 #include "hw/arm7/arm_mem.h"
+#include "cfg/option.h"
+#include "profiler/bench.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #define SH4_IRQ_BIT (1 << (holly_SPU_IRQ & 31))
 
@@ -67,10 +73,9 @@ static void update_arm_interrupts()
 }
 
 //sh4 side
-static void UpdateSh4Ints()
+static void SetSh4Int(bool pending)
 {
-	u32 p_ints = MCIEB->full & MCIPD->full;
-	if (p_ints)
+	if (pending)
 	{
 		if ((SB_ISTEXT & SH4_IRQ_BIT) == 0)
 			//if no interrupt is already pending then raise one :)
@@ -87,9 +92,188 @@ AicaTimer timers[3];
 int aica_schid = -1;
 const int AICA_TICK = 145125;	// 44.1 KHz / 32
 
-static int AicaUpdate(int tag, int c, int j)
+static void AicaTick()
 {
+	bench::Timer timer(bench::Arm7);
 	aicaarm::run(32);
+	AICA_FlushSamples();
+}
+
+//
+// Runs the arm7, sound generation and dsp on a separate thread, behind the sh4.
+// Each AICA tick is queued by the sh4 scheduler, and the sh4 only waits for a tick
+// once it is more than `lag` ticks old. The lag shrinks to one tick whenever the sh4
+// accesses the AICA or the AICA changes the sh4 interrupt, and grows back while
+// they don't interact.
+// The sh4 interrupt level is recorded at the end of each tick and applied when the
+// tick is retired on the sh4 thread, so the outcome doesn't depend on host timing.
+// G2 and AICA DMAs to or from the AICA ram sync first.
+// The AICA ram is mapped read-only in the sh4 address space so sh4 writes always go
+// through the area 0 handlers, which sync. Reads by the sh4 dynarec fast path don't:
+// they race with the AICA thread and may see the AICA ram up to `lag` ticks old.
+// This is accepted since the sh4 only reads what the arm7 writes (mailboxes, status
+// flags) and games poll them, so a stale value only delays the handover by a few ticks.
+//
+class AicaThread
+{
+public:
+	void queueTick();
+	void sync();
+	void stop();
+
+	bool isWorker() const {
+		return std::this_thread::get_id() == threadId;
+	}
+	// Called on the worker thread
+	void setSh4Int(bool pending) {
+		tickSh4Int = pending;
+	}
+
+private:
+	void run();
+	void retire(u32 tick);
+
+	void shrinkLag() {
+		lag = 1;
+		quietTicks = 0;
+	}
+
+	static constexpr u32 MAX_LAG = 8;
+	static constexpr u32 QUIET_TICKS = 16;	// before the lag is doubled
+	static constexpr u32 RESULT_COUNT = 16;
+	static_assert(RESULT_COUNT > MAX_LAG, "RESULT_COUNT too small");
+
+	std::thread thread;
+	std::thread::id threadId;
+	std::mutex mutex;
+	std::condition_variable workCond;
+	std::condition_variable doneCond;
+	bool exiting = false;
+	// ticks queued and retired by the sh4 thread
+	u32 queued = 0;
+	u32 retired = 0;
+	// ticks done by the worker. Guarded by the mutex
+	u32 done = 0;
+	u32 lag = 1;
+	u32 quietTicks = 0;
+	// sh4 interrupt level at the end of each tick: -1 if unchanged, 0 or 1
+	s8 sh4Int[RESULT_COUNT];
+	int tickSh4Int = -1;
+};
+
+void AicaThread::queueTick()
+{
+	if (!thread.joinable())
+	{
+		thread = std::thread(&AicaThread::run, this);
+		threadId = thread.get_id();
+	}
+	{
+		std::lock_guard<std::mutex> _(mutex);
+		queued++;
+	}
+	workCond.notify_one();
+
+	if (queued - retired > lag)
+		retire(queued - lag);
+	if (lag < MAX_LAG && ++quietTicks >= QUIET_TICKS)
+	{
+		lag = std::min(lag * 2, MAX_LAG);
+		quietTicks = 0;
+	}
+}
+
+// Waits for the ticks before the given one and applies their outcome
+void AicaThread::retire(u32 tick)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCond.wait(lock, [this, tick]() { return (int)(done - tick) >= 0; });
+	}
+	for (; retired != tick; retired++)
+	{
+		int pending = sh4Int[retired % RESULT_COUNT];
+		if (pending != -1)
+		{
+			SetSh4Int(pending);
+			shrinkLag();
+		}
+	}
+}
+
+void AicaThread::sync()
+{
+	if (retired == queued || isWorker())
+		return;
+	retire(queued);
+	shrinkLag();
+}
+
+void AicaThread::stop()
+{
+	if (!thread.joinable())
+		return;
+	sync();
+	{
+		std::lock_guard<std::mutex> _(mutex);
+		exiting = true;
+	}
+	workCond.notify_one();
+	thread.join();
+	threadId = std::thread::id();
+	exiting = false;
+	queued = retired = done = 0;
+	shrinkLag();
+}
+
+void AicaThread::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		workCond.wait(lock, [this]() { return exiting || done != queued; });
+		if (exiting)
+			break;
+		lock.unlock();
+
+		tickSh4Int = -1;
+		AicaTick();
+
+		lock.lock();
+		sh4Int[done % RESULT_COUNT] = (s8)tickSh4Int;
+		done++;
+		doneCond.notify_one();
+	}
+}
+
+static AicaThread aicaThread;
+
+static void UpdateSh4Ints()
+{
+	bool pending = (MCIEB->full & MCIPD->full) != 0;
+	if (aicaThread.isWorker())
+		aicaThread.setSh4Int(pending);
+	else
+		SetSh4Int(pending);
+}
+
+void libAICA_Sync()
+{
+	aicaThread.sync();
+}
+
+static int AicaUpdate(int tag, int c, int j)
+{
+	// netplay needs a deterministic AICA
+	if (config::ThreadedAica && !config::GGPOEnable)
+	{
+		aicaThread.queueTick();
+	}
+	else
+	{
+		aicaThread.sync();
+		AicaTick();
+	}
 
 	return AICA_TICK;
 }
@@ -98,6 +282,7 @@ static int AicaUpdate(int tag, int c, int j)
 
 void libAICA_TimeStep()
 {
+	bench::Timer timer(bench::Aica);
 	for (int i=0;i<3;i++)
 		timers[i].StepTimer(1);
 
@@ -111,6 +296,16 @@ void libAICA_TimeStep()
 	UpdateSh4Ints();	
 }
 
+u32 libAICA_NextEventSamples(u32 maxSamples)
+{
+	if (SCIEB->SAMPLE_DONE)
+		return 1;
+	u32 samples = maxSamples;
+	for (const AicaTimer& timer : timers)
+		samples = std::min(samples, timer.SamplesToOverflow());
+	return samples;
+}
+
 static void AicaInternalDMA()
 {
 	if (!CommonData->DEXE)
@@ -200,16 +395,24 @@ void WriteAicaReg(u32 reg, T data)
 	case TIMER_A:
 		WriteMemArr(aica_reg, reg, data);
 		timers[0].RegisterWrite();
+		aicaarm::stopAtNextSample();
 		break;
 
 	case TIMER_B:
 		WriteMemArr(aica_reg, reg, data);
 		timers[1].RegisterWrite();
+		aicaarm::stopAtNextSample();
 		break;
 
 	case TIMER_C:
 		WriteMemArr(aica_reg, reg, data);
 		timers[2].RegisterWrite();
+		aicaarm::stopAtNextSample();
+		break;
+
+	case SCIEB_addr:
+		WriteMemArr(aica_reg, reg, data);
+		aicaarm::stopAtNextSample();
 		break;
 
 	// DEXE, DDIR, DLG
@@ -267,6 +470,7 @@ s32 libAICA_Init()
 
 void libAICA_Reset(bool hard)
 {
+	aicaThread.sync();
 	if (hard)
 	{
 		init_mem();
@@ -280,6 +484,7 @@ void libAICA_Reset(bool hard)
 
 void libAICA_Term()
 {
+	aicaThread.stop();
 	sgc_Term();
 	term_mem();
 	sh4_sched_unregister(aica_schid);
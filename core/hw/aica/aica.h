@@ -339,6 +339,12 @@ public:
 		c_step=m_step;
 	}
 
+	// Number of samples until the counter overflows
+	u32 SamplesToOverflow() const
+	{
+		return c_step + (255 - data->count) * m_step;
+	}
+
 	void StepTimer(u32 samples)
 	{
 		do
@@ -6,6 +6,7 @@
 
 #include "aica_if.h"
 #include "aica_mem.h"
+#include "sgc_if.h"
 #include "hw/holly/sb.h"
 #include "hw/holly/holly_intc.h"
 #include "hw/sh4/sh4_mem.h"
@@ -268,6 +269,13 @@ static bool check_STAR_overrun(u32 addr)
 #endif
 }
 
+// True if the G2 address range overlaps the AICA ram
+static bool isAicaRam(u32 addr, u32 len)
+{
+	addr &= 0x1fffffff;
+	return addr < 0x01000000 && addr + len > 0x00800000;
+}
+
 template<u32 ENABLE, u32 START, u32 SRC, u32 DEST, u32 LEN, u32 DIR,
 	HollyInterruptID interrupt, HollyInterruptID iainterrupt, HollyInterruptID ovinterrupt,
 	const char *LogTag>
@@ -314,6 +322,11 @@ void Write_DmaStart(u32 addr, u32 data)
 		return;
 	}
 
+	if (isAicaRam(dst, len))
+	{
+		libAICA_Sync();
+		AICA_FlushSamples();
+	}
 	if (dirReg == 1)
 		std::swap(src, dst);
 	DEBUG_LOG(AICA, "%s: DMA Write to %X from %X %d bytes", LogTag, dst, src, len);
@@ -378,6 +391,9 @@ static void Write_SB_ADST(u32 addr, u32 data)
 				return;
 			}
 
+			// The arm7 and dsp may be using the AICA ram on the AICA thread
+			libAICA_Sync();
+			AICA_FlushSamples();
 			if (SB_ADDIR == 1)
 			{
 				//swap direction
@@ -24,3 +24,9 @@ s32 libAICA_Init();
 void libAICA_Reset(bool hard);
 void libAICA_Term();
 void libAICA_TimeStep();
+// Number of samples, up to maxSamples, until the next timer overflow or sample interrupt.
+// The arm7 can run that many samples ahead of the sound generation without missing an event.
+u32 libAICA_NextEventSamples(u32 maxSamples);
+// Wait until the AICA thread has caught up with the SH4.
+// Must be called before the SH4 side reads or writes AICA registers or memory.
+void libAICA_Sync();
@@ -19,6 +19,9 @@ template<typename T>
 T aicaReadReg(u32 addr)
 {
 	addr &= 0x7FFF;
+	// Channel, common and DSP registers reflect the generated samples
+	if (addr < 0x2818 || addr >= 0x3000)
+		AICA_FlushSamples();
 
 	if (addr >= 0x2800 && addr < 0x2818)
 	{
@@ -87,6 +90,9 @@ void aicaWriteReg(u32 addr, T data)
 {
 	constexpr size_t sz = sizeof(T);
 	addr &= 0x7FFF;
+	// Generate the pending samples with the previous register values
+	if (addr < 0x2818 || addr >= 0x3000)
+		AICA_FlushSamples();
 
 	if (addr < 0x2000)
 	{
@@ -104,6 +104,88 @@ void recompile() {
 }
 #endif
 
+// Everything the compiled program depends on
+struct ProgramKey
+{
+	u32 MPRO[128 * 4];
+	u32 MADRS[64];
+	CoefValue coefs[128];
+	u32 RBL;
+	u32 RBP;
+};
+static ProgramKey compiledKey;
+static bool keyValid;
+
+// Volatile registers tracked by the dataflow analysis
+enum : u32 {
+	LIVE_ACC = 1,
+	LIVE_FRC_REG = 2,
+	LIVE_Y_REG = 4,
+	LIVE_ADRS_REG = 8,
+	LIVE_MEMVAL = 0x10,	// one bit per MEMVAL entry
+};
+
+static CoefValue coefValue(u32 coef)
+{
+	s32 y = (s32)(s16)coef >> 3;
+	if (y == 0)
+		return CoefValue::Zero;
+	if (y == -4096)
+		return CoefValue::MinusOne;
+	return CoefValue::Any;
+}
+
+// Walk the program backwards to find which steps have a visible effect.
+// TEMP, MEMS, EFREG and wave memory writes are always visible. ACC, FRC_REG, Y_REG and ADRS_REG are
+// cleared at the start of each sample, so they're dead at the end of the program. MEMVAL is kept.
+static void analyzeProgram()
+{
+	u32 live = LIVE_MEMVAL * 0xf;
+	for (int step = 127; step >= 0; step--)
+	{
+		Instruction op;
+		DecodeInst(&DSPData->MPRO[step * 4], &op);
+		StepInfo& info = state.steps[step];
+		const bool mrd = (step & 1) && op.MRD;
+		const bool mwt = (step & 1) && op.MWT;
+
+		u32 written = LIVE_ACC;
+		if (op.FRCL)
+			written |= LIVE_FRC_REG;
+		if (op.YRL)
+			written |= LIVE_Y_REG;
+		if (op.ADRL)
+			written |= LIVE_ADRS_REG;
+		if (mrd)
+			written |= LIVE_MEMVAL << ((step + 2) & 3);
+
+		info.live = op.TWT || op.IWT || op.EWT || mwt || (written & live) != 0;
+		info.accLive = info.live && (live & LIVE_ACC) != 0;
+		info.coef = info.accLive && op.YSEL == 1 ? coefValue(DSPData->COEF[step]) : CoefValue::Any;
+		if (!info.live)
+			continue;
+
+		// Registers are read before being written within a step
+		live &= ~written;
+		if (info.accLive)
+		{
+			if (!op.ZERO && op.BSEL)
+				live |= LIVE_ACC;
+			if (op.YSEL == 0)
+				live |= LIVE_FRC_REG;
+			else if (op.YSEL >= 2)
+				live |= LIVE_Y_REG;
+		}
+		if (op.TWT || op.FRCL || mwt || (op.ADRL && op.SHIFT == 3) || op.EWT)
+			// SHIFTED
+			live |= LIVE_ACC;
+		if ((mrd || mwt) && op.ADREB)
+			live |= LIVE_ADRS_REG;
+		if (op.IWT)
+			live |= LIVE_MEMVAL << (step & 3);
+	}
+}
+
 void init()
 {
 	memset(&state, 0, sizeof(state));
@@ -111,13 +193,15 @@ void init()
 	state.RBP = 0;
 	state.MDEC_CT = 1;
 	state.dirty = true;
+	keyValid = false;
 
 	recInit();
 }
 
 void writeProg(u32 addr)
 {
-	if (addr >= 0x3400 && addr < 0x3C00)
+	// COEF, MADRS and MPRO
+	if (addr >= 0x3000 && addr < 0x3C00)
 		state.dirty = true;
 }
 
@@ -131,15 +215,30 @@ void step()
 	if (state.dirty)
 	{
 		state.dirty = false;
-		state.stopped = true;
-		for (u32 instr : DSPData->MPRO)
-			if (instr != 0)
-			{
-				state.stopped = false;
-				break;
-			}
-		if (!state.stopped)
-			recompile();
+		analyzeProgram();
+
+		// Only recompile if something the compiled code depends on has changed
+		ProgramKey key;
+		memcpy(key.MPRO, DSPData->MPRO, sizeof(key.MPRO));
+		memcpy(key.MADRS, DSPData->MADRS, sizeof(key.MADRS));
+		for (int i = 0; i < 128; i++)
+			key.coefs[i] = state.steps[i].coef;
+		key.RBL = state.RBL;
+		key.RBP = state.RBP;
+		if (!keyValid || memcmp(&key, &compiledKey, sizeof(key)) != 0)
+		{
+			compiledKey = key;
+			keyValid = true;
+			state.stopped = true;
+			for (const StepInfo& info : state.steps)
+				if (info.live)
+				{
+					state.stopped = false;
+					break;
+				}
+			if (!state.stopped)
+				recompile();
+		}
 	}
 	if (state.stopped)
 		return;
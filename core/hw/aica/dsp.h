@@ -5,6 +5,22 @@
 namespace dsp
 {
 
+// Value of the COEF register used by a step, as far as the compiled code is concerned
+enum class CoefValue : u8
+{
+	Any,
+	Zero,		// Y == 0
+	MinusOne,	// Y == -4096: X * Y >> 12 == -X
+};
+
+// Result of the dataflow analysis of the microprogram
+struct StepInfo
+{
+	bool live;			// the step has a visible effect
+	bool accLive;		// the X * Y + B result is read by a later step
+	CoefValue coef;		// COEF value if YSEL == 1 and the result is used
+};
+
 struct DSPState
 {
 	// buffered DSP state
@@ -27,7 +43,9 @@ struct DSPState
 	u32 ADRS_REG;	// 13 bit
 
 	bool stopped;	// DSP program is a no-op
-	bool dirty;		// DSP program has changed
+	bool dirty;		// DSP program, coefficients or addresses have been written
+
+	StepInfo steps[128];	// analysis of the current program
 
 	void serialize(Serializer& ser)
 	{
@@ -51,6 +69,7 @@ struct DSPState
 		deser >> MDEC_CT;
 		deser.skip(33596 - 4096 * 8 - sizeof(TEMP) - sizeof(MEMS) - sizeof(MIXS) - 4 * 3 - 44,
 				Deserializer::V18);	// other dsp stuff
+		dirty = true;
 	}
 };
 
@@ -98,12 +98,19 @@ public:
 
 		for (int step = 0; step < 128; ++step)
 		{
+			const StepInfo& info = DSP->steps[step];
+			if (!info.live)
+				continue;
 			u32 *mpro = &DSPData->MPRO[step * 4];
 			Instruction op;
 			DecodeInst(mpro, &op);
 			const u32 COEF = step;
+			// X is only needed if ACC is used later and Y isn't zero
+			const bool readX = info.accLive && info.coef != CoefValue::Zero;
+			// X * Y needs a multiplication unless Y is -4096
+			const bool multiply = readX && info.coef != CoefValue::MinusOne;
 
-			if (op.XSEL || op.YRL || (op.ADRL && op.SHIFT != 3))
+			if ((op.XSEL && readX) || op.YRL || (op.ADRL && op.SHIFT != 3))
 			{
 				if (op.IRA <= 0x1f)
 					//INPUTS = DSP->MEMS[op.IRA];
@@ -135,7 +142,7 @@ public:
 
 			// Operand sel
 			// B
-			if (!op.ZERO)
+			if (info.accLive && !op.ZERO)
 			{
 				if (op.BSEL)
 					//B = ACC;
@@ -157,43 +164,49 @@ public:
 
 			// X
 			const Register* X_alias = &X;
-			if (op.XSEL)
-				//X = INPUTS;
-				X_alias = &INPUTS;
-			else
+			if (readX)
 			{
-				//X = DSP->TEMP[(TRA + DSP->MDEC_CT) & 0x7F];
-				if (!op.ZERO && !op.BSEL && !op.NEGB)
-					X_alias = &B;
+				if (op.XSEL)
+					//X = INPUTS;
+					X_alias = &INPUTS;
 				else
 				{
-					if (op.TRA)
-						Add(w1, MDEC_CT, op.TRA);
+					//X = DSP->TEMP[(TRA + DSP->MDEC_CT) & 0x7F];
+					if (!op.ZERO && !op.BSEL && !op.NEGB)
+						X_alias = &B;
 					else
-						Mov(w1, MDEC_CT);
-					Bfc(w1, 7, 25);
-					Ldr(X, dsp_operand(DSP->TEMP, x1));
+					{
+						if (op.TRA)
+							Add(w1, MDEC_CT, op.TRA);
+						else
+							Mov(w1, MDEC_CT);
+						Bfc(w1, 7, 25);
+						Ldr(X, dsp_operand(DSP->TEMP, x1));
+					}
 				}
 			}
 
 			// Y
-			if (op.YSEL == 0)
-			{
-				//Y = FRC_REG;
-				Mov(Y, FRC_REG);
-			}
-			else if (op.YSEL == 1)
+			if (multiply)
 			{
-				//Y = DSPData->COEF[COEF] >> 3;	//COEF is 16 bits
-				Ldr(Y, dspdata_operand(DSPData->COEF, COEF));
-				Sbfx(Y, Y, 3, 13);
+				if (op.YSEL == 0)
+				{
+					//Y = FRC_REG;
+					Mov(Y, FRC_REG);
+				}
+				else if (op.YSEL == 1)
+				{
+					//Y = DSPData->COEF[COEF] >> 3;	//COEF is 16 bits
+					Ldr(Y, dspdata_operand(DSPData->COEF, COEF));
+					Sbfx(Y, Y, 3, 13);
+				}
+				else if (op.YSEL == 2)
+					//Y = Y_REG >> 11;
+					Asr(Y, Y_REG, 11);
+				else if (op.YSEL == 3)
+					//Y = (Y_REG >> 4) & 0x0FFF;
+					Ubfx(Y, Y_REG, 4, 12);
 			}
-			else if (op.YSEL == 2)
-				//Y = Y_REG >> 11;
-				Asr(Y, Y_REG, 11);
-			else if (op.YSEL == 3)
-				//Y = (Y_REG >> 4) & 0x0FFF;
-				Ubfx(Y, Y_REG, 4, 12);
 
 			if (op.YRL)
 				//Y_REG = INPUTS;
@@ -240,17 +253,36 @@ public:
 			}
 
 			// ACCUM
-			//ACC = (((s64)X * (s64)Y) >> 12) + B;
-			const Register& X64 = Register::GetXRegFromCode(X_alias->GetCode());
-			const Register& Y64 = Register::GetXRegFromCode(Y.GetCode());
-			Sxtw(X64, *X_alias);
-			Sxtw(Y64, Y);
-			Mul(x0, X64, Y64);
-			Asr(x0, x0, 12);
-			if (op.ZERO)
-				Mov(ACC, w0);
-			else
-				Add(ACC, w0, B);
+			if (multiply)
+			{
+				//ACC = (((s64)X * (s64)Y) >> 12) + B;
+				const Register& X64 = Register::GetXRegFromCode(X_alias->GetCode());
+				const Register& Y64 = Register::GetXRegFromCode(Y.GetCode());
+				Sxtw(X64, *X_alias);
+				Sxtw(Y64, Y);
+				Mul(x0, X64, Y64);
+				Asr(x0, x0, 12);
+				if (op.ZERO)
+					Mov(ACC, w0);
+				else
+					Add(ACC, w0, B);
+			}
+			else if (readX)
+			{
+				//ACC = B - X;	// Y == -4096
+				if (op.ZERO)
+					Neg(ACC, *X_alias);
+				else
+					Sub(ACC, B, *X_alias);
+			}
+			else if (info.accLive)
+			{
+				//ACC = B;		// Y == 0
+				if (op.ZERO)
+					Mov(ACC, 0);
+				else
+					Mov(ACC, B);
+			}
 
 			if (op.TWT)
 			{
@@ -392,17 +424,25 @@ private:
 
 	void CalculateADDR(const Register& ADDR, const Instruction& op, const Register& ADRS_REG, const Register& MDEC_CT)
 	{
+		// MADRS is constant for this program
+		u32 madrs = DSPData->MADRS[op.MASA];
+		if (op.NXADR)
+			madrs++;
+		if (op.TABLE && !op.ADREB)
+		{
+			// Constant address
+			Mov(ADDR, (((madrs & 0xFFFF) << 1) + DSP->RBP) & ARAM_MASK);
+			return;
+		}
 		//u32 ADDR = DSPData->MADRS[op.MASA];
-		Ldr(ADDR, dspdata_operand(DSPData->MADRS, op.MASA));
+		//ADDR++;	// if NXADR
+		Mov(ADDR, madrs);
 		if (op.ADREB)
 		{
 			//ADDR += ADRS_REG & 0x0FFF;
 			Ubfx(w0, ADRS_REG, 0, 12);
 			Add(ADDR, ADDR, w0);
 		}
-		if (op.NXADR)
-			//ADDR++;
-			Add(ADDR, ADDR, 1);
 		if (!op.TABLE)
 		{
 			//ADDR += DSP->MDEC_CT;
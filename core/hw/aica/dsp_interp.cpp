@@ -34,6 +34,8 @@ void runStep()
 
 	for (int step = 0; step < 128; ++step)
 	{
+		if (!state.steps[step].live)
+			continue;
 		u32 *IPtr = DSPData->MPRO + step * 4;
 
 		if (IPtr[0] == 0 && IPtr[1] == 0 && IPtr[2] == 0 && IPtr[3] == 0)
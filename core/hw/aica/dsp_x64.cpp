@@ -93,12 +93,19 @@ public:
 
 		for (int step = 0; step < 128; ++step)
 		{
+			const StepInfo& info = DSP->steps[step];
+			if (!info.live)
+				continue;
 			u32 *mpro = &DSPData->MPRO[step * 4];
 			Instruction op;
 			DecodeInst(mpro, &op);
 			const u32 COEF = step;
+			// X is only needed if ACC is used later and Y isn't zero
+			const bool readX = info.accLive && info.coef != CoefValue::Zero;
+			// X * Y needs a multiplication unless Y is -4096
+			const bool multiply = readX && info.coef != CoefValue::MinusOne;
 
-			if (op.XSEL || op.YRL || (op.ADRL && op.SHIFT != 3))
+			if ((op.XSEL && readX) || op.YRL || (op.ADRL && op.SHIFT != 3))
 			{
 				if (op.IRA <= 0x1f)
 					//INPUTS = DSP->MEMS[op.IRA];
@@ -130,7 +137,7 @@ public:
 
 			// Operand sel
 			// B
-			if (!op.ZERO)
+			if (info.accLive && !op.ZERO)
 			{
 				if (op.BSEL)
 					//B = ACC;
@@ -151,48 +158,54 @@ public:
 
 			// X
 			Xbyak::Reg32 X_alias = X;
-			if (op.XSEL)
-				//X = INPUTS;
-				X_alias = INPUTS;
-			else
+			if (readX)
 			{
-				//X = DSP->TEMP[(TRA + DSP->MDEC_CT) & 0x7F];
-				if (!op.ZERO && !op.BSEL && !op.NEGB)
-					X_alias = B;
+				if (op.XSEL)
+					//X = INPUTS;
+					X_alias = INPUTS;
 				else
 				{
-					mov(eax, MDEC_CT);
-					if (op.TRA)
-						add(eax, op.TRA);
-					and_(eax, 0x7f);
-					mov(X, dword[rbx + rax * 4]);
+					//X = DSP->TEMP[(TRA + DSP->MDEC_CT) & 0x7F];
+					if (!op.ZERO && !op.BSEL && !op.NEGB)
+						X_alias = B;
+					else
+					{
+						mov(eax, MDEC_CT);
+						if (op.TRA)
+							add(eax, op.TRA);
+						and_(eax, 0x7f);
+						mov(X, dword[rbx + rax * 4]);
+					}
 				}
 			}
 
 			// Y
-			if (op.YSEL == 0)
+			if (multiply)
 			{
-				//Y = FRC_REG;
-				mov(Y, dword[rbx + dsp_operand(&DSP->FRC_REG)]);
-			}
-			else if (op.YSEL == 1)
-			{
-				//Y = DSPData->COEF[COEF] >> 3;	//COEF is 16 bits
-				movsx(Y, word[rbp + dspdata_operand(DSPData->COEF, COEF)]);
-				sar(Y, 3);
-			}
-			else if (op.YSEL == 2)
-			{
-				//Y = Y_REG >> 11;
-				mov(Y, Y_REG);
-				sar(Y, 11);
-			}
-			else if (op.YSEL == 3)
-			{
-				//Y = (Y_REG >> 4) & 0x0FFF;
-				mov(Y, Y_REG);
-				sar(Y, 4);
-				and_(Y, 0x0fff);
+				if (op.YSEL == 0)
+				{
+					//Y = FRC_REG;
+					mov(Y, dword[rbx + dsp_operand(&DSP->FRC_REG)]);
+				}
+				else if (op.YSEL == 1)
+				{
+					//Y = DSPData->COEF[COEF] >> 3;	//COEF is 16 bits
+					movsx(Y, word[rbp + dspdata_operand(DSPData->COEF, COEF)]);
+					sar(Y, 3);
+				}
+				else if (op.YSEL == 2)
+				{
+					//Y = Y_REG >> 11;
+					mov(Y, Y_REG);
+					sar(Y, 11);
+				}
+				else if (op.YSEL == 3)
+				{
+					//Y = (Y_REG >> 4) & 0x0FFF;
+					mov(Y, Y_REG);
+					sar(Y, 4);
+					and_(Y, 0x0fff);
+				}
 			}
 
 			if (op.YRL)
@@ -241,15 +254,40 @@ public:
 			}
 
 			// ACCUM
-			//ACC = (((s64)X * (s64)Y) >> 12) + B;
-			const Xbyak::Reg64 Xlong = X_alias.cvt64();
-			movsxd(Xlong, X_alias);
-			movsxd(rax, Y);
-			imul(rax, Xlong);
-			sar(rax, 12);
-			mov(ACC, eax);
-			if (!op.ZERO)
-				add(ACC, B);
+			if (multiply)
+			{
+				//ACC = (((s64)X * (s64)Y) >> 12) + B;
+				const Xbyak::Reg64 Xlong = X_alias.cvt64();
+				movsxd(Xlong, X_alias);
+				movsxd(rax, Y);
+				imul(rax, Xlong);
+				sar(rax, 12);
+				mov(ACC, eax);
+				if (!op.ZERO)
+					add(ACC, B);
+			}
+			else if (readX)
+			{
+				//ACC = B - X;	// Y == -4096
+				if (op.ZERO)
+				{
+					mov(ACC, X_alias);
+					neg(ACC);
+				}
+				else
+				{
+					mov(ACC, B);
+					sub(ACC, X_alias);
+				}
+			}
+			else if (info.accLive)
+			{
+				//ACC = B;		// Y == 0
+				if (op.ZERO)
+					xor_(ACC, ACC);
+				else
+					mov(ACC, B);
+			}
 
 			if (op.TWT)
 			{
@@ -370,8 +408,19 @@ private:
 
 	void CalculateADDR(const Xbyak::Reg32 ADDR, const Instruction& op, const Xbyak::Reg32 ADRS_REG, const Xbyak::Reg32 MDEC_CT)
 	{
+		// MADRS is constant for this program
+		u32 madrs = DSPData->MADRS[op.MASA];
+		if (op.NXADR)
+			madrs++;
+		if (op.TABLE && !op.ADREB)
+		{
+			// Constant address
+			mov(ADDR, ((((madrs & 0xFFFF) << 1) + DSP->RBP) & ARAM_MASK));
+			return;
+		}
 		//u32 ADDR = DSPData->MADRS[op.MASA];
-		mov(ADDR, dword[rbp + dspdata_operand(DSPData->MADRS, op.MASA)]);
+		//ADDR++;	// if NXADR
+		mov(ADDR, madrs);
 		if (op.ADREB)
 		{
 			//ADDR += ADRS_REG & 0x0FFF;
@@ -379,9 +428,6 @@ private:
 			and_(ecx, 0x0FFF);
 			add(ADDR, ecx);
 		}
-		if (op.NXADR)
-			//ADDR++;
-			add(ADDR, 1);
 		if (!op.TABLE)
 		{
 			//ADDR += DSP->MDEC_CT;
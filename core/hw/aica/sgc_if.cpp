@@ -27,9 +27,20 @@
 #include "hw/gdrom/gdrom_if.h"
 #include "cfg/option.h"
 #include "serialize.h"
+#include "log/BitSet.h"
 
 #include <algorithm>
 #include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#define AICA_SIMD_SSE2
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define AICA_SIMD_NEON
+#endif
 
 #undef FAR
 
@@ -164,10 +175,168 @@ static void clip16(T& v) {
 	clip<T>(v, -32768, 32767);
 }
 
+// Outputs of the enabled channels for one sample, in structure-of-arrays form.
+// Entries [count, count + 3] must be zeroed before mixing.
+struct ChannelMix
+{
+	alignas(16) SampleType s0[64];
+	alignas(16) SampleType s1[64];
+	alignas(16) s32 fp[64];
+	alignas(16) SampleType sample[64];
+	alignas(16) s32 volL[64];
+	alignas(16) s32 volR[64];
+	alignas(16) s32 volDsp[64];
+	alignas(16) SampleType dsp[64];
+	s32 filterCoef[64];
+	// channels going through the low-pass filter
+	u8 filtered[64];
+	u8 channel[64];
+	SampleType *dspOut[64];
+	u32 count;
+	u32 filteredCount;
+
+	void interpolate();
+	void applyVolume(SampleType& mixl, SampleType& mixr, bool dspFallback);
+};
+
+#if defined(AICA_SIMD_SSE2)
+static inline __m128i mul32(__m128i a, __m128i b)
+{
+#ifdef __SSE4_1__
+	return _mm_mullo_epi32(a, b);
+#else
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+static inline s32 sum32(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+#elif defined(AICA_SIMD_NEON)
+static inline s32 sum32(int32x4_t v)
+{
+#if HOST_CPU == CPU_ARM64
+	return vaddvq_s32(v);
+#else
+	int32x2_t s = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+	return vget_lane_s32(vpadd_s32(s, s), 0);
+#endif
+}
+#endif
+
+// sample = s0 * (1 - fp) + s1 * fp
+void ChannelMix::interpolate()
+{
+	u32 i = 0;
+#if defined(AICA_SIMD_SSE2)
+	const __m128i one = _mm_set1_epi32(1024);
+	for (; i < count; i += 4)
+	{
+		__m128i f = _mm_load_si128((const __m128i *)&fp[i]);
+		__m128i a = _mm_srai_epi32(mul32(_mm_load_si128((const __m128i *)&s0[i]), _mm_sub_epi32(one, f)), 10);
+		__m128i b = _mm_srai_epi32(mul32(_mm_load_si128((const __m128i *)&s1[i]), f), 10);
+		_mm_store_si128((__m128i *)&sample[i], _mm_add_epi32(a, b));
+	}
+#elif defined(AICA_SIMD_NEON)
+	const int32x4_t one = vdupq_n_s32(1024);
+	for (; i < count; i += 4)
+	{
+		int32x4_t f = vld1q_s32(&fp[i]);
+		int32x4_t a = vshrq_n_s32(vmulq_s32(vld1q_s32(&s0[i]), vsubq_s32(one, f)), 10);
+		int32x4_t b = vshrq_n_s32(vmulq_s32(vld1q_s32(&s1[i]), f), 10);
+		vst1q_s32(&sample[i], vaddq_s32(a, b));
+	}
+#endif
+	for (; i < count; i++)
+		sample[i] = FPMul(s0[i], 1024 - fp[i], 10) + FPMul(s1[i], fp[i], 10);
+}
+
+// Applies the channel volumes, and adds the direct outputs to mixl and mixr.
+// If dspFallback is set, channels without direct output are sent to both sides.
+void ChannelMix::applyVolume(SampleType& mixl, SampleType& mixr, bool dspFallback)
+{
+	u32 i = 0;
+#if defined(AICA_SIMD_SSE2)
+	const __m128i fallback = _mm_set1_epi32(dspFallback ? -1 : 0);
+	__m128i suml = _mm_setzero_si128();
+	__m128i sumr = _mm_setzero_si128();
+	for (; i < count; i += 4)
+	{
+		__m128i smp = _mm_load_si128((const __m128i *)&sample[i]);
+		__m128i l = _mm_srai_epi32(mul32(smp, _mm_load_si128((const __m128i *)&volL[i])), 15);
+		__m128i r = _mm_srai_epi32(mul32(smp, _mm_load_si128((const __m128i *)&volR[i])), 15);
+		__m128i d = _mm_srai_epi32(mul32(smp, _mm_load_si128((const __m128i *)&volDsp[i])), 11);
+		_mm_store_si128((__m128i *)&dsp[i], d);
+		__m128i mask = _mm_and_si128(fallback, _mm_cmpeq_epi32(_mm_add_epi32(l, r), _mm_setzero_si128()));
+		d = _mm_and_si128(mask, _mm_srai_epi32(d, 4));
+		suml = _mm_add_epi32(suml, _mm_or_si128(d, _mm_andnot_si128(mask, l)));
+		sumr = _mm_add_epi32(sumr, _mm_or_si128(d, _mm_andnot_si128(mask, r)));
+	}
+	mixl += sum32(suml);
+	mixr += sum32(sumr);
+#elif defined(AICA_SIMD_NEON)
+	const uint32x4_t fallback = vdupq_n_u32(dspFallback ? ~0u : 0);
+	int32x4_t suml = vdupq_n_s32(0);
+	int32x4_t sumr = vdupq_n_s32(0);
+	for (; i < count; i += 4)
+	{
+		int32x4_t smp = vld1q_s32(&sample[i]);
+		int32x4_t l = vshrq_n_s32(vmulq_s32(smp, vld1q_s32(&volL[i])), 15);
+		int32x4_t r = vshrq_n_s32(vmulq_s32(smp, vld1q_s32(&volR[i])), 15);
+		int32x4_t d = vshrq_n_s32(vmulq_s32(smp, vld1q_s32(&volDsp[i])), 11);
+		vst1q_s32(&dsp[i], d);
+		uint32x4_t mask = vandq_u32(fallback, vceqq_s32(vaddq_s32(l, r), vdupq_n_s32(0)));
+		d = vshrq_n_s32(d, 4);
+		suml = vaddq_s32(suml, vbslq_s32(mask, d, l));
+		sumr = vaddq_s32(sumr, vbslq_s32(mask, d, r));
+	}
+	mixl += sum32(suml);
+	mixr += sum32(sumr);
+#endif
+	for (; i < count; i++)
+	{
+		SampleType oLeft = FPMul(sample[i], volL[i], 15);
+		SampleType oRight = FPMul(sample[i], volR[i], 15);
+		dsp[i] = FPMul(sample[i], volDsp[i], 11);	// 20 bits
+		if (oLeft + oRight == 0 && dspFallback)
+			oLeft = oRight = dsp[i] >> 4;
+		mixl += oLeft;
+		mixr += oRight;
+	}
+}
+
 const DSP_OUT_VOL_REG *dsp_out_vol = (DSP_OUT_VOL_REG *)&aica_reg[0x2000];
 static int beepOn;
 static int beepPeriod;
 static int beepCounter;
+// Samples are generated in blocks when the sound registers are accessed, when the AICA ram
+// they read is written, or when this many are pending
+constexpr u32 MAX_PENDING_SAMPLES = 64;
+static u32 pendingSamples;
+u32 aicaWatchedPages[ARAM_SIZE_MAX >> AICA_WATCH_PAGE_SHIFT];
+u32 aicaWatchGeneration = 1;
+
+// Forgets the watched pages
+static void unwatchAicaRam()
+{
+	if (++aicaWatchGeneration == 0)
+	{
+		memset(aicaWatchedPages, 0, sizeof(aicaWatchedPages));
+		aicaWatchGeneration = 1;
+	}
+}
+
+static void watchAicaRam(u32 start, u32 size)
+{
+	const u32 end = std::min(start + size, ARAM_SIZE);
+	for (u32 page = start >> AICA_WATCH_PAGE_SHIFT; page < (end + (1 << AICA_WATCH_PAGE_SHIFT) - 1) >> AICA_WATCH_PAGE_SHIFT; page++)
+		aicaWatchedPages[page] = aicaWatchGeneration;
+}
 
 #pragma pack(push, 1)
 //All regs are 16b , aligned to 32b (upper bits 0?)
@@ -341,6 +510,8 @@ static void (* PLFOWS_CALC[4])(ChannelEx* ch);
 struct ChannelEx
 {
 	static ChannelEx Chans[64];
+	// Bit n is set if channel n is enabled
+	static u64 activeChannels;
 
 	ChannelCommonData* ccd;
 
@@ -460,112 +631,105 @@ struct ChannelEx
 
 	void disable()
 	{
-		enabled=false;
+		setEnabled(false);
 		SetAegState(EG_Release);
 		AEG.SetValue(0x3FF);
 	}
 
 	void enable()
 	{
-		enabled=true;
+		setEnabled(true);
 	}
 
-	SampleType InterpolateSample()
+	void setEnabled(bool enabled)
 	{
-		SampleType rv;
-		u32 fp=step.fp;
-		rv=FPMul(s0,(s32)(1024-fp),10);
-		rv+=FPMul(s1,(s32)(fp),10);
-
-		return rv;
+		this->enabled = enabled;
+		if (enabled)
+			activeChannels |= 1ull << ChannelNumber;
+		else
+			activeChannels &= ~(1ull << ChannelNumber);
 	}
 
-	bool Step(SampleType& oLeft, SampleType& oRight, SampleType& oDsp)
+	// Adds the channel to the mix of the current sample then advances its state
+	void Step(ChannelMix& mix)
 	{
-		if (!enabled)
+		const u32 i = mix.count++;
+		mix.s0[i] = s0;
+		mix.s1[i] = s1;
+		mix.fp[i] = step.fp;
+		mix.dspOut[i] = VolMix.DSPOut;
+		mix.channel[i] = ChannelNumber;
+
+		// Low-pass filter
+		if (FEG.active)
 		{
-			oLeft=oRight=oDsp=0;
-			return false;
+			u32 fv = FEG.GetValue();
+			s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
+			mix.filterCoef[i] = std::max(1, f);
+			mix.filtered[mix.filteredCount++] = i;
 		}
-		else
-		{
-			SampleType sample = InterpolateSample();
 
-			// Low-pass filter
-			if (FEG.active)
-			{
-				u32 fv = FEG.GetValue();
-				s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
-				f = std::max(1, f);
-				sample = f * sample + (0x2000 - f + FEG.q) * FEG.prev1 - FEG.q * FEG.prev2;
-				sample >>= 13;
-				clip16(sample);
-				FEG.prev2 = FEG.prev1;
-				FEG.prev1 = sample;
-			}
-
-			//Volume & Mixer processing
-			//All attenuations are added together then applied and mixed :)
+		//Volume & Mixer processing
+		//All attenuations are added together then applied and mixed :)
 
-			//offset is up to 511
-			//*Att is up to 511
-			//logtable handles up to 1024, anything >=255 is mute
+		//offset is up to 511
+		//*Att is up to 511
+		//logtable handles up to 1024, anything >=255 is mute
 
-			u32 ofsatt;
-			if (ccd->VOFF == 1)
-			{
-				ofsatt = 0;
-			}
-			else
-			{
-				ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
-				ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
-			}
-			u32 const max_att = ((16 << 4) - 1) - ofsatt;
-			
-			s32* logtable = ofsatt + tl_lut;
-
-			u32 dl = std::min(VolMix.DLAtt, max_att);
-			u32 dr = std::min(VolMix.DRAtt, max_att);
-			u32 ds = std::min(VolMix.DSPAtt, max_att);
-
-			oLeft = FPMul(sample, logtable[dl], 15);
-			oRight = FPMul(sample, logtable[dr], 15);
-			oDsp = FPMul(sample, logtable[ds], 11);	// 20 bits
-
-			clip_verify(((s16)oLeft)==oLeft);
-			clip_verify(((s16)oRight)==oRight);
-			clip_verify((oDsp << 12) >> 12 == oDsp);
-			clip_verify(sample*oLeft>=0);
-			clip_verify(sample*oRight>=0);
-			clip_verify((s64)sample*oDsp>=0);
-
-			StepAEG(this);
-			StepFEG(this);
-			StepStream(this);
-			lfo.Step(this);
-			return true;
+		u32 ofsatt;
+		if (ccd->VOFF == 1)
+		{
+			ofsatt = 0;
 		}
-	}
-
-	void Step(SampleType& mixl, SampleType& mixr)
-	{
-		SampleType oLeft,oRight,oDsp;
+		else
+		{
+			ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
+			ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
+		}
+		u32 const max_att = ((16 << 4) - 1) - ofsatt;
 
-		Step(oLeft, oRight, oDsp);
+		s32* logtable = ofsatt + tl_lut;
 
-		*VolMix.DSPOut += oDsp;
-		if (oLeft + oRight == 0 && !config::DSPEnabled)
-			oLeft = oRight = oDsp >> 4;
+		mix.volL[i] = logtable[std::min(VolMix.DLAtt, max_att)];
+		mix.volR[i] = logtable[std::min(VolMix.DRAtt, max_att)];
+		mix.volDsp[i] = logtable[std::min(VolMix.DSPAtt, max_att)];
 
-		mixl+=oLeft;
-		mixr+=oRight;
+		StepAEG(this);
+		StepFEG(this);
+		StepStream(this);
+		lfo.Step(this);
 	}
 
 	static void StepAll(SampleType& mixl, SampleType& mixr)
 	{
-		for (ChannelEx& channel : Chans)
-			channel.Step(mixl, mixr);
+		static ChannelMix mix;
+		mix.count = 0;
+		mix.filteredCount = 0;
+		for (u64 mask = activeChannels; mask != 0; mask &= mask - 1)
+			Chans[Common::LeastSignificantSetBit(mask)].Step(mix);
+		if (mix.count == 0)
+			return;
+		// Pad to a multiple of the vector size with muted channels
+		for (u32 i = mix.count; i & 3; i++)
+		{
+			mix.s0[i] = mix.s1[i] = mix.fp[i] = 0;
+			mix.volL[i] = mix.volR[i] = mix.volDsp[i] = 0;
+		}
+		mix.interpolate();
+		for (u32 j = 0; j < mix.filteredCount; j++)
+		{
+			const u32 i = mix.filtered[j];
+			ChannelEx& ch = Chans[mix.channel[i]];
+			SampleType sample = mix.filterCoef[i] * mix.sample[i] + (0x2000 - mix.filterCoef[i] + ch.FEG.q) * ch.FEG.prev1 - ch.FEG.q * ch.FEG.prev2;
+			sample >>= 13;
+			clip16(sample);
+			ch.FEG.prev2 = ch.FEG.prev1;
+			ch.FEG.prev1 = sample;
+			mix.sample[i] = sample;
+		}
+		mix.applyVolume(mixl, mixr, !config::DSPEnabled);
+		for (u32 i = 0; i < mix.count; i++)
+			*mix.dspOut[i] += mix.dsp[i];
 	}
 
 	void SetAegState(_EG_state newstate)
@@ -1254,6 +1418,7 @@ static void staticinitialise()
 }
 
 ChannelEx ChannelEx::Chans[64];
+u64 ChannelEx::activeChannels;
 
 #define Chans ChannelEx::Chans
 
@@ -1322,6 +1487,8 @@ void sgc_Init()
 	beepOn = 0;
 	beepPeriod = 0;
 	beepCounter = 0;
+	pendingSamples = 0;
+	unwatchAicaRam();
 
 	dsp::init();
 }
@@ -1426,7 +1593,8 @@ constexpr int CDDA_SIZE = 2352 / 2;
 static s16 cdda_sector[CDDA_SIZE];
 static u32 cdda_index = CDDA_SIZE;
 
-void AICA_Sample()
+// Returns false if the sample is muted
+static bool generateSample(SoundFrame& frame)
 {
 	SampleType mixl,mixr;
 	mixl = 0;
@@ -1466,7 +1634,7 @@ void AICA_Sample()
 	}
 
 	if (settings.input.fastForwardMode || settings.aica.muteAudio)
-		return;
+		return false;
 
 	SampleType beep = vmuBeepSample();
 	mixl += beep;
@@ -1504,7 +1672,52 @@ void AICA_Sample()
 	clip16(mixl);
 	clip16(mixr);
 
-	WriteSample(mixr,mixl);
+	frame.l = mixl;
+	frame.r = mixr;
+	return true;
+}
+
+// Watches the AICA ram the queued samples may read: the samples of the enabled channels
+// up to their loop end and the dsp ring buffer.
+// Channel and dsp registers can't change while samples are queued.
+static void watchPendingReads()
+{
+	unwatchAicaRam();
+	for (u64 mask = ChannelEx::activeChannels; mask != 0; mask &= mask - 1)
+	{
+		const ChannelEx& channel = Chans[Common::LeastSignificantSetBit(mask)];
+		if (channel.ccd->SSCTL)
+			// noise
+			continue;
+		// 16-bit samples at most
+		watchAicaRam(channel.SA - &aica_ram[0], (channel.loop.LEA + 1) * 2);
+	}
+	if (config::DSPEnabled)
+		// table reads can reach 64K words
+		watchAicaRam(dsp::state.RBP, 0x20000);
+}
+
+void AICA_Sample()
+{
+	if (++pendingSamples == 1)
+		watchPendingReads();
+	if (pendingSamples == MAX_PENDING_SAMPLES)
+		AICA_FlushSamples();
+}
+
+void AICA_FlushSamples()
+{
+	if (pendingSamples == 0)
+		return;
+	unwatchAicaRam();
+	SoundFrame frames[MAX_PENDING_SAMPLES];
+	u32 count = 0;
+	for (u32 i = 0; i < pendingSamples; i++)
+		if (generateSample(frames[count]))
+			count++;
+	pendingSamples = 0;
+	if (count > 0)
+		WriteSamples(frames, count);
 }
 
 void channel_serialize(Serializer& ser)
@@ -1548,6 +1761,8 @@ void channel_serialize(Serializer& ser)
 
 void channel_deserialize(Deserializer& deser)
 {
+	pendingSamples = 0;
+	unwatchAicaRam();
 	if (deser.version() < Deserializer::V7_LIBRETRO)
 	{
 		deser.skip(4 * 16); 		// volume_lut
@@ -1654,7 +1869,9 @@ void channel_deserialize(Deserializer& deser)
 			deser.skip<u8>();   // channel.lfo.plfo_calc_lut
 		}
 		channel.UpdateLFO(true);
-		deser >> channel.enabled;
+		bool enabled;
+		deser >> enabled;
+		channel.setEnabled(enabled);
 		if (old_format)
 			deser.skip<u32>(); // channel.ChannelNumber
 		channel.quiet = false;
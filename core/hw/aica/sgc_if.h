@@ -1,8 +1,24 @@
 #pragma once
 #include "types.h"
 
+// Queues the generation of a sample
 void AICA_Sample();
-void AICA_Sample32();
+// Generates the queued samples and sends them to the audio output
+void AICA_FlushSamples();
+
+// AICA ram read by the queued samples, in 4 KB pages.
+// A page is read if its entry is equal to aicaWatchGeneration.
+constexpr u32 AICA_WATCH_PAGE_SHIFT = 12;
+extern u32 aicaWatchedPages[];
+extern u32 aicaWatchGeneration;
+
+// Must be called before writing to the AICA ram so that the queued samples
+// don't read the new data
+static inline void AICA_RamWrite(u32 addr)
+{
+	if (unlikely(aicaWatchedPages[(addr & ARAM_MASK) >> AICA_WATCH_PAGE_SHIFT] == aicaWatchGeneration))
+		AICA_FlushSamples();
+}
 
 void WriteChannelReg(u32 channel, u32 reg, int size);
 
@@ -76,12 +76,31 @@ void aicaarm::avoidRaceCondition()
 	arm7ClockTicks = std::min(arm7ClockTicks, -50);
 }
 
+static u32 skippedSamples;
+
+void aicaarm::stopAtNextSample()
+{
+	int cycles = -arm7ClockTicks;
+	if (cycles > (int)ARM_CYCLES_PER_SAMPLE)
+	{
+		u32 skipped = (cycles - 1) / ARM_CYCLES_PER_SAMPLE;
+		arm7ClockTicks += skipped * ARM_CYCLES_PER_SAMPLE;
+		skippedSamples += skipped;
+	}
+}
+
 void aicaarm::run(u32 samples)
 {
-	for (u32 i = 0; i < samples; i++)
+	while (samples > 0)
 	{
-		runInterpreter(ARM_CYCLES_PER_SAMPLE);
-		libAICA_TimeStep();
+		// Run the arm7 until the next timer or interrupt event it can observe
+		u32 batch = libAICA_NextEventSamples(samples);
+		skippedSamples = 0;
+		runInterpreter(ARM_CYCLES_PER_SAMPLE * batch);
+		batch -= skippedSamples;
+		for (u32 i = 0; i < batch; i++)
+			libAICA_TimeStep();
+		samples -= batch;
 	}
 }
 #endif
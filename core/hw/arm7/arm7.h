@@ -9,6 +9,8 @@ void run(u32 samples);
 void enable(bool enabled);
 // Called when the arm interrupts the SH4 to make sure it has enough cycles to finish what it's doing.
 void avoidRaceCondition();
+// Called when the arm reprograms a timer or interrupt so that it stops running ahead of the sound generation.
+void stopAtNextSample();
 }
 
 enum Arm7Reg
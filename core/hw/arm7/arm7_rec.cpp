@@ -26,6 +26,7 @@
 #include "hw/aica/aica_if.h"
 #include "hw/mem/_vmem.h"
 #include "arm_mem.h"
+#include "profiler/bench.h"
 
 #if 0
 // for debug
@@ -659,10 +660,47 @@ void compile()
 	block_ssa_pass();
 
 	arm7backend_compile(block_ops, cycles);
+	bench::stats.arm7BlocksCompiled++;
 
 	arm_printf("arm7rec_compile done: %p,%p", rv, icPtr);
 }
 
+// Returns the addresses of the blocks that follow this one if they are known at compile time.
+// They differ when the block ends with a conditional branch.
+bool getBlockSuccessors(const std::vector<ArmOp>& block_ops, u32& taken, u32& notTaken)
+{
+	if (block_ops.empty())
+		return false;
+	const ArmOp& last = block_ops.back();
+	if (last.op_type == ArmOp::MOV && last.condition == ArmOp::AL && last.rd.isReg()
+			&& last.rd.getReg().armreg == R15_ARM_NEXT && last.arg[0].isImmediate())
+	{
+		// block split or mov pc, #imm
+		taken = notTaken = last.arg[0].getImmediate();
+		return true;
+	}
+	if ((last.op_type != ArmOp::B && last.op_type != ArmOp::BL) || !last.arg[0].isImmediate())
+		return false;
+	taken = last.arg[0].getImmediate();
+	if (last.condition == ArmOp::AL)
+	{
+		notTaken = taken;
+		return true;
+	}
+	// conditional branches are preceded by "mov armNextPC, pc + 4"
+	for (auto it = block_ops.rbegin() + 1; it != block_ops.rend(); ++it)
+	{
+		if (it->rd.isReg() && it->rd.getReg().armreg == R15_ARM_NEXT)
+		{
+			if (it->op_type != ArmOp::MOV || it->condition != ArmOp::AL || !it->arg[0].isImmediate())
+				return false;
+			notTaken = it->arg[0].getImmediate();
+			return true;
+		}
+	}
+	return false;
+}
+
 void flush()
 {
 	icPtr = ICache;
@@ -738,16 +776,24 @@ void *getMemOp(bool Load, bool Byte)
 } // recompiler ns
 // Run a timeslice of arm7
 
+static u32 skippedSamples;
+
 void run(u32 samples)
 {
-	for (u32 i = 0; i < samples; i++)
+	while (samples > 0)
 	{
+		// Run the arm7 until the next timer or interrupt event it can observe
+		u32 batch = libAICA_NextEventSamples(samples);
 		if (Arm7Enabled)
 		{
-			arm_Reg[CYCL_CNT].I += ARM_CYCLES_PER_SAMPLE;
+			skippedSamples = 0;
+			arm_Reg[CYCL_CNT].I += ARM_CYCLES_PER_SAMPLE * batch;
 			arm_mainloop(arm_Reg, recompiler::EntryPoints);
+			batch -= skippedSamples;
 		}
-		libAICA_TimeStep();
+		for (u32 i = 0; i < batch; i++)
+			libAICA_TimeStep();
+		samples -= batch;
 	}
 }
 
@@ -756,5 +802,16 @@ void avoidRaceCondition()
 	arm_Reg[CYCL_CNT].I = std::max((int)arm_Reg[CYCL_CNT].I, 50);
 }
 
+void stopAtNextSample()
+{
+	int cycles = (int)arm_Reg[CYCL_CNT].I;
+	if (cycles > (int)ARM_CYCLES_PER_SAMPLE)
+	{
+		u32 skipped = (cycles - 1) / ARM_CYCLES_PER_SAMPLE;
+		arm_Reg[CYCL_CNT].I -= skipped * ARM_CYCLES_PER_SAMPLE;
+		skippedSamples += skipped;
+	}
+}
+
 } // aicarm ns
 #endif // FEAT_AREC != DYNAREC_NONE
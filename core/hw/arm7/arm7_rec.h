@@ -423,12 +423,14 @@ namespace recompiler {
 void init();
 void flush();
 void compile();
+bool getBlockSuccessors(const std::vector<ArmOp>& block_ops, u32& taken, u32& notTaken);
 void *getMemOp(bool load, bool byte);
 template<u32 Pd> void DYNACALL MSR_do(u32 v);
 void DYNACALL interpret(u32 opcode);
 
 extern u8* icPtr;
 extern u8* ICache;
+extern void (*EntryPoints[ARAM_SIZE_MAX / 4])();
 const u32 ICacheSize = 1024 * 1024 * 4;
 
 static inline void *currentCode() {
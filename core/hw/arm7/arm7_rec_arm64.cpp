@@ -560,6 +560,26 @@ class Arm7Compiler : public MacroAssembler
 		call((void*)recompiler::interpret);
 	}
 
+	void emitLink(u32 target)
+	{
+		// Blocks are only discarded when the whole cache is flushed, so the target can be branched to directly
+		// once it's compiled. Otherwise go through the entry point table.
+		u32 index = (target & (ARAM_SIZE_MAX - 1)) / 4;
+		void (*entry)() = recompiler::EntryPoints[index];
+		if (entry != arm_compilecode)
+		{
+			ptrdiff_t offset = reinterpret_cast<uintptr_t>(recompiler::execToWrite((void *)entry)) - GetBuffer()->GetStartAddress<uintptr_t>();
+			Label blockLabel;
+			BindToOffset(&blockLabel, offset);
+			B(&blockLabel);
+		}
+		else
+		{
+			Ldr(x3, MemOperand(x26, index * sizeof(void *)));
+			Br(x3);
+		}
+	}
+
 public:
 	Arm7Compiler() : MacroAssembler((u8 *)recompiler::currentCode(), recompiler::spaceLeft()) {}
 
@@ -617,6 +637,26 @@ public:
 			endConditional(condLabel);
 		}
 
+		u32 taken, notTaken;
+		Label dispatchLabel;
+		if (recompiler::getBlockSuccessors(block_ops, taken, notTaken))
+		{
+			// Jump directly to the next block unless the timeslice is over or an interrupt is pending
+			Ldr(w3, arm_reg_operand(CYCL_CNT));
+			Ldp(w0, w1, arm_reg_operand(R15_ARM_NEXT));
+			Tbnz(w3, 31, &dispatchLabel);
+			Cbnz(w1, &dispatchLabel);
+			if (taken != notTaken)
+			{
+				Label notTakenLabel;
+				Cmp(w0, taken);
+				B(&notTakenLabel, ne);
+				emitLink(taken);
+				Bind(&notTakenLabel);
+			}
+			emitLink(notTaken);
+		}
+		Bind(&dispatchLabel);
 		ptrdiff_t offset = reinterpret_cast<uintptr_t>(arm_dispatch) - GetBuffer()->GetStartAddress<uintptr_t>();
 		Label arm_dispatch_label;
 		BindToOffset(&arm_dispatch_label, offset);
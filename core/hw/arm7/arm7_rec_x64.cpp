@@ -802,6 +802,17 @@ class Arm7Compiler : public Xbyak::CodeGenerator
 		call(recompiler::interpret);
 	}
 
+	void emitLink(u32 target)
+	{
+		// Blocks are only discarded when the whole cache is flushed, so the target can be jumped to directly
+		// once it's compiled. Otherwise go through the entry point table.
+		void (**entry)() = &recompiler::EntryPoints[(target & (ARAM_SIZE_MAX - 1)) / 4];
+		if (*entry != arm_compilecode)
+			jmp((const void *)*entry, T_NEAR);
+		else
+			jmp(qword[rip + entry]);
+	}
+
 public:
 	Arm7Compiler() : Xbyak::CodeGenerator(recompiler::spaceLeft(), recompiler::currentCode()) { }
 
@@ -870,7 +881,28 @@ public:
 		}
 		endConditional(condLabel);
 
-		jmp((void*)arm_dispatch);
+		u32 taken, notTaken;
+		if (recompiler::getBlockSuccessors(block_ops, taken, notTaken))
+		{
+			// Jump directly to the next block unless the timeslice is over or an interrupt is pending
+			cmp(dword[rip + &arm_Reg[CYCL_CNT]], 0);
+			jle((const void *)arm_dispatch);
+			cmp(dword[rip + &arm_Reg[INTR_PEND]], 0);
+			jne((const void *)arm_dispatch);
+			if (taken != notTaken)
+			{
+				Xbyak::Label notTakenLabel;
+				cmp(dword[rip + &arm_Reg[R15_ARM_NEXT]], taken);
+				jne(notTakenLabel, T_NEAR);
+				emitLink(taken);
+				L(notTakenLabel);
+			}
+			emitLink(notTaken);
+		}
+		else
+		{
+			jmp((void*)arm_dispatch);
+		}
 
 		ready();
 		recompiler::advance(getSize());
@@ -1,6 +1,7 @@
 #pragma once
 #include "types.h"
 #include "hw/aica/aica_if.h"
+#include "hw/aica/sgc_if.h"
 
 template <typename T> T arm_ReadReg(u32 addr);
 template <typename T> void arm_WriteReg(u32 addr, T data);
@@ -33,6 +34,7 @@ static inline void DYNACALL WriteMemArm(u32 addr, T data)
 	addr &= 0x00FFFFFF;
 	if (addr < 0x800000)
 	{
+		AICA_RamWrite(addr);
 		*(T *)&aica_ram[addr & (ARAM_MASK - (sizeof(T) - 1))] = data;
 	}
 	else
@@ -6,6 +6,7 @@
 #include "gdromv3.h"
 #include "gdrom_if.h"
 #include "cfg/option.h"
+#include "hw/aica/aica_if.h"
 #include "hw/holly/holly_intc.h"
 #include "hw/holly/sb.h"
 #include "hw/sh4/modules/dmac.h"
@@ -64,6 +65,7 @@ GD_HardwareInfo_t GD_HardwareInfo;
 #define printf_spicmd(...) DEBUG_LOG(GDROM, __VA_ARGS__)
 #define printf_subcode(...) DEBUG_LOG(GDROM, __VA_ARGS__)
 
+// May be called on the AICA thread. The sh4 side calls libAICA_Sync() before accessing the drive.
 void libCore_CDDA_Sector(s16* sector)
 {
 	//silence ! :p
@@ -696,6 +698,7 @@ void gd_process_spi_cmd()
 			else
 				read_params.remaining_sectors = (readcmd.b[6] << 8) | readcmd.b[7];
 			read_params.sector_type = sector_type;//yeah i know , not really many types supported...
+			libGDR_ReadAhead(read_params.start_sector, read_params.remaining_sectors);
 
 			printf_spicmd("SPI_CD_READ - Sector=%d Size=%d/%d DMA=%d",read_params.start_sector,read_params.remaining_sectors,read_params.sector_type,Features.CDRead.DMA);
 			if (Features.CDRead.DMA == 1)
@@ -971,7 +974,9 @@ void gd_process_spi_cmd()
 }
 //Read handler
 u32 ReadMem_gdrom(u32 Addr, u32 sz)
-{	
+{
+	// The AICA thread reads CDDA sectors and updates the drive status
+	libAICA_Sync();
 	switch (Addr)
 	{
 		//cancel interrupt
@@ -1051,6 +1056,7 @@ u32 ReadMem_gdrom(u32 Addr, u32 sz)
 //Write Handler
 void WriteMem_gdrom(u32 Addr, u32 data, u32 sz)
 {
+	libAICA_Sync();
 	switch(Addr)
 	{
 	//ATA_IOPORT_WR_CYLINDER_LOW
@@ -1161,6 +1167,7 @@ static int getGDROMTicks()
 //is this needed ?
 static int GDRomschd(int i, int c, int j)
 {
+	libAICA_Sync();
 	if (SecNumber.Status == GD_SEEK)
 	{
 		SecNumber.Status = GD_PAUSE;
@@ -1255,6 +1262,7 @@ static int GDRomschd(int i, int c, int j)
 //DMA Start
 static void GDROM_DmaStart(u32 addr, u32 data)
 {
+	libAICA_Sync();
 	SB_GDST |= data & 1;
 
 	if (SB_GDST == 1)
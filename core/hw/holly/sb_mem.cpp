@@ -7,6 +7,7 @@
 #include "sb_mem.h"
 #include "sb.h"
 #include "hw/aica/aica_if.h"
+#include "hw/aica/sgc_if.h"
 #include "hw/flashrom/flashrom.h"
 #include "hw/gdrom/gdrom_if.h"
 #include "hw/modem/modem.h"
@@ -353,7 +354,10 @@ T DYNACALL ReadMem_area0(u32 paddr)
 		}
 		// AICA sound registers
 		if (addr >= 0x00700000 && addr <= 0x00707FFF)
+		{
+			libAICA_Sync();
 			return ReadMem_aica_reg<T>(addr);
+		}
 		// AICA RTC registers
 		if (addr >= 0x00710000 && addr <= 0x0071000B)
 			return ReadMem_aica_rtc<T>(addr);
@@ -364,6 +368,7 @@ T DYNACALL ReadMem_area0(u32 paddr)
 	case 6:
 	case 7:
 		// AICA ram
+		libAICA_Sync();
 		return ReadMemArr<T>(aica_ram.data, addr & ARAM_MASK);
 
 	default:
@@ -465,6 +470,7 @@ void DYNACALL WriteMem_area0(u32 paddr, T data)
 		// AICA sound registers
 		if (addr >= 0x00700000 && addr <= 0x00707FFF)
 		{
+			libAICA_Sync();
 			WriteMem_aica_reg(addr, data);
 			return;
 		}
@@ -480,6 +486,8 @@ void DYNACALL WriteMem_area0(u32 paddr, T data)
 	case 6:
 	case 7:
 		// AICA ram
+		libAICA_Sync();
+		AICA_RamWrite(addr);
 		WriteMemArr(aica_ram.data, addr & ARAM_MASK, data);
 		return;
 
@@ -24,7 +24,8 @@
 #include "hw/pvr/pvr_mem.h"
 #include "hw/pvr/elan.h"
 #include "rend/TexCache.h"
-#include <unordered_map>
+#include <algorithm>
+#include <vector>
 
 namespace memwatch
 {
@@ -36,13 +37,73 @@ struct Page
 	}
 	u8 data[PAGE_SIZE];
 };
-using PageMap = std::unordered_map<u32, Page>;
+
+// Pages saved before their first write, stored as flat arrays.
+// Entries are sorted by offset once the list is complete. Pages are referenced by index
+// since adding a page may reallocate the storage and invalidate references to the others.
+struct PageList
+{
+	struct Entry
+	{
+		u32 offset;
+		u32 index;		// in pages
+
+		bool operator<(const Entry& other) const {
+			return offset < other.offset;
+		}
+	};
+	std::vector<Entry> entries;
+	std::vector<Page> pages;
+
+	size_t size() const {
+		return entries.size();
+	}
+
+	// Keeps the allocated memory so that the list can be reused
+	void clear()
+	{
+		entries.clear();
+		pages.clear();
+	}
+
+	// The returned reference is only valid until the next call
+	Page& add(u32 offset)
+	{
+		entries.push_back({ offset, (u32)pages.size() });
+		pages.emplace_back();
+		return pages.back();
+	}
+
+	const Page& page(const Entry& entry) const {
+		return pages[entry.index];
+	}
+
+	void sort() {
+		std::sort(entries.begin(), entries.end());
+	}
+
+	const Page *find(u32 offset) const
+	{
+		auto it = std::lower_bound(entries.begin(), entries.end(), Entry{ offset, 0 });
+		if (it == entries.end() || it->offset != offset)
+			return nullptr;
+		return &pages[it->index];
+	}
+};
 
 template<typename T>
 class Watcher
 {
 	bool started;
-	PageMap pages;
+	PageList pages;
+	// one flag per page, set once the page is saved
+	std::vector<u8> saved;
+
+	void clearSaved()
+	{
+		for (const auto& entry : pages.entries)
+			saved[entry.offset / PAGE_SIZE] = 0;
+	}
 
 public:
 	void protect()
@@ -54,8 +115,8 @@ public:
 		}
 		else
 		{
-			for (const auto& pair : pages)
-				static_cast<T&>(*this).protectMem(pair.first, PAGE_SIZE);
+			for (const auto& entry : pages.entries)
+				static_cast<T&>(*this).protectMem(entry.offset, PAGE_SIZE);
 		}
 	}
 
@@ -67,6 +128,7 @@ public:
 	void reset()
 	{
 		started = false;
+		clearSaved();
 		pages.clear();
 	}
 
@@ -76,20 +138,27 @@ public:
 		if (offset == (u32)-1)
 			return false;
 		offset &= ~PAGE_MASK;
-	    auto rv = pages.emplace(offset, Page());
-	    if (!rv.second)
-	      // already saved
-	      return true;
-	    Page& page = rv.first->second;
-	    memcpy(&page.data[0], static_cast<T&>(*this).getMemPage(offset), PAGE_SIZE);
+		const u32 index = offset / PAGE_SIZE;
+		if (index >= saved.size())
+			saved.resize(index + 1);
+		if (saved[index] != 0)
+			// already saved
+			return true;
+		saved[index] = 1;
+		Page& page = pages.add(offset);
+		memcpy(&page.data[0], static_cast<T&>(*this).getMemPage(offset), PAGE_SIZE);
 		static_cast<T&>(*this).unprotectMem(offset, PAGE_SIZE);
 		return true;
 	}
 
-	void getPages(PageMap& other)
+	// Moves the saved pages to other. The previous content of other is discarded
+	// but its memory is reused for the next pages.
+	void getPages(PageList& other)
 	{
+		clearSaved();
+		pages.sort();
 		std::swap(pages, other);
-		pages = PageMap();
+		pages.clear();
 	}
 };
 
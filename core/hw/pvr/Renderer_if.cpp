@@ -10,8 +10,7 @@
 #include "profiler/fc_profiler.h"
 #include "network/ggpo.h"
 
-#include <mutex>
-#include <deque>
+#include <atomic>
 
 #ifdef LIBRETRO
 void retro_rend_present();
@@ -39,10 +38,12 @@ TA_context* _pvrrc;
 
 static bool presented;
 
+//
+// Messages from the emulation thread to the render thread.
+// Lock-free ring buffer. The events are only used to block when the ring is empty or full.
+//
 class PvrMessageQueue
 {
-	using lock_guard = std::lock_guard<std::mutex>;
-
 public:
 	enum MessageType { NoMessage = -1, Render, RenderFramebuffer, Present, Stop };
 	struct Message
@@ -60,29 +61,29 @@ public:
 		Message msg { type, config };
 		if (config::ThreadedRendering)
 		{
+			if (type == Stop)
+			{
+				// Can be called from any thread
+				stopRequested = true;
+				enqueueEvent.Set();
+				return;
+			}
 			// FIXME need some synchronization to avoid blinking in densha de go
 			// or use !threaded rendering for emufb?
 			// or read framebuffer vram on emu thread
-			bool dupe;
-			do {
-				dupe = false;
-				{
-					const lock_guard lock(mutex);
-					for (const auto& m : queue)
-						if (m.type == type) {
-							dupe = true;
-							break;
-						}
-					if (!dupe)
-						queue.push_back(msg);
-				}
-				if (dupe)
-				{
-					if (type == Stop)
-						return;
-					dequeueEvent.Wait();
-				}
-			} while (dupe);
+
+			// Consecutive presents are merged if the render thread hasn't caught up yet
+			if (type == Present && lastType == Present && (int)(lastIndex - queue.readIndex()) >= 0)
+				return;
+			u32 cancelCount = this->cancelCount;
+			while (!queue.push(msg))
+			{
+				dequeueEvent.Wait();
+				if (cancelCount != this->cancelCount)
+					return;
+			}
+			lastType = type;
+			lastIndex = queue.writeIndex() - 1;
 			enqueueEvent.Set();
 		}
 		else
@@ -100,20 +101,18 @@ public:
 	}
 
 	void reset() {
-		const lock_guard lock(mutex);
 		queue.clear();
+		stopRequested = false;
+		lastType = NoMessage;
+		canceling = false;
 	}
 
+	// Drops the pending messages other than Render and unblocks the emulation thread.
+	// Can be called from any thread.
 	void cancelEnqueue()
 	{
-		const lock_guard lock(mutex);
-		for (auto it = queue.begin(); it != queue.end(); )
-		{
-			if (it->type != Render)
-				it = queue.erase(it);
-			else
-				++it;
-		}
+		cancelIndex = queue.writeIndex();
+		cancelCount++;
 		dequeueEvent.Set();
 	}
 private:
@@ -121,27 +120,34 @@ private:
 	{
 		FC_PROFILE_SCOPE;
 
-		Message msg;
 		while (true)
 		{
+			if (stopRequested.exchange(false))
+				return Message(Stop, FramebufferInfo());
+			Message *front = queue.front();
+			if (front != nullptr)
 			{
-				const lock_guard lock(mutex);
-				if (!queue.empty())
+				Message msg = *front;
+				u32 index = queue.readIndex();
+				queue.pop();
+				dequeueEvent.Set();
+				if (consumerCancelCount != cancelCount)
 				{
-					msg = queue.front();
-					queue.pop_front();
+					consumerCancelCount = cancelCount;
+					cancelEnd = cancelIndex;
+					canceling = true;
 				}
-			}
-			if (msg.type != NoMessage) {
-				dequeueEvent.Set();
-				break;
+				if (canceling && (int)(index - cancelEnd) >= 0)
+					canceling = false;
+				if (canceling && msg.type != Render)
+					continue;
+				return msg;
 			}
 			if (timeoutMs == -1)
 				enqueueEvent.Wait();
 			else if (!enqueueEvent.Wait(timeoutMs))
-				break;
+				return Message();
 		}
-		return msg;
 	}
 
 	bool execute(Message msg)
@@ -240,10 +246,19 @@ private:
 		}
 	}
 
-	std::mutex mutex;
+	SPSCQueue<Message, 8> queue;
 	cResetEvent enqueueEvent;
 	cResetEvent dequeueEvent;
-	std::deque<Message> queue;
+	std::atomic<bool> stopRequested { false };
+	std::atomic<u32> cancelIndex { 0 };
+	std::atomic<u32> cancelCount { 0 };
+	// Last message pushed. Only used by the producer
+	MessageType lastType = NoMessage;
+	u32 lastIndex = 0;
+	// Only used by the consumer
+	u32 consumerCancelCount = 0;
+	u32 cancelEnd = 0;
+	bool canceling = false;
 };
 
 static PvrMessageQueue pvrQueue;
@@ -337,7 +352,8 @@ void rend_term_renderer()
 
 void rend_reset()
 {
-	FinishRender(DequeueRender());
+	while (TA_context *ctx = DequeueRender())
+		FinishRender(ctx);
 	render_called = false;
 	pend_rend = false;
 	FrameCount = 1;
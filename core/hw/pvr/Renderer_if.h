@@ -2,6 +2,9 @@
 #include "types.h"
 #include "ta_ctx.h"
 
+#include <utility>
+#include <vector>
+
 extern u32 FrameCount;
 
 bool rend_init_renderer();
@@ -68,6 +71,8 @@ struct Renderer
 	virtual void DrawOSD(bool clear_screen) { }
 
 	virtual BaseTextureCacheData *GetTexture(TSP tsp, TCW tcw) { return nullptr; }
+	// Called with the textures of a frame before GetTexture is called for each of them
+	virtual void PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures) { }
 };
 
 extern Renderer* renderer;
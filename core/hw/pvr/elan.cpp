@@ -1782,7 +1782,7 @@ void serialize(Serializer& ser)
 	ser << reg10;
 	ser << reg74;
 	ser << elanCmd;
-	if (!ser.rollback())
+	if (!ser.skipRam())
 		ser.serialize(RAM, ERAM_SIZE);
 	state.serialize(ser);
 }
@@ -1794,7 +1794,7 @@ void deserialize(Deserializer& deser)
 	deser >> reg10;
 	deser >> reg74;
 	deser >> elanCmd;
-	if (!deser.rollback())
+	if (!deser.skipRam())
 		deser.deserialize(RAM, ERAM_SIZE);
 	state.deserialize(deser);
 }
@@ -78,7 +78,7 @@ void serialize(Serializer& ser)
 
 	SerializeTAContext(ser);
 
-	if (!ser.rollback())
+	if (!ser.skipRam())
 		ser.serialize(vram.data, vram.size);
 	elan::serialize(ser);
 }
@@ -146,7 +146,7 @@ void deserialize(Deserializer& deser)
 	if (deser.version() >= Deserializer::V11 || (deser.version() >= Deserializer::V10_LIBRETRO && deser.version() <= Deserializer::VLAST_LIBRETRO))
 		DeserializeTAContext(deser);
 
-	if (!deser.rollback())
+	if (!deser.skipRam())
 		deser.deserialize(vram.data, vram.size);
 	elan::deserialize(deser);
 	pal_needs_update = true;
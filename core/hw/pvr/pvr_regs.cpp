@@ -3,9 +3,12 @@
 #include "Renderer_if.h"
 #include "ta.h"
 #include "spg.h"
+#include <atomic>
 #include <map>
 
 bool pal_needs_update=true;
+// One bit per 16-entry palette bank written since the last palette update
+std::atomic<u64> pal_dirty_banks;
 bool fog_needs_update=true;
 
 u8 pvr_regs[pvr_RegSize];
@@ -218,8 +221,8 @@ void pvr_WriteReg(u32 paddr,u32 data)
 		break;
 
 	default:
-		if (addr >= PALETTE_RAM_START_addr && PvrReg(addr,u32) != data)
-			pal_needs_update = true;
+		if (addr >= PALETTE_RAM_START_addr && addr <= PALETTE_RAM_END_addr && PvrReg(addr,u32) != data)
+			pal_dirty_banks.fetch_or(1ull << ((addr - PALETTE_RAM_START_addr) / 64), std::memory_order_relaxed);
 		else if (addr >= FOG_TABLE_START_addr && addr <= FOG_TABLE_END_addr && PvrReg(addr,u32) != data)
 			fog_needs_update = true;
 		break;
@@ -8,8 +8,7 @@
 #include "serialize.h"
 #include "network/ggpo.h"
 #include "hw/pvr/Renderer_if.h"
-
-#ifdef TEST_AUTOMATION
+#ifndef LIBRETRO
 #include "input/gamepad_device.h"
 #endif
 
@@ -167,7 +166,7 @@ static int spg_line_sched(int tag, int cycles, int jitter)
 			cpu_cycles[cpu_time_idx] = sh4_sched_now64();
 			real_times[cpu_time_idx] = now;
 
-#ifdef TEST_AUTOMATION
+#ifndef LIBRETRO
 			replay_input();
 #endif
 
@@ -15,6 +15,9 @@ void DYNACALL ta_vtx_data32(const SQBuffer *data);
 void ta_vtx_data(const SQBuffer *data, u32 size);
 
 bool ta_parse(TA_context *ctx, bool primRestart);
+// Decodes the TA data of one pass into ctx without building the render passes.
+// Used to benchmark the vertex decoding with and without the SIMD kernels.
+void ta_decode(TA_context *ctx, const u8 *data, u32 size, bool simd);
 
 class TaTypeLut
 {
@@ -5,6 +5,7 @@
 #include "serialize.h"
 #include "stdclass.h"
 
+#include <chrono>
 #include <mutex>
 #include <vector>
 
@@ -43,8 +44,20 @@ void SetCurrentTARC(u32 addr)
 	}
 }
 
-static TA_context* rqueue;
+// Frames queued by the emulation thread and not yet rendered
+struct FrameSlot
+{
+	TA_context *ctx;
+	u64 queueTime;
+};
+static SPSCQueue<FrameSlot, FRAMES_IN_FLIGHT> rqueue;
 static cResetEvent frame_finished;
+static FrameSlotStats slotStats[FRAMES_IN_FLIGHT];
+
+static u64 getTimeNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 bool QueueRender(TA_context* ctx)
 {
@@ -56,15 +69,19 @@ bool QueueRender(TA_context* ctx)
 		RenderCount++;
 		if (RenderCount % (config::SkipFrame + 1) != 0)
 			skipFrame = true;
-		else if (config::ThreadedRendering && rqueue != nullptr
+		else if (config::ThreadedRendering
 				&& (config::AutoSkipFrame == 0 || (config::AutoSkipFrame == 1 && SH4FastEnough)))
-			// The previous render hasn't completed yet so we wait.
+		{
+			// All the frame slots are used so we wait for the oldest frame to be rendered.
 			// If autoskipframe is enabled (normal level), we only do so if the CPU is running
 			// fast enough over the last frames
-			frame_finished.Wait();
+			frame_finished.Reset();
+			if (rqueue.full())
+				frame_finished.Wait();
+		}
 	}
 
-	if (skipFrame || rqueue)
+	if (skipFrame || rqueue.full())
 	{
 		tactx_Recycle(ctx);
 		if (rend_is_enabled())
@@ -73,33 +90,48 @@ bool QueueRender(TA_context* ctx)
 	}
 	// disable net rollbacks until the render thread has processed the frame
 	rend_disable_rollback();
-	frame_finished.Reset();
-	verify(rqueue == nullptr);
-	rqueue = ctx;
-
+	rqueue.push({ ctx, getTimeNs() });
 
 	return true;
 }
 
 TA_context* DequeueRender()
 {
-	if (rqueue != nullptr)
-		FrameCount++;
+	FrameSlot *slot = rqueue.front();
+	if (slot == nullptr)
+		return nullptr;
+	FrameCount++;
 
-	return rqueue;
+	return slot->ctx;
 }
 
 void FinishRender(TA_context* ctx)
 {
 	if (ctx != nullptr)
 	{
-		verify(rqueue == ctx);
-		rqueue = nullptr;
+		FrameSlot *slot = rqueue.front();
+		verify(slot != nullptr && slot->ctx == ctx);
+		FrameSlotStats& stats = slotStats[rqueue.readIndex() % FRAMES_IN_FLIGHT];
+		u64 latency = getTimeNs() - slot->queueTime;
+		stats.frames++;
+		stats.totalLatency += latency;
+		stats.maxLatency = std::max(stats.maxLatency, latency);
+		rqueue.pop();
 		tactx_Recycle(ctx);
 	}
 	frame_finished.Set();
 }
 
+const FrameSlotStats *getFrameSlotStats()
+{
+	return slotStats;
+}
+
+void resetFrameSlotStats()
+{
+	memset(slotStats, 0, sizeof(slotStats));
+}
+
 static std::mutex mtx_pool;
 
 static std::vector<TA_context*> ctx_pool;
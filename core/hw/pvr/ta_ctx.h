@@ -401,10 +401,27 @@ TA_context *tactx_Alloc();
 #define TACTX_NONE (0xFFFFFFFF)
 
 void SetCurrentTARC(u32 addr);
+
+// Number of frames that can be queued for rendering when ThreadedRendering is enabled
+constexpr u32 FRAMES_IN_FLIGHT = 2;
+// Queues a frame for rendering. Called by the emulation thread.
 bool QueueRender(TA_context* ctx);
+// Returns the oldest queued frame, or nullptr. Called by the render thread.
 TA_context* DequeueRender();
+// Releases the frame returned by DequeueRender. Called by the render thread.
 void FinishRender(TA_context* ctx);
 
+// Time between QueueRender and FinishRender, per frame slot
+struct FrameSlotStats
+{
+	u64 frames;
+	u64 totalLatency;	// nanoseconds
+	u64 maxLatency;		// nanoseconds
+};
+// Returns FRAMES_IN_FLIGHT entries
+const FrameSlotStats *getFrameSlotStats();
+void resetFrameSlotStats();
+
 //must be moved to proper header
 void FillBGP(TA_context* ctx);
 void SerializeTAContext(Serializer& ser);
@@ -9,9 +9,22 @@
 #include "pvr_mem.h"
 #include "Renderer_if.h"
 #include "cfg/option.h"
+#include "profiler/bench.h"
 
 #include <algorithm>
+#include <memory>
 #include <utility>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TA_SIMD_SSE2
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define TA_SIMD_NEON
+#endif
 
 #define TACALL DYNACALL
 #ifdef NDEBUG
@@ -25,10 +38,66 @@ static u8 float_to_satu8(float val) {
 	return f32_su8_tbl[(u32&)val >> 16];
 }
 
-static TA_context *vd_ctx;
+//
+// Converts 4 consecutive float color components to saturated u8, in the same order.
+// Same results as float_to_satu8: the lookup table only uses the 16 upper bits of the float.
+//
+template<bool Simd>
+static u32 float4_to_satu8(const f32 *src)
+{
+	if (Simd)
+	{
+#if defined(TA_SIMD_SSE2)
+		__m128 v = _mm_loadu_ps(src);
+		v = _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0xffff0000)));
+		// NaN gives 0
+		v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.f));
+		__m128i i = _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.f)));
+		i = _mm_packs_epi32(i, i);
+		i = _mm_packus_epi16(i, i);
+		return _mm_cvtsi128_si32(i);
+#elif defined(TA_SIMD_NEON)
+		float32x4_t v = vreinterpretq_f32_u32(vandq_u32(vld1q_u32((const u32 *)src), vdupq_n_u32(0xffff0000)));
+		const float32x4_t zero = vdupq_n_f32(0.f);
+		const float32x4_t one = vdupq_n_f32(1.f);
+		// NaN gives 0
+		v = vbslq_f32(vcgtq_f32(v, zero), v, zero);
+		v = vbslq_f32(vcltq_f32(v, one), v, one);
+		uint16x4_t h = vmovn_u32(vcvtq_u32_f32(vmulq_n_f32(v, 255.f)));
+		uint8x8_t b = vmovn_u16(vcombine_u16(h, h));
+		return vget_lane_u32(vreinterpret_u32_u8(b), 0);
+#endif
+	}
+	return float_to_satu8(src[0]) | (float_to_satu8(src[1]) << 8)
+			| (float_to_satu8(src[2]) << 16) | ((u32)float_to_satu8(src[3]) << 24);
+}
+
+// Multiplies the red, green and blue components by intensity/256
+template<bool Simd>
+static u32 scale_color(u32 color, u32 intensity, u32 alphaMask)
+{
+	if (Simd)
+	{
+		// two components per multiplication
+		u32 rb = (((color & 0x00ff00ff) * intensity) >> 8) & 0x00ff00ff;
+		u32 ga = (((color >> 8) & 0x00ff00ff) * intensity) & 0xff00ff00;
+		return ((rb | ga) & ~alphaMask) | (color & alphaMask);
+	}
+	u32 rv = color & alphaMask;
+	for (int i = 0; i < 32; i += 8)
+		if (((alphaMask >> i) & 0xff) == 0)
+			rv |= (((color >> i) & 0xff) * intensity / 256) << i;
+	return rv;
+}
+
+// Whether vertex runs are decoded with the SIMD kernels. Only disabled to benchmark the scalar code.
+static bool simdVertexDecode = true;
+
 #define vd_rc (vd_ctx->rend)
 
 constexpr u32 ListType_None = -1;
+// Number of parsers that can run concurrently. Slot 0 is used by the main parser.
+constexpr u32 TA_PARSER_SLOTS = 4;
 
 static f32 f16(u16 v)
 {
@@ -36,7 +105,57 @@ static f32 f16(u16 v)
 	return *(f32*)&z;
 }
 
-class BaseTAParser
+static u32 tileClipRect(u32 tileclip, u32 xmin, u32 ymin, u32 xmax, u32 ymax)
+{
+	u32 rv=tileclip & 0xF0000000;
+	rv|=xmin; //6 bits
+	rv|=xmax<<6; //6 bits
+	rv|=ymin<<12; //5 bits
+	rv|=ymax<<17; //5 bits
+	return rv;
+}
+
+static u32 tileClipMode(u32 tileclip, u32 mode)
+{
+	//Group_En bit seems ignored, thanks p1pkin
+	return (tileclip&(~0xF0000000)) | (mode<<28);
+}
+
+// Global parameters that last set the face colors
+struct FaceColorParams
+{
+	const Ta_Dma *base;
+	const Ta_Dma *offs;
+	const Ta_Dma *base1;
+
+	void set(u32 ppid, const Ta_Dma *param)
+	{
+		switch (ppid)
+		{
+		case 1:
+			base = param;
+			break;
+		case 2:
+			base = offs = param;
+			break;
+		case 4:
+			base = base1 = param;
+			break;
+		}
+	}
+};
+
+struct FaceColors
+{
+	u8 base[4];
+	u8 offs[4];
+	u8 base1[4];
+	u8 offs1[4];
+};
+
+// Each slot has its own parser state so that TA data can be parsed by several threads
+template<u32 Slot>
+class BaseTAParserT
 {
 	static Ta_Dma *DYNACALL NullVertexData(Ta_Dma *data, Ta_Dma *data_end)
 	{
@@ -101,6 +220,22 @@ public:
 		tileclip_val = tileclip;
 	}
 
+	static void getFaceColors(FaceColors& colors)
+	{
+		memcpy(colors.base, FaceBaseColor, sizeof(colors.base));
+		memcpy(colors.offs, FaceOffsColor, sizeof(colors.offs));
+		memcpy(colors.base1, FaceBaseColor1, sizeof(colors.base1));
+		memcpy(colors.offs1, FaceOffsColor1, sizeof(colors.offs1));
+	}
+
+	static void setFaceColors(const FaceColors& colors)
+	{
+		memcpy(FaceBaseColor, colors.base, sizeof(colors.base));
+		memcpy(FaceOffsColor, colors.offs, sizeof(colors.offs));
+		memcpy(FaceBaseColor1, colors.base1, sizeof(colors.base1));
+		memcpy(FaceOffsColor1, colors.offs1, sizeof(colors.offs1));
+	}
+
 protected:
 	typedef Ta_Dma* DYNACALL TaListFP(Ta_Dma* data, Ta_Dma* data_end);
 	typedef void TACALL TaPolyParamFP(void* ptr);
@@ -157,49 +292,72 @@ protected:
 	static PolyParam* CurrentPP;
 	static TaListFP *VertexDataFP;
 public:
+	static TA_context *vd_ctx;
 	static List<PolyParam>* CurrentPPlist;
 	static TaListFP* TaCmd;
 	static bool fetchTextures;
 };
 
-const u32 *BaseTAParser::ta_type_lut = TaTypeLut::instance().table;
-u32 BaseTAParser::tileclip_val;
-alignas(4) u8 BaseTAParser::FaceBaseColor[4];
-alignas(4) u8 BaseTAParser::FaceOffsColor[4];
-alignas(4) u8 BaseTAParser::FaceBaseColor1[4];
-alignas(4) u8 BaseTAParser::FaceOffsColor1[4];
-u32 BaseTAParser::SFaceBaseColor;
-u32 BaseTAParser::SFaceOffsColor;
-ModTriangle* BaseTAParser::lmr;
-u32 BaseTAParser::CurrentList;
-PolyParam* BaseTAParser::CurrentPP;
-List<PolyParam>* BaseTAParser::CurrentPPlist;
-BaseTAParser::TaListFP *BaseTAParser::TaCmd;
-BaseTAParser::TaListFP *BaseTAParser::VertexDataFP;
-bool BaseTAParser::fetchTextures = true;
-
-template<int Red = 0, int Green = 1, int Blue = 2, int Alpha = 3>
-class TAParserTempl : public BaseTAParser
+template<u32 Slot> TA_context *BaseTAParserT<Slot>::vd_ctx;
+template<u32 Slot> const u32 *BaseTAParserT<Slot>::ta_type_lut = TaTypeLut::instance().table;
+template<u32 Slot> u32 BaseTAParserT<Slot>::tileclip_val;
+template<u32 Slot> alignas(4) u8 BaseTAParserT<Slot>::FaceBaseColor[4];
+template<u32 Slot> alignas(4) u8 BaseTAParserT<Slot>::FaceOffsColor[4];
+template<u32 Slot> alignas(4) u8 BaseTAParserT<Slot>::FaceBaseColor1[4];
+template<u32 Slot> alignas(4) u8 BaseTAParserT<Slot>::FaceOffsColor1[4];
+template<u32 Slot> u32 BaseTAParserT<Slot>::SFaceBaseColor;
+template<u32 Slot> u32 BaseTAParserT<Slot>::SFaceOffsColor;
+template<u32 Slot> ModTriangle* BaseTAParserT<Slot>::lmr;
+template<u32 Slot> u32 BaseTAParserT<Slot>::CurrentList;
+template<u32 Slot> PolyParam* BaseTAParserT<Slot>::CurrentPP;
+template<u32 Slot> List<PolyParam>* BaseTAParserT<Slot>::CurrentPPlist;
+template<u32 Slot> typename BaseTAParserT<Slot>::TaListFP *BaseTAParserT<Slot>::TaCmd;
+template<u32 Slot> typename BaseTAParserT<Slot>::TaListFP *BaseTAParserT<Slot>::VertexDataFP;
+template<u32 Slot> bool BaseTAParserT<Slot>::fetchTextures = true;
+
+using BaseTAParser = BaseTAParserT<0>;
+static TA_context *&vd_ctx = BaseTAParser::vd_ctx;
+
+template<int Red = 0, int Green = 1, int Blue = 2, int Alpha = 3, u32 Slot = 0>
+class TAParserTempl : public BaseTAParserT<Slot>
 {
+	using Base = BaseTAParserT<Slot>;
+	using typename Base::TaListFP;
+	using typename Base::TaPolyParamFP;
+	using Base::ta_type_lut;
+	using Base::tileclip_val;
+	using Base::FaceBaseColor;
+	using Base::FaceOffsColor;
+	using Base::FaceBaseColor1;
+	using Base::FaceOffsColor1;
+	using Base::SFaceBaseColor;
+	using Base::SFaceOffsColor;
+	using Base::lmr;
+	using Base::CurrentList;
+	using Base::CurrentPP;
+	using Base::VertexDataFP;
+	using Base::endModVol;
+public:
+	using Base::vd_ctx;
+	using Base::CurrentPPlist;
+	using Base::TaCmd;
+	using Base::fetchTextures;
+	using Base::startList;
+	using Base::endList;
+private:
+
 	//part : 0 fill all data , 1 fill upper 32B , 2 fill lower 32B
 	//Poly decoder , will be moved to pvr code
-	template <u32 poly_type,u32 part>
-	static Ta_Dma* TACALL ta_handle_poly(Ta_Dma* data,Ta_Dma* data_end)
+	template <u32 poly_type,u32 part,bool Simd>
+	static void decodePolyVertex(Ta_Dma* data,Vertex* cv)
 	{
 		TA_VertexParam* vp=(TA_VertexParam*)data;
-		u32 rv=0;
-
-		if (part==2)
-		{
-			TaCmd=ta_main;
-		}
 
 		switch (poly_type)
 		{
 #define ver_32B_def(num) \
-case num : {\
-AppendPolyVertex##num(&vp->vtx##num);\
-rv=SZ32; }\
+case num : \
+AppendPolyVertex##num<Simd>(&vp->vtx##num, cv);\
 break;
 
 			//32b , always in one pass :)
@@ -216,25 +374,15 @@ break;
 #undef ver_32B_def
 
 #define ver_64B_def(num) \
-case num : {\
-/*process first half*/\
+case num : \
+	/*process first half*/\
 	if (part!=2)\
-	{\
-	rv+=SZ32;\
-	AppendPolyVertex##num##A(&vp->vtx##num##A);\
-	}\
+		AppendPolyVertex##num##A<Simd>(&vp->vtx##num##A, cv);\
 	/*process second half*/\
 	if (part==0)\
-	{\
-	AppendPolyVertex##num##B(&vp->vtx##num##B);\
-	rv+=SZ32;\
-	}\
+		AppendPolyVertex##num##B<Simd>(&vp->vtx##num##B, cv);\
 	else if (part==2)\
-	{\
-	AppendPolyVertex##num##B((TA_Vertex##num##B*)data);\
-	rv+=SZ32;\
-	}\
-	}\
+		AppendPolyVertex##num##B<Simd>((TA_Vertex##num##B*)data, cv);\
 	break;
 
 
@@ -247,9 +395,35 @@ case num : {\
 			ver_64B_def(14);//(Textured, Intensity, 16bit UV, with Two Volumes)
 #undef ver_64B_def
 		}
+	}
+
+	// Vertex split in 2 parts at the end of the data
+	template <u32 poly_type,u32 part>
+	static Ta_Dma* TACALL ta_handle_poly(Ta_Dma* data,Ta_Dma* data_end)
+	{
+		Vertex* cv;
+		if (part==2)
+		{
+			TaCmd=ta_main;
+			cv=vd_rc.verts.LastPtr();
+		}
+		else
+		{
+			cv=vd_rc.verts.Append();
+		}
+		decodePolyVertex<poly_type,part,true>(data,cv);
+
+		return data+SZ32;
+	}
 
-		return data+rv;
-	};
+	// Decodes a run of vertices of the same format
+	template <u32 poly_type,u32 poly_size,bool Simd>
+	static void decodePolyVertices(Ta_Dma* data,u32 count)
+	{
+		Vertex* cv=vd_rc.verts.Append(count);
+		for (u32 i=0;i<count;i++)
+			decodePolyVertex<poly_type,0,Simd>(data+i*poly_size,cv+i);
+	}
 
 	//Code Splitter/routers
 
@@ -322,14 +496,28 @@ case num : {\
 		if (IS_FIST_HALF)
 			goto fist_half;
 
-		do
 		{
-			verify(data->pcw.ParaType == ParamType_Vertex_Parameter);
-			ta_handle_poly<poly_type,0>(data, 0);
-			if (data->pcw.EndOfStrip)
+			// Find the vertices up to the end of the strip and decode them in one go
+			Ta_Dma* first=data;
+			u32 count=0;
+			bool endOfStrip;
+			do
+			{
+				verify(data->pcw.ParaType == ParamType_Vertex_Parameter);
+				count++;
+				endOfStrip=data->pcw.EndOfStrip;
+				if (endOfStrip)
+					break;
+				data += poly_size;
+			} while (data <= data_end - poly_size);
+
+			if (simdVertexDecode)
+				decodePolyVertices<poly_type,poly_size,true>(first,count);
+			else
+				decodePolyVertices<poly_type,poly_size,false>(first,count);
+			if (endOfStrip)
 				goto strip_end;
-			data += poly_size;
-		} while (data <= data_end - poly_size);
+		}
 			
 		if (IS_FIST_HALF)
 		{
@@ -501,24 +689,23 @@ public:
 	static void reset()
 	{
 		TaCmd = ta_main;
-		BaseTAParser::reset();
+		Base::reset();
+	}
+
+	// True if no list is open and no parameter is partially parsed
+	static bool isIdle() {
+		return CurrentList == ListType_None && TaCmd == ta_main;
 	}
 
 private:
 	static void SetTileClip(u32 xmin,u32 ymin,u32 xmax,u32 ymax)
 	{
-		u32 rv=tileclip_val & 0xF0000000;
-		rv|=xmin; //6 bits
-		rv|=xmax<<6; //6 bits
-		rv|=ymin<<12; //5 bits
-		rv|=ymax<<17; //5 bits
-		tileclip_val=rv;
+		tileclip_val = tileClipRect(tileclip_val, xmin, ymin, xmax, ymax);
 	}
 
 	static void TileClipMode(u32 mode)
 	{
-		//Group_En bit seems ignored, thanks p1pkin
-		tileclip_val=(tileclip_val&(~0xF0000000)) | (mode<<28);
+		tileclip_val = tileClipMode(tileclip_val, mode);
 	}
 
 	//Polys  -- update code on sprites if that gets updated too --
@@ -649,18 +836,16 @@ private:
 		//Poly Vertex handlers
 		//Append vertex base
 	template<class T>
-	static Vertex* vert_cvt_base_(T* vtx)
+	static void vert_cvt_base_(Vertex* cv, T* vtx)
 	{
 		f32 invW = vtx->xyz[2];
-		Vertex* cv = vd_rc.verts.Append();
 		cv->x = vtx->xyz[0];
 		cv->y = vtx->xyz[1];
 		cv->z = invW;
 		update_fz(invW);
-		return cv;
 	}
 
-	#define vert_cvt_base Vertex* cv=vert_cvt_base_((TA_Vertex0*)vtx)
+	#define vert_cvt_base vert_cvt_base_(cv, (TA_Vertex0*)vtx)
 
 		//Resume vertex base (for B part)
 	#define vert_res_base \
@@ -693,18 +878,31 @@ private:
 		to[Alpha] = (u8)(t);      \
 		}
 
-	#define vert_float_color_(to,a,r,g,b) \
-		to[Red] = float_to_satu8(r); \
-		to[Green] = float_to_satu8(g); \
-		to[Blue] = float_to_satu8(b); \
-		to[Alpha] = float_to_satu8(a);
+	// Stores color components in A, R, G, B byte order
+	static void setArgbColor(u8* to, u32 argb)
+	{
+		u32 c = ((argb >> 8) & 0xff) << (Red * 8)
+				| ((argb >> 16) & 0xff) << (Green * 8)
+				| (argb >> 24) << (Blue * 8)
+				| (argb & 0xff) << (Alpha * 8);
+		memcpy(to, &c, sizeof(c));
+	}
+
+	template<bool Simd>
+	static void setFaceColor(u8* to, const u8* faceColor, f32 intensity)
+	{
+		u32 c;
+		memcpy(&c, faceColor, sizeof(c));
+		c = scale_color<Simd>(c, float_to_satu8(intensity), 0xffu << (Alpha * 8));
+		memcpy(to, &c, sizeof(c));
+	}
 
 		//Macros to make thins easier ;)
 	#define vert_packed_color(to,src) \
 		vert_packed_color_(cv->to,vtx->src);
 
 	#define vert_float_color(to,src) \
-		vert_float_color_(cv->to,vtx->src##A,vtx->src##R,vtx->src##G,vtx->src##B)
+		setArgbColor(cv->to, float4_to_satu8<Simd>(&vtx->src##A));
 
 		//Intensity handling
 
@@ -713,36 +911,21 @@ private:
 		//Intensity is clamped before the mul, as well as on face color to work the same as the hardware. [Fixes red dog]
 
 	#define vert_face_base_color(baseint) \
-		{ u32 satint = float_to_satu8(vtx->baseint); \
-		cv->col[Red] = FaceBaseColor[Red] * satint / 256;  \
-		cv->col[Green] = FaceBaseColor[Green] * satint / 256;  \
-		cv->col[Blue] = FaceBaseColor[Blue] * satint / 256;  \
-		cv->col[Alpha] = FaceBaseColor[Alpha]; }
+		setFaceColor<Simd>(cv->col, FaceBaseColor, vtx->baseint);
 
 	#define vert_face_offs_color(offsint) \
-		{ u32 satint = float_to_satu8(vtx->offsint); \
-		cv->spc[Red] = FaceOffsColor[Red] * satint / 256;  \
-		cv->spc[Green] = FaceOffsColor[Green] * satint / 256;  \
-		cv->spc[Blue] = FaceOffsColor[Blue] * satint / 256;  \
-		cv->spc[Alpha] = FaceOffsColor[Alpha]; }
+		setFaceColor<Simd>(cv->spc, FaceOffsColor, vtx->offsint);
 
 	#define vert_face_base_color1(baseint) \
-		{ u32 satint = float_to_satu8(vtx->baseint); \
-		cv->col1[Red] = FaceBaseColor1[Red] * satint / 256;  \
-		cv->col1[Green] = FaceBaseColor1[Green] * satint / 256;  \
-		cv->col1[Blue] = FaceBaseColor1[Blue] * satint / 256;  \
-		cv->col1[Alpha] = FaceBaseColor1[Alpha]; }
+		setFaceColor<Simd>(cv->col1, FaceBaseColor1, vtx->baseint);
 
 	#define vert_face_offs_color1(offsint) \
-		{ u32 satint = float_to_satu8(vtx->offsint); \
-		cv->spc1[Red] = FaceOffsColor1[Red] * satint / 256;  \
-		cv->spc1[Green] = FaceOffsColor1[Green] * satint / 256;  \
-		cv->spc1[Blue] = FaceOffsColor1[Blue] * satint / 256;  \
-		cv->spc1[Alpha] = FaceOffsColor1[Alpha]; }
+		setFaceColor<Simd>(cv->spc1, FaceOffsColor1, vtx->offsint);
 
 
 	//(Non-Textured, Packed Color)
-	static void AppendPolyVertex0(TA_Vertex0* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex0(TA_Vertex0* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -750,7 +933,8 @@ private:
 	}
 
 	//(Non-Textured, Floating Color)
-	static void AppendPolyVertex1(TA_Vertex1* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex1(TA_Vertex1* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -758,7 +942,8 @@ private:
 	}
 
 	//(Non-Textured, Intensity)
-	static void AppendPolyVertex2(TA_Vertex2* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex2(TA_Vertex2* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -766,7 +951,8 @@ private:
 	}
 
 	//(Textured, Packed Color)
-	static void AppendPolyVertex3(TA_Vertex3* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex3(TA_Vertex3* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -777,7 +963,8 @@ private:
 	}
 
 	//(Textured, Packed Color, 16bit UV)
-	static void AppendPolyVertex4(TA_Vertex4* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex4(TA_Vertex4* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -788,7 +975,8 @@ private:
 	}
 
 	//(Textured, Floating Color)
-	static void AppendPolyVertex5A(TA_Vertex5A* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex5A(TA_Vertex5A* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -797,16 +985,16 @@ private:
 		vert_uv_32(u,v);
 	}
 
-	static void AppendPolyVertex5B(TA_Vertex5B* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex5B(TA_Vertex5B* vtx, Vertex* cv)
 	{
-		vert_res_base;
-
 		vert_float_color(col,Base);
 		vert_float_color(spc,Offs);
 	}
 
 	//(Textured, Floating Color, 16bit UV)
-	static void AppendPolyVertex6A(TA_Vertex6A* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex6A(TA_Vertex6A* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -815,16 +1003,16 @@ private:
 		vert_uv_16(u,v);
 	}
 
-	static void AppendPolyVertex6B(TA_Vertex6B* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex6B(TA_Vertex6B* vtx, Vertex* cv)
 	{
-		vert_res_base;
-
 		vert_float_color(col,Base);
 		vert_float_color(spc,Offs);
 	}
 
 	//(Textured, Intensity)
-	static void AppendPolyVertex7(TA_Vertex7* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex7(TA_Vertex7* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -835,7 +1023,8 @@ private:
 	}
 
 	//(Textured, Intensity, 16bit UV)
-	static void AppendPolyVertex8(TA_Vertex8* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex8(TA_Vertex8* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -847,7 +1036,8 @@ private:
 	}
 
 	//(Non-Textured, Packed Color, with Two Volumes)
-	static void AppendPolyVertex9(TA_Vertex9* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex9(TA_Vertex9* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -856,7 +1046,8 @@ private:
 	}
 
 	//(Non-Textured, Intensity,	with Two Volumes)
-	static void AppendPolyVertex10(TA_Vertex10* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex10(TA_Vertex10* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -865,7 +1056,8 @@ private:
 	}
 
 	//(Textured, Packed Color,	with Two Volumes)	
-	static void AppendPolyVertex11A(TA_Vertex11A* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex11A(TA_Vertex11A* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -875,10 +1067,9 @@ private:
 		vert_uv_32(u0,v0);
 	}
 
-	static void AppendPolyVertex11B(TA_Vertex11B* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex11B(TA_Vertex11B* vtx, Vertex* cv)
 	{
-		vert_res_base;
-
 		vert_packed_color(col1, BaseCol1);
 		vert_packed_color(spc1, OffsCol1);
 
@@ -886,7 +1077,8 @@ private:
 	}
 
 	//(Textured, Packed Color, 16bit UV, with Two Volumes)
-	static void AppendPolyVertex12A(TA_Vertex12A* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex12A(TA_Vertex12A* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -896,10 +1088,9 @@ private:
 		vert_uv_16(u0,v0);
 	}
 
-	static void AppendPolyVertex12B(TA_Vertex12B* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex12B(TA_Vertex12B* vtx, Vertex* cv)
 	{
-		vert_res_base;
-
 		vert_packed_color(col1, BaseCol1);
 		vert_packed_color(spc1, OffsCol1);
 
@@ -907,7 +1098,8 @@ private:
 	}
 
 	//(Textured, Intensity,	with Two Volumes)
-	static void AppendPolyVertex13A(TA_Vertex13A* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex13A(TA_Vertex13A* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -917,10 +1109,9 @@ private:
 		vert_uv_32(u0,v0);
 	}
 
-	static void AppendPolyVertex13B(TA_Vertex13B* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex13B(TA_Vertex13B* vtx, Vertex* cv)
 	{
-		vert_res_base;
-
 		vert_face_base_color1(BaseInt1);
 		vert_face_offs_color1(OffsInt1);
 
@@ -928,7 +1119,8 @@ private:
 	}
 
 	//(Textured, Intensity, 16bit UV, with Two Volumes)
-	static void AppendPolyVertex14A(TA_Vertex14A* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex14A(TA_Vertex14A* vtx, Vertex* cv)
 	{
 		vert_cvt_base;
 
@@ -938,10 +1130,9 @@ private:
 		vert_uv_16(u0,v0);
 	}
 
-	static void AppendPolyVertex14B(TA_Vertex14B* vtx)
+	template<bool Simd>
+	static void AppendPolyVertex14B(TA_Vertex14B* vtx, Vertex* cv)
 	{
-		vert_res_base;
-
 		vert_face_base_color1(BaseInt1);
 		vert_face_offs_color1(OffsInt1);
 
@@ -1135,6 +1326,31 @@ private:
 		lmr->z2=mvv->z2;
 		//update_fz(mvv->z2);
 	}
+
+public:
+	// Sets the face colors like the given global parameters do
+	static void applyFaceColors(const FaceColorParams& params)
+	{
+		const Ta_Dma *sorted[] { params.base, params.offs, params.base1 };
+		std::sort(std::begin(sorted), std::end(sorted));
+		const Ta_Dma *last = nullptr;
+		for (const Ta_Dma *param : sorted)
+		{
+			if (param == nullptr || param == last)
+				continue;
+			last = param;
+			u32 ppid = (u8)(ta_type_lut[param->pcw.obj_ctrl] >> 8);
+			if (ppid == 1)
+			{
+				const TA_PolyParam1 *pp = (const TA_PolyParam1 *)param;
+				poly_float_color(FaceBaseColor, FaceColor);
+			}
+			else if (ppid == 2)
+				AppendPolyParam2B((void *)&param[1]);
+			else if (ppid == 4)
+				AppendPolyParam4B((void *)&param[1]);
+		}
+	}
 };
 
 static void getRegionTileClipping(u32& xmin, u32& xmax, u32& ymin, u32& ymax);
@@ -1181,6 +1397,355 @@ static void parseRenderPass(RenderPass& pass, const RenderPass& previousPass, re
 	}
 }
 
+#ifdef _OPENMP
+//
+// Multi-threaded parsing
+// Each pass is split at the end of lists. Consecutive lists are grouped into chunks
+// that are parsed concurrently. The first chunk is parsed into the render context and
+// the others into separate arenas that are then appended in order to the render context.
+//
+
+// Passes smaller than this are parsed on a single thread
+constexpr size_t PARALLEL_PARSE_MIN_SIZE = 64 * 1024;
+
+struct TaListSegment
+{
+	Ta_Dma *start;
+	Ta_Dma *end;
+	// Parser state at the start of the segment
+	u32 tileclip;
+	FaceColorParams faceColors;
+};
+
+// Walks the TA data like ta_main does but without decoding anything, and splits it at the end of each list.
+// Returns false if the data cannot be split: a list or parameter is continued in the next pass
+// or an unhandled parameter type is found.
+static bool splitTaData(Ta_Dma *data, Ta_Dma *data_end, u32 tileclip, std::vector<TaListSegment>& segments, TaListSegment& endState)
+{
+	enum { VtxNone, VtxPoly, VtxSprite, VtxModVol } vtxType = VtxNone;
+	const u32 *typeLut = TaTypeLut::instance().table;
+	u32 vtxSize = SZ32;
+	u32 listType = ListType_None;
+	FaceColorParams faceColors{};
+
+	segments.clear();
+	segments.push_back({ data, data, tileclip, faceColors });
+	while (data < data_end)
+	{
+		switch (data->pcw.ParaType)
+		{
+		case ParamType_End_Of_List:
+			listType = ListType_None;
+			vtxType = VtxNone;
+			data += SZ32;
+			segments.back().end = data;
+			segments.push_back({ data, data, tileclip, faceColors });
+			break;
+
+		case ParamType_User_Tile_Clip:
+			tileclip = tileClipRect(tileclip, data->data_32[3] & 63, data->data_32[4] & 31, data->data_32[5] & 63, data->data_32[6] & 31);
+			data += SZ32;
+			break;
+
+		case ParamType_Object_List_Set:
+			data += SZ32;
+			break;
+
+		case ParamType_Polygon_or_Modifier_Volume:
+			tileclip = tileClipMode(tileclip, data->pcw.User_Clip);
+			if (listType == ListType_None)
+			{
+				if (data->pcw.ListType > ListType_Punch_Through)
+				{
+					data += SZ32;
+					break;
+				}
+				listType = data->pcw.ListType;
+			}
+			if (IsModVolList(listType))
+			{
+				vtxType = VtxModVol;
+				data += SZ32;
+			}
+			else
+			{
+				u32 uid = typeLut[data->pcw.obj_ctrl];
+				if (uid == TaTypeLut::INVALID_TYPE)
+				{
+					data += SZ32;
+					break;
+				}
+				u32 psz = uid >> 30;
+				u32 pdid = (u8)uid;
+				u32 ppid = (u8)(uid >> 8);
+				if (data > data_end - psz)
+					return false;
+				faceColors.set(ppid, data);
+				vtxType = VtxPoly;
+				vtxSize = pdid == 5 || pdid == 6 || pdid >= 11 ? SZ64 : SZ32;
+				data += psz;
+			}
+			break;
+
+		case ParamType_Sprite:
+			tileclip = tileClipMode(tileclip, data->pcw.User_Clip);
+			if (listType == ListType_None)
+			{
+				if (data->pcw.ListType > ListType_Punch_Through)
+				{
+					data += SZ32;
+					break;
+				}
+				listType = data->pcw.ListType;
+			}
+			vtxType = VtxSprite;
+			data += SZ32;
+			break;
+
+		case ParamType_Vertex_Parameter:
+			switch (vtxType)
+			{
+			case VtxNone:
+				data += SZ32;
+				break;
+			case VtxSprite:
+			case VtxModVol:
+				if (data == data_end - SZ32)
+					return false;
+				data += SZ64;
+				break;
+			case VtxPoly:
+				// Vertices are consumed until the end of the strip
+				bool endOfStrip;
+				do {
+					if (data > data_end - vtxSize)
+						return false;
+					endOfStrip = data->pcw.EndOfStrip;
+					data += vtxSize;
+				} while (!endOfStrip);
+				break;
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+	if (segments.back().start == data_end)
+		segments.pop_back();
+	else
+		segments.back().end = data_end;
+	endState = { data_end, data_end, tileclip, faceColors };
+
+	return listType == ListType_None;
+}
+
+template<typename T>
+static T *appendList(List<T>& dest, const List<T>& src)
+{
+	if (src.used() > dest.avail)
+		return dest.sig_overrun();
+	T *p = dest.Append(src.used());
+	memcpy(p, src.head(), src.bytes());
+	return p;
+}
+
+// Appends the lists parsed into an arena to the render context
+static void mergeArena(rend_context& dest, const rend_context& src)
+{
+	const u32 vertexBase = dest.verts.used();
+	const u32 modTrigBase = dest.modtrig.used();
+	appendList(dest.verts, src.verts);
+	appendList(dest.modtrig, src.modtrig);
+	for (List<PolyParam> rend_context::*list : { &rend_context::global_param_op, &rend_context::global_param_pt, &rend_context::global_param_tr })
+	{
+		PolyParam *pp = appendList(dest.*list, src.*list);
+		for (int i = 0; i < (src.*list).used() && !dest.Overrun; i++)
+			pp[i].first += vertexBase;
+	}
+	for (List<ModifierVolumeParam> rend_context::*list : { &rend_context::global_param_mvo, &rend_context::global_param_mvo_tr })
+	{
+		ModifierVolumeParam *mvp = appendList(dest.*list, src.*list);
+		for (int i = 0; i < (src.*list).used() && !dest.Overrun; i++)
+			mvp[i].first += modTrigBase;
+	}
+	if ((s32&)dest.fZ_max < (s32&)src.fZ_max)
+		dest.fZ_max = src.fZ_max;
+	dest.Overrun |= src.Overrun;
+}
+
+static std::unique_ptr<TA_context> arenas[TA_PARSER_SLOTS];
+
+static TA_context *newArena()
+{
+	TA_context *arena = new TA_context();
+	arena->Alloc();
+	return arena;
+}
+
+static void clearArena(rend_context& rend, f32 fZ_max)
+{
+	rend.verts.Clear();
+	rend.modtrig.Clear();
+	rend.global_param_op.Clear();
+	rend.global_param_pt.Clear();
+	rend.global_param_tr.Clear();
+	rend.global_param_mvo.Clear();
+	rend.global_param_mvo_tr.Clear();
+	rend.Overrun = false;
+	rend.fZ_max = fZ_max;
+}
+
+template<int Red, int Green, int Blue, int Alpha, u32 Slot>
+static void parseChunk(TA_context *dest, const TaListSegment& chunk, const FaceColors& faceColors)
+{
+	using Parser = TAParserTempl<Red, Green, Blue, Alpha, Slot>;
+
+	TA_context *const prevCtx = Parser::vd_ctx;
+	const bool prevFetchTextures = Parser::fetchTextures;
+	Parser::vd_ctx = dest;
+	Parser::reset();
+	// The texture cache isn't thread safe
+	Parser::fetchTextures = false;
+	Parser::setTileClip(chunk.tileclip);
+	Parser::setFaceColors(faceColors);
+	Parser::applyFaceColors(chunk.faceColors);
+
+	Ta_Dma *data = chunk.start;
+	while (data < chunk.end)
+		data = Parser::TaCmd(data, chunk.end);
+
+	Parser::fetchTextures = prevFetchTextures;
+	Parser::vd_ctx = prevCtx;
+}
+
+template<int Red, int Green, int Blue, int Alpha>
+static void parseChunk(u32 slot, TA_context *dest, const TaListSegment& chunk, const FaceColors& faceColors)
+{
+	static_assert(TA_PARSER_SLOTS == 4, "Update the slot list");
+	switch (slot)
+	{
+	case 0:
+		parseChunk<Red, Green, Blue, Alpha, 0>(dest, chunk, faceColors);
+		break;
+	case 1:
+		parseChunk<Red, Green, Blue, Alpha, 1>(dest, chunk, faceColors);
+		break;
+	case 2:
+		parseChunk<Red, Green, Blue, Alpha, 2>(dest, chunk, faceColors);
+		break;
+	case 3:
+		parseChunk<Red, Green, Blue, Alpha, 3>(dest, chunk, faceColors);
+		break;
+	}
+}
+
+// Parses the data of one pass on multiple threads.
+// Returns false if the pass must be parsed sequentially.
+template<int Red, int Green, int Blue, int Alpha>
+static bool ta_parse_parallel(Ta_Dma *data, Ta_Dma *data_end)
+{
+	using Parser = TAParserTempl<Red, Green, Blue, Alpha>;
+	static std::vector<TaListSegment> segments;
+	static std::vector<TaListSegment> chunks;
+
+	const size_t size = (data_end - data) * sizeof(Ta_Dma);
+	if (!config::ParallelTAParsing || size < PARALLEL_PARSE_MIN_SIZE || !Parser::isIdle())
+		return false;
+	const int threads = std::min<int>(omp_get_num_procs(), TA_PARSER_SLOTS);
+	if (threads < 2)
+		return false;
+	TaListSegment endState;
+	if (!splitTaData(data, data_end, Parser::getTileClip(), segments, endState) || segments.size() < 2)
+		return false;
+
+	// Group consecutive lists into chunks of similar size
+	chunks.clear();
+	for (const TaListSegment& segment : segments)
+	{
+		size_t offset = (segment.start - data) * sizeof(Ta_Dma);
+		if (chunks.empty() || (chunks.size() < (size_t)threads && offset >= size * chunks.size() / threads))
+			chunks.push_back(segment);
+		else
+			chunks.back().end = segment.end;
+	}
+	const int chunkCount = (int)chunks.size();
+	for (int i = 1; i < chunkCount; i++)
+	{
+		if (arenas[i] == nullptr)
+			arenas[i].reset(newArena());
+		clearArena(arenas[i]->rend, vd_rc.fZ_max);
+	}
+	FaceColors faceColors;
+	Parser::getFaceColors(faceColors);
+	TA_context *ctx = vd_ctx;
+
+#pragma omp parallel num_threads(chunkCount)
+	{
+		// The chunk parsed by the calling thread goes directly into the render context
+		const int thread = omp_get_thread_num();
+		for (int i = thread; i < chunkCount; i += omp_get_num_threads())
+			parseChunk<Red, Green, Blue, Alpha>(thread, i == 0 ? ctx : arenas[i].get(), chunks[i], faceColors);
+	}
+	for (int i = 1; i < chunkCount; i++)
+		mergeArena(ctx->rend, arenas[i]->rend);
+
+	// Resume in the state left by the last list
+	Parser::setTileClip(endState.tileclip);
+	Parser::applyFaceColors(endState.faceColors);
+	// Textures are fetched once the whole context is parsed
+
+	return true;
+}
+
+static bool ta_parse_parallel(Ta_Dma *data, Ta_Dma *data_end)
+{
+	if (isDirectX(config::RendererType))
+		return ta_parse_parallel<2, 1, 0, 3>(data, data_end);
+	else
+		return ta_parse_parallel<0, 1, 2, 3>(data, data_end);
+}
+
+#else
+static bool ta_parse_parallel(Ta_Dma *data, Ta_Dma *data_end) {
+	return false;
+}
+#endif
+
+// Lets the renderer decode the textures of the context concurrently
+static void prefetchTextures(rend_context& rc)
+{
+	static std::vector<std::pair<TSP, TCW>> textures;
+	textures.clear();
+	for (List<PolyParam> *list : { &rc.global_param_op, &rc.global_param_pt, &rc.global_param_tr })
+		for (const PolyParam& pp : *list)
+		{
+			// Textures decoded here must be fetched afterwards
+			if (pp.pcw.Texture)
+			{
+				textures.emplace_back(pp.tsp, pp.tcw);
+				if (pp.tsp1.full != (u32)-1)
+					textures.emplace_back(pp.tsp1, pp.tcw1);
+			}
+		}
+	if (!textures.empty())
+		renderer->PrefetchTextures(textures);
+}
+
+static void fetchTextures(List<PolyParam>& list, int first)
+{
+	for (int i = first; i < list.used(); i++)
+	{
+		PolyParam& pp = list.head()[i];
+		if (pp.pcw.Texture)
+		{
+			pp.texture = renderer->GetTexture(pp.tsp, pp.tcw);
+			if (pp.tsp1.full != (u32)-1)
+				pp.texture1 = renderer->GetTexture(pp.tsp1, pp.tcw1);
+		}
+	}
+}
+
 static bool ta_parse_vdrc(TA_context* ctx, bool primRestart)
 {
 	bool rv=false;
@@ -1188,6 +1753,8 @@ static bool ta_parse_vdrc(TA_context* ctx, bool primRestart)
 	vd_ctx = ctx;
 
 	ta_parse_reset();
+	// Textures are fetched once all the passes are parsed
+	BaseTAParser::fetchTextures = false;
 
 	bool empty_context = true;
 
@@ -1210,13 +1777,18 @@ static bool ta_parse_vdrc(TA_context* ctx, bool primRestart)
 
 		Ta_Dma* ta_data = (Ta_Dma *)vd_rc.proc_start;
 		Ta_Dma* ta_data_end = (Ta_Dma *)vd_rc.proc_end;
+		if (bench::active)
+			bench::captureTaData(vd_rc.proc_start, (u32)(vd_rc.proc_end - vd_rc.proc_start));
 
-		while (ta_data < ta_data_end)
-			try {
-				ta_data = BaseTAParser::TaCmd(ta_data, ta_data_end);
-			} catch (const TAParserException& e) {
-				break;
-			}
+		if (!ta_parse_parallel(ta_data, ta_data_end))
+		{
+			while (ta_data < ta_data_end)
+				try {
+					ta_data = BaseTAParser::TaCmd(ta_data, ta_data_end);
+				} catch (const TAParserException& e) {
+					break;
+				}
+		}
 
 		if (vd_ctx->rend.Overrun)
 			break;
@@ -1244,10 +1816,18 @@ static bool ta_parse_vdrc(TA_context* ctx, bool primRestart)
 		pass++;
 	}
 	rv = !empty_context;
+	BaseTAParser::fetchTextures = true;
 
 	bool overrun = vd_ctx->rend.Overrun;
 	if (overrun)
 		WARN_LOG(PVR, "ERROR: TA context overrun");
+	else
+	{
+		prefetchTextures(vd_rc);
+		fetchTextures(vd_rc.global_param_op, 1);
+		fetchTextures(vd_rc.global_param_pt, 0);
+		fetchTextures(vd_rc.global_param_tr, 0);
+	}
 	if (rv && !overrun)
 	{
 		u32 xmin, xmax, ymin, ymax;
@@ -1267,6 +1847,7 @@ static bool ta_parse_vdrc(TA_context* ctx, bool primRestart)
 
 static bool ta_parse_naomi2(TA_context* ctx, bool primRestart)
 {
+	prefetchTextures(ctx->rend);
 	for (PolyParam& pp : ctx->rend.global_param_op)
 	{
 		if (pp.pcw.Texture)
@@ -1318,12 +1899,35 @@ static bool ta_parse_naomi2(TA_context* ctx, bool primRestart)
 
 bool ta_parse(TA_context *ctx, bool primRestart)
 {
+	bench::Timer timer(bench::TaParse);
 	if (settings.platform.isNaomi2())
 		return ta_parse_naomi2(ctx, primRestart);
 	else
 		return ta_parse_vdrc(ctx, primRestart);
 }
 
+void ta_decode(TA_context *ctx, const u8 *data, u32 size, bool simd)
+{
+	verify(vd_ctx == nullptr);
+	vd_ctx = ctx;
+	ta_parse_reset();
+	BaseTAParser::fetchTextures = false;
+	simdVertexDecode = simd;
+
+	Ta_Dma *ta_data = (Ta_Dma *)data;
+	Ta_Dma *ta_data_end = (Ta_Dma *)(data + size);
+	while (ta_data < ta_data_end)
+		try {
+			ta_data = BaseTAParser::TaCmd(ta_data, ta_data_end);
+		} catch (const TAParserException& e) {
+			break;
+		}
+
+	simdVertexDecode = true;
+	BaseTAParser::fetchTextures = true;
+	vd_ctx = nullptr;
+}
+
 //
 // Naomi 2 stuff
 //
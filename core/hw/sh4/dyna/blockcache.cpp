@@ -0,0 +1,415 @@
+/*
+	Persistent cache of decoded blocks
+*/
+#include "blockcache.h"
+
+#if FEAT_SHREC != DYNAREC_NONE
+#include "blockmanager.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "cfg/option.h"
+#include "emulator.h"
+#include "oslib/oslib.h"
+#include "version.h"
+
+#include <xxhash.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Bump when the file format or the shil code changes
+constexpr u32 CACHE_VERSION = 1;
+constexpr u32 CACHE_MAGIC = 0x43344853;	// SH4C
+// Blocks with the same address (overlays)
+constexpr size_t MAX_BLOCKS_PER_ADDR = 4;
+
+struct CachedBlock
+{
+	u32 fpuMode;
+	u32 codeSize;
+	u64 hash;
+	bool readOnly;
+	bool hasFpuOp;
+	bool hasJcond;
+	u32 guestCycles;
+	u32 guestOpcodes;
+	u32 blockType;
+	u32 branchBlock;
+	u32 nextBlock;
+	u32 opCount;
+	std::vector<u8> ops;
+};
+
+static std::mutex mutex;
+static std::unordered_multimap<u32, CachedBlock> blocks;
+static std::string cachePath;
+// Game whose cache has been loaded, or empty
+static std::string loadedGameId;
+static bool dirty;
+
+class CacheWriter
+{
+public:
+	CacheWriter(std::vector<u8>& data) : data(data) {}
+
+	template<typename T>
+	void write(const T& v)
+	{
+		const u8 *p = (const u8 *)&v;
+		data.insert(data.end(), p, p + sizeof(T));
+	}
+
+	void write(const shil_param& param)
+	{
+		write((u8)param.type);
+		write(param._imm);
+		if (param.is_reg())
+			for (u32 i = 0; i < param.count(); i++)
+				write(param.version[i]);
+	}
+
+private:
+	std::vector<u8>& data;
+};
+
+class CacheReader
+{
+public:
+	CacheReader(const u8 *data, size_t size) : p(data), end(data + size) {}
+
+	template<typename T>
+	void read(T& v)
+	{
+		if ((size_t)(end - p) < sizeof(T))
+			throw FlycastException("Truncated block cache");
+		memcpy(&v, p, sizeof(T));
+		p += sizeof(T);
+	}
+
+	void read(bool& v)
+	{
+		u8 b;
+		read(b);
+		v = b != 0;
+	}
+
+	void read(shil_param& param)
+	{
+		u8 type;
+		read(type);
+		if (type > FMT_V16)
+			throw FlycastException("Invalid block cache");
+		param.type = type;
+		read(param._imm);
+		if (param.is_reg())
+		{
+			if (param._imm + param.count() > sh4_reg_count)
+				throw FlycastException("Invalid block cache");
+			for (u32 i = 0; i < param.count(); i++)
+				read(param.version[i]);
+		}
+	}
+
+	void read(std::vector<u8>& v, size_t size)
+	{
+		if ((size_t)(end - p) < size)
+			throw FlycastException("Truncated block cache");
+		v.assign(p, p + size);
+		p += size;
+	}
+
+	bool eof() const { return p == end; }
+
+private:
+	const u8 *p;
+	const u8 *end;
+};
+
+// Only the fpscr bits used by the decoder
+static u32 fpuMode(fpscr_t fpu_cfg)
+{
+	return fpu_cfg.PR | (fpu_cfg.SZ << 1) | ((fpu_cfg.RM == 1) << 2);
+}
+
+// Blocks are hashed with the memory pages they span if they are read-only
+// since the optimizer can read constants from them
+static bool hashBlock(u32 addr, u32 size, bool readOnly, u64& hash)
+{
+	if (readOnly)
+	{
+		u32 end = addr + size;
+		addr &= ~PAGE_MASK;
+		size = ((end + PAGE_MASK) & ~PAGE_MASK) - addr;
+	}
+	if (!IsOnRam(addr) || (addr & RAM_MASK) + size > RAM_SIZE)
+		return false;
+	const u8 *p = GetMemPtr(addr, size);
+	if (p == nullptr)
+		return false;
+	hash = XXH64(p, size, 0);
+
+	return true;
+}
+
+bool bc_Lookup(RuntimeBlockInfo* block, bool fpu_disabled, const u32 *unprotectedMask)
+{
+	if (!config::DynarecPersistentCache || mmu_enabled())
+		return false;
+
+	std::lock_guard<std::mutex> _(mutex);
+	const u32 mode = fpuMode(block->fpu_cfg);
+	auto range = blocks.equal_range(block->addr);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const CachedBlock& cached = it->second;
+		if (cached.fpuMode != mode || (fpu_disabled && cached.hasFpuOp))
+			continue;
+		block->sh4_code_size = cached.codeSize;
+		u64 hash;
+		bool readOnly = unprotectedMask == nullptr ? block->CanBeProtected() : block->CanBeProtected(*unprotectedMask);
+		if (readOnly != cached.readOnly
+				|| !hashBlock(block->addr, cached.codeSize, cached.readOnly, hash)
+				|| hash != cached.hash)
+			continue;
+
+		std::vector<shil_opcode> oplist(cached.opCount);
+		try {
+			CacheReader reader(cached.ops.data(), cached.ops.size());
+			for (shil_opcode& op : oplist)
+			{
+				u8 b;
+				reader.read(b);
+				if (b >= shop_max)
+					throw FlycastException("Invalid block cache");
+				op.op = (shilop)b;
+				reader.read(b);
+				op.size = b;
+				reader.read(op.rd);
+				reader.read(op.rd2);
+				reader.read(op.rs1);
+				reader.read(op.rs2);
+				reader.read(op.rs3);
+				reader.read(op.guest_offs);
+				reader.read(op.delay_slot);
+			}
+		} catch (const FlycastException& e) {
+			WARN_LOG(DYNAREC, "Block cache entry %08x: %s", block->addr, e.what());
+			continue;
+		}
+		block->oplist = std::move(oplist);
+		block->has_fpu_op = cached.hasFpuOp;
+		block->has_jcond = cached.hasJcond;
+		block->guest_cycles = cached.guestCycles;
+		block->guest_opcodes = cached.guestOpcodes;
+		block->BlockType = (BlockEndType)cached.blockType;
+		block->BranchBlock = cached.branchBlock;
+		block->NextBlock = cached.nextBlock;
+
+		return true;
+	}
+	block->sh4_code_size = 0;
+
+	return false;
+}
+
+void bc_Store(const RuntimeBlockInfo* block)
+{
+	if (!config::DynarecPersistentCache || mmu_enabled() || block->temp_block || block->superblock)
+		return;
+
+	CachedBlock cached;
+	if (!hashBlock(block->addr, block->sh4_code_size, block->read_only, cached.hash))
+		return;
+	cached.fpuMode = fpuMode(block->fpu_cfg);
+	cached.codeSize = block->sh4_code_size;
+	cached.readOnly = block->read_only;
+	cached.hasFpuOp = block->has_fpu_op;
+	cached.hasJcond = block->has_jcond;
+	cached.guestCycles = block->guest_cycles;
+	cached.guestOpcodes = block->guest_opcodes;
+	cached.blockType = block->BlockType;
+	cached.branchBlock = block->BranchBlock;
+	cached.nextBlock = block->NextBlock;
+	cached.opCount = (u32)block->oplist.size();
+	CacheWriter writer(cached.ops);
+	for (const shil_opcode& op : block->oplist)
+	{
+		writer.write((u8)op.op);
+		writer.write((u8)op.size);
+		writer.write(op.rd);
+		writer.write(op.rd2);
+		writer.write(op.rs1);
+		writer.write(op.rs2);
+		writer.write(op.rs3);
+		writer.write(op.guest_offs);
+		writer.write((u8)op.delay_slot);
+	}
+
+	std::lock_guard<std::mutex> _(mutex);
+	if (cachePath.empty())
+		return;
+	auto range = blocks.equal_range(block->addr);
+	if ((size_t)std::distance(range.first, range.second) >= MAX_BLOCKS_PER_ADDR)
+		blocks.erase(range.first);
+	blocks.emplace(block->addr, std::move(cached));
+	dirty = true;
+}
+
+static void writeHeader(CacheWriter& writer)
+{
+	writer.write(CACHE_MAGIC);
+	writer.write(CACHE_VERSION);
+	// The decoded blocks depend on the emulator version and idle skip setting
+	writer.write(XXH32(GIT_HASH, strlen(GIT_HASH), 0));
+	writer.write((u8)config::DynarecIdleSkip);
+	writer.write((u32)shop_max);
+}
+
+static void loadCache(const std::string& gameId)
+{
+	std::lock_guard<std::mutex> _(mutex);
+	blocks.clear();
+	dirty = false;
+	cachePath.clear();
+	loadedGameId.clear();
+	if (!config::DynarecPersistentCache || gameId.empty())
+		return;
+	loadedGameId = gameId;
+	std::string name = gameId;
+	for (char& c : name)
+		if (c == '/' || c == '\\' || c == ':' || c == '*' || c == '?')
+			c = '_';
+	cachePath = hostfs::getShaderCachePath(name + ".sh4cache");
+
+	FILE *f = nowide::fopen(cachePath.c_str(), "rb");
+	if (f == nullptr)
+		return;
+	std::fseek(f, 0, SEEK_END);
+	size_t size = std::ftell(f);
+	std::fseek(f, 0, SEEK_SET);
+	std::vector<u8> data(size);
+	size_t read = std::fread(data.data(), 1, size, f);
+	std::fclose(f);
+	if (read != size)
+	{
+		WARN_LOG(DYNAREC, "Error reading block cache %s", cachePath.c_str());
+		return;
+	}
+
+	std::vector<u8> header;
+	CacheWriter headerWriter(header);
+	writeHeader(headerWriter);
+	if (size < header.size() || memcmp(data.data(), header.data(), header.size()) != 0)
+	{
+		INFO_LOG(DYNAREC, "Block cache %s is outdated", cachePath.c_str());
+		return;
+	}
+	try {
+		CacheReader reader(data.data() + header.size(), size - header.size());
+		while (!reader.eof())
+		{
+			u32 addr;
+			CachedBlock cached;
+			u32 opsSize;
+			reader.read(addr);
+			reader.read(cached.fpuMode);
+			reader.read(cached.codeSize);
+			reader.read(cached.hash);
+			reader.read(cached.readOnly);
+			reader.read(cached.hasFpuOp);
+			reader.read(cached.hasJcond);
+			reader.read(cached.guestCycles);
+			reader.read(cached.guestOpcodes);
+			reader.read(cached.blockType);
+			reader.read(cached.branchBlock);
+			reader.read(cached.nextBlock);
+			reader.read(cached.opCount);
+			reader.read(opsSize);
+			reader.read(cached.ops, opsSize);
+			blocks.emplace(addr, std::move(cached));
+		}
+	} catch (const FlycastException& e) {
+		WARN_LOG(DYNAREC, "Block cache %s: %s", cachePath.c_str(), e.what());
+		blocks.clear();
+		return;
+	}
+	INFO_LOG(DYNAREC, "Loaded %zd blocks from %s", blocks.size(), cachePath.c_str());
+}
+
+static void saveCache()
+{
+	std::lock_guard<std::mutex> _(mutex);
+	if (!dirty || cachePath.empty())
+		return;
+	std::vector<u8> data;
+	CacheWriter writer(data);
+	writeHeader(writer);
+	for (const auto& it : blocks)
+	{
+		const CachedBlock& cached = it.second;
+		writer.write(it.first);
+		writer.write(cached.fpuMode);
+		writer.write(cached.codeSize);
+		writer.write(cached.hash);
+		writer.write(cached.readOnly);
+		writer.write(cached.hasFpuOp);
+		writer.write(cached.hasJcond);
+		writer.write(cached.guestCycles);
+		writer.write(cached.guestOpcodes);
+		writer.write(cached.blockType);
+		writer.write(cached.branchBlock);
+		writer.write(cached.nextBlock);
+		writer.write(cached.opCount);
+		writer.write((u32)cached.ops.size());
+		data.insert(data.end(), cached.ops.begin(), cached.ops.end());
+	}
+	FILE *f = nowide::fopen(cachePath.c_str(), "wb");
+	if (f == nullptr)
+	{
+		WARN_LOG(DYNAREC, "Cannot save block cache to %s", cachePath.c_str());
+		return;
+	}
+	std::fwrite(data.data(), 1, data.size(), f);
+	std::fclose(f);
+	dirty = false;
+	INFO_LOG(DYNAREC, "Saved %zd blocks to %s", blocks.size(), cachePath.c_str());
+}
+
+static void emuEventCallback(Event event, void *)
+{
+	switch (event)
+	{
+	case Event::Start:
+		// Also sent when resuming
+		if (settings.content.gameId != loadedGameId)
+			loadCache(settings.content.gameId);
+		break;
+	case Event::Pause:
+		saveCache();
+		break;
+	case Event::Terminate:
+		saveCache();
+		loadCache("");
+		break;
+	default:
+		break;
+	}
+}
+
+void bc_Init()
+{
+	EventManager::listen(Event::Start, emuEventCallback);
+	EventManager::listen(Event::Pause, emuEventCallback);
+	EventManager::listen(Event::Terminate, emuEventCallback);
+}
+
+void bc_Term()
+{
+	EventManager::unlisten(Event::Start, emuEventCallback);
+	EventManager::unlisten(Event::Pause, emuEventCallback);
+	EventManager::unlisten(Event::Terminate, emuEventCallback);
+	saveCache();
+	loadCache("");
+}
+
+#endif
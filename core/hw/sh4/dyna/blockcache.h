@@ -0,0 +1,22 @@
+/*
+	Persistent cache of decoded blocks
+
+	The shil code of each block, after the SSA optimizations, is saved in a per-game file
+	and reused at the next start so that blocks found in the cache skip decoding and optimization.
+	Blocks are keyed by address, fpu mode and a hash of the guest code.
+	Only blocks in system RAM compiled with the mmu disabled are cached.
+*/
+#pragma once
+#include "types.h"
+
+struct RuntimeBlockInfo;
+
+void bc_Init();
+void bc_Term();
+
+// Fills the block if found in the cache. block->addr and block->fpu_cfg must be set.
+// Thread safe. Off the emulation thread, unprotectedMask must point to a snapshot of the
+// unprotected page flags (see RuntimeBlockInfo::CanBeProtected)
+bool bc_Lookup(RuntimeBlockInfo* block, bool fpu_disabled, const u32 *unprotectedMask = nullptr);
+// Adds a block that has just been decoded and optimized. Thread safe.
+void bc_Store(const RuntimeBlockInfo* block);
@@ -33,6 +33,9 @@ static bm_List del_blocks;
 
 bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
 static std::set<RuntimeBlockInfo*> blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
+// pages protected on behalf of the interpreter block cache
+static bool code_pages[RAM_SIZE_MAX/PAGE_SIZE];
+static bm_CodePageHandler codePageHandler;
 
 static bm_Map blkmap;
 // Stats
@@ -41,6 +44,44 @@ u32 unprotected_blocks;
 
 #define FPCA(x) ((DynarecCodeEntryPtr&)sh4rcb.fpcb[(x>>1)&FPCB_MASK])
 
+#ifdef FAST_MMU
+// First level of the block lookup when the mmu is enabled:
+// direct-mapped cache of virtual to physical 1K page translations.
+// The second level is the fpcb table.
+// Entries are only valid for the mmu generation they were filled with.
+struct VPageEntry
+{
+	u32 vpage;
+	u32 ppage;
+	u32 generation;
+};
+constexpr u32 VPAGE_CACHE_SIZE = 4096;
+static VPageEntry vpageCache[VPAGE_CACHE_SIZE];
+// mmu generation of the last fill, to detect wrap-arounds
+static u32 vpageCacheGeneration;
+
+static void bm_FlushVPageCache()
+{
+	for (VPageEntry& entry : vpageCache)
+		entry.vpage = 1;	// never matches an aligned address
+	vpageCacheGeneration = mmuGeneration;
+}
+#endif
+
+ReturnStack returnStack { {}, 0, 1 };
+// Never cached. Entries point to it when the return stack is invalidated.
+static ReturnSlot invalidReturnSlot;
+
+// The return target of all the slots must be looked up again
+// and the blocks referenced by the entries may be deleted
+static void bm_InvalidateReturnStack()
+{
+	if (++returnStack.epoch == 0)
+		returnStack.epoch = 1;
+	for (ReturnStackEntry& entry : returnStack.entries)
+		entry.slot = &invalidReturnSlot;
+}
+
 // addr must be a physical address
 // This returns an executable address
 static DynarecCodeEntryPtr DYNACALL bm_GetCode(u32 addr)
@@ -92,6 +133,13 @@ DynarecCodeEntryPtr DYNACALL bm_GetCodeByVAddr(u32 addr)
 		addr = next_pc;
 	}
 
+#ifdef FAST_MMU
+	VPageEntry& entry = vpageCache[(addr >> 10) & (VPAGE_CACHE_SIZE - 1)];
+	const u32 generation = mmuGeneration;
+	if (entry.vpage == (addr & ~0x3ff) && entry.generation == generation)
+		return bm_GetCode(entry.ppage | (addr & 0x3ff));
+#endif
+
 	u32 paddr;
 	u32 rv = mmu_instruction_translation(addr, paddr);
 	if (rv != MMU_ERROR_NONE)
@@ -99,10 +147,39 @@ DynarecCodeEntryPtr DYNACALL bm_GetCodeByVAddr(u32 addr)
 		DoMMUException(addr, rv, MMU_TT_IREAD);
 		mmu_instruction_translation(next_pc, paddr);
 	}
+#ifdef FAST_MMU
+	// The generation changes if the translation modifies the mmu state
+	else if (generation == mmuGeneration)
+	{
+		if (unlikely(generation < vpageCacheGeneration))
+			// Old entries could match again
+			bm_FlushVPageCache();
+		vpageCacheGeneration = generation;
+		entry.vpage = addr & ~0x3ff;
+		entry.ppage = paddr & ~0x3ff;
+		entry.generation = generation;
+	}
+#endif
 
 	return bm_GetCode(paddr);
 }
 
+DynarecCodeEntryPtr DYNACALL bm_GetReturnCode(ReturnSlot *slot)
+{
+	const u32 pc = next_pc;
+	const u32 generation = mmuGeneration;
+	DynarecCodeEntryPtr code = bm_GetCodeByVAddr(pc);
+	// Don't cache blocks not compiled yet, exceptions or translations that changed the mmu state
+	if (slot != &invalidReturnSlot && next_pc == pc && generation == mmuGeneration
+			&& code != ngen_FailedToFindBlock)
+	{
+		slot->code = code;
+		slot->epoch = returnStack.epoch;
+		slot->mmuGeneration = generation;
+	}
+	return code;
+}
+
 // addr must be a physical address
 // This returns an executable address
 RuntimeBlockInfoPtr DYNACALL bm_GetBlock(u32 addr)
@@ -137,6 +214,10 @@ RuntimeBlockInfoPtr bm_GetBlock(void* dynarec_code)
 
 static void bm_CleanupDeletedBlocks()
 {
+	if (del_blocks.empty())
+		return;
+	// A block discarded while running may have pushed its return slot after being discarded
+	bm_InvalidateReturnStack();
 	del_blocks.clear();
 }
 
@@ -211,6 +292,7 @@ void bm_DiscardBlock(RuntimeBlockInfo* block)
 
 	del_blocks.push_back(block_ptr);
 	block_ptr->Discard();
+	bm_InvalidateReturnStack();
 }
 
 void bm_Periodical_1s()
@@ -231,6 +313,7 @@ void bm_Reset()
 	bm_CleanupDeletedBlocks();
 	protected_blocks = 0;
 	unprotected_blocks = 0;
+	bm_ResetCodePages();
 
 	if (_nvmem_enabled())
 	{
@@ -273,6 +356,44 @@ void bm_UnlockPage(u32 addr, u32 size)
 		mem_region_unlock(&mem_b[addr], size);
 }
 
+void bm_SetCodePageHandler(bm_CodePageHandler handler)
+{
+	codePageHandler = handler;
+}
+
+bool bm_ProtectCodePage(u32 addr)
+{
+#ifdef TARGET_NO_EXCEPTIONS
+	return false;
+#else
+	addr &= RAM_MASK;
+	u32 page = addr / PAGE_SIZE;
+	if (unprotected_pages[page])
+		return false;
+	if (!code_pages[page])
+	{
+		code_pages[page] = true;
+		if (blocks_per_page[page].empty())
+			bm_LockPage(addr);
+	}
+	return true;
+#endif
+}
+
+void bm_ResetCodePages()
+{
+	for (u32 page = 0; page < RAM_SIZE_MAX / PAGE_SIZE; page++)
+	{
+		if (!code_pages[page])
+			continue;
+		code_pages[page] = false;
+		if (blocks_per_page[page].empty())
+			bm_UnlockPage(page * PAGE_SIZE);
+		if (codePageHandler != nullptr)
+			codePageHandler(page * PAGE_SIZE);
+	}
+}
+
 void bm_ResetCache()
 {
 	ngen_ResetBlocks();
@@ -299,6 +420,7 @@ void bm_ResetCache()
 		block_list.clear();
 
 	memset(unprotected_pages, 0, sizeof(unprotected_pages));
+	bm_InvalidateReturnStack();
 
 #ifdef DYNA_OPROF
 	if (oprofHandle)
@@ -326,6 +448,7 @@ void bm_ResetTempCache(bool full)
 	}
 	del_blocks.insert(del_blocks.begin(),all_temp_blocks.begin(),all_temp_blocks.end());
 	all_temp_blocks.clear();
+	bm_InvalidateReturnStack();
 }
 
 void bm_Init()
@@ -337,6 +460,10 @@ void bm_Init()
 	else
 		INFO_LOG(DYNAREC, "bm: Oprofile integration enabled !");
 #endif
+#ifdef FAST_MMU
+	bm_FlushVPageCache();
+#endif
+	bm_InvalidateReturnStack();
 }
 
 void bm_Term()
@@ -530,29 +657,47 @@ void RuntimeBlockInfo::Discard()
 	}
 }
 
-void RuntimeBlockInfo::SetProtectedFlags()
+bool RuntimeBlockInfo::CanBeProtected() const
 {
 #ifdef TARGET_NO_EXCEPTIONS
-	this->read_only = false;
-	return;
+	return false;
 #endif
 	// Don't write protect rom and BIOS/IP.BIN (Grandia II)
 	if (!IsOnRam(addr) || (addr & 0x1FFF0000) == 0x0c000000)
-	{
-		this->read_only = false;
-		unprotected_blocks++;
-		return;
-	}
+		return false;
 	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE)
-	{
 		if (unprotected_pages[(addr & RAM_MASK) / PAGE_SIZE])
-		{
-			this->read_only = false;
-			unprotected_blocks++;
-			return;
-		}
-	}
-	this->read_only = true;
+			return false;
+
+	return true;
+}
+
+bool RuntimeBlockInfo::CanBeProtected(u32 unprotectedMask) const
+{
+#ifdef TARGET_NO_EXCEPTIONS
+	return false;
+#endif
+	if (!IsOnRam(addr) || (addr & 0x1FFF0000) == 0x0c000000)
+		return false;
+	u32 page = 0;
+	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE, page++)
+		if (page >= 32 || (unprotectedMask & (1u << page)))
+			return false;
+
+	return true;
+}
+
+void RuntimeBlockInfo::SetProtectedFlags()
+{
+	this->read_only = CanBeProtected();
+	if (this->read_only)
+		Protect();
+	else
+		unprotected_blocks++;
+}
+
+void RuntimeBlockInfo::Protect()
+{
 	protected_blocks++;
 	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE)
 	{
@@ -574,6 +719,12 @@ void bm_RamWriteAccess(u32 addr)
 	}
 	unprotected_pages[addr / PAGE_SIZE] = true;
 	bm_UnlockPage(addr);
+	if (code_pages[addr / PAGE_SIZE])
+	{
+		code_pages[addr / PAGE_SIZE] = false;
+		if (codePageHandler != nullptr)
+			codePageHandler(addr);
+	}
 	std::set<RuntimeBlockInfo*>& block_list = blocks_per_page[addr / PAGE_SIZE];
 	if (!block_list.empty())
 	{
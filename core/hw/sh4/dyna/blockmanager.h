@@ -10,6 +10,29 @@ typedef void (*DynarecCodeEntryPtr)();
 struct RuntimeBlockInfo;
 typedef std::shared_ptr<RuntimeBlockInfo> RuntimeBlockInfoPtr;
 
+// Return address stack used by the backends to predict the target of rts.
+// Call blocks push their return address and a pointer to their ReturnSlot,
+// which caches the code of the return target.
+struct ReturnSlot
+{
+	DynarecCodeEntryPtr code;
+	u32 epoch;			// ReturnStack::epoch when cached, 0 if not cached
+	u32 mmuGeneration;	// mmuGeneration when cached
+};
+struct ReturnStackEntry
+{
+	u32 pc;
+	ReturnSlot *slot;
+};
+constexpr u32 RETURN_STACK_SIZE = 16;
+struct ReturnStack
+{
+	ReturnStackEntry entries[RETURN_STACK_SIZE];
+	u32 top;
+	u32 epoch;	// changed when blocks are discarded. Never 0.
+};
+extern ReturnStack returnStack;
+
 struct RuntimeBlockInfo_Core
 {
 	u32 addr;
@@ -19,7 +42,10 @@ struct RuntimeBlockInfo_Core
 
 struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 {
-	bool Setup(u32 pc,fpscr_t fpu_cfg);
+	bool Setup(u32 pc,fpscr_t fpu_cfg, bool superblock = false);
+	// Decodes and analyses the block without modifying the cpu or block manager state.
+	// Only valid if the mmu is disabled.
+	bool SetupAsync(u32 pc, fpscr_t fpu_cfg, u32 unprotectedMask);
 	const char* hash();
 
 	u32 vaddr;
@@ -37,6 +63,9 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	bool has_fpu_op;
 	u32 blockcheck_failures;
 	bool temp_block;
+	bool cached;	// loaded from the persistent block cache
+	bool superblock;	// tier-2 block following unconditional branches
+	u32 merged_blocks;	// number of branches followed by a superblock
 
 	u32 BranchBlock; //if not 0xFFFFFFFF then jump target
 	u32 NextBlock;   //if not 0xFFFFFFFF then next block (by position)
@@ -50,6 +79,8 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 
 	BlockEndType BlockType;
 	bool has_jcond;
+	// Return target of call blocks
+	ReturnSlot returnSlot;
 
 	std::vector<shil_opcode> oplist;
 
@@ -71,8 +102,18 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 
 	void Discard();
 	void SetProtectedFlags();
+	// Emulation thread only
+	bool CanBeProtected() const;
+	// Same check using a snapshot of the unprotected page flags instead of the current ones.
+	// Bit n of unprotectedMask is set if the nth page from the block start page is unprotected.
+	// The block must fit in the 32 pages of the mask.
+	bool CanBeProtected(u32 unprotectedMask) const;
+	void Protect();
 
 	bool read_only;
+
+private:
+	void Init(u32 pc, fpscr_t fpu_cfg);
 };
 
 void bm_WriteBlockMap(const std::string& file);
@@ -103,5 +144,14 @@ static inline bool bm_IsRamPageProtected(u32 addr)
 }
 void bm_LockPage(u32 addr, u32 size = PAGE_SIZE);
 void bm_UnlockPage(u32 addr, u32 size = PAGE_SIZE);
+// Write protection of RAM pages holding code that isn't compiled into blocks (interpreter block cache).
+// The handler is called when a protected page is written to or unprotected by a reset.
+typedef void (*bm_CodePageHandler)(u32 addr);
+void bm_SetCodePageHandler(bm_CodePageHandler handler);
+// Returns false if the page has already been written to and can't be protected anymore
+bool bm_ProtectCodePage(u32 addr);
+void bm_ResetCodePages();
 u32 bm_getRamOffset(void *p);
+// Returns the code of the block at next_pc after a predicted return, and caches it in the slot
+DynarecCodeEntryPtr DYNACALL bm_GetReturnCode(ReturnSlot *slot);
 
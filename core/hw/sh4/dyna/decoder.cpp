@@ -20,7 +20,7 @@
 #define BLOCK_MAX_SH_OPS_SOFT 500
 #define BLOCK_MAX_SH_OPS_HARD 511
 
-static RuntimeBlockInfo* blk;
+static thread_local RuntimeBlockInfo* blk;
 
 static const char idle_hash[] =
        //BIOS
@@ -61,7 +61,7 @@ static inline shil_param mk_regi(int reg)
 	return mk_reg((Sh4RegType)reg);
 }
 
-static state_t state;
+static thread_local state_t state;
 
 static void Emit(shilop op, shil_param rd = shil_param(), shil_param rs1 = shil_param(), shil_param rs2 = shil_param(),
 		u32 size = 0, shil_param rs3 = shil_param(), shil_param rd2 = shil_param())
@@ -567,9 +567,9 @@ static void dec_param(DecParam p,shil_param& r1,shil_param& r2, u32 op)
 #define DIV1_KEY 0x3004
 #define ROTCL_KEY 0x4024
 
-static Sh4RegType div_som_reg1;
-static Sh4RegType div_som_reg2;
-static Sh4RegType div_som_reg3;
+static thread_local Sh4RegType div_som_reg1;
+static thread_local Sh4RegType div_som_reg2;
+static thread_local Sh4RegType div_som_reg3;
 
 static u32 MatchDiv32(u32 pc , Sh4RegType &reg1,Sh4RegType &reg2 , Sh4RegType &reg3)
 {
@@ -965,7 +965,7 @@ void dec_updateBlockCycles(RuntimeBlockInfo *block, u16 op)
 	}
 }
 
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi, u32 max_cycles, bool fpu_disabled)
 {
 	blk=rbi;
 	state_Setup(blk->vaddr, blk->fpu_cfg);
@@ -998,7 +998,7 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 
 					if (OpDesc[op]->IsFloatingPoint())
 					{
-						if (sr.FD == 1)
+						if (fpu_disabled)
 						{
 							// We need to know FPSCR to compile the block, so let the exception handler run first
 							// as it may change the fp registers
@@ -1036,6 +1036,21 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 			break;
 
 		case NDO_End:
+			// Superblocks: follow unconditional forward branches (bra, bsr) into the same or next page
+			if (blk->superblock && state.cpu.is_delayslot
+					&& (state.BlockType == BET_StaticJump || state.BlockType == BET_StaticCall)
+					&& state.JumpAddr >= state.cpu.rpc
+					&& (state.JumpAddr >> 12) <= (blk->vaddr >> 12) + 1
+					&& GetMemPtr(state.JumpAddr, 2) != nullptr)
+			{
+				state.cpu.rpc = state.JumpAddr;
+				state.cpu.is_delayslot = false;
+				state.NextOp = NDO_NextOp;
+				state.BlockType = BET_SCL_Intr;
+				state.JumpAddr = NullAddress;
+				blk->merged_blocks++;
+				continue;
+			}
 			// Disabled for now since we need to know if the block is read-only,
 			// which isn't determined until after the decoding.
 			// This is a relatively rare optimization anyway
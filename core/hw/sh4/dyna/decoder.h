@@ -38,7 +38,7 @@ enum NextDecoderOperation
 };
 
 struct RuntimeBlockInfo;
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles);
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi, u32 max_cycles, bool fpu_disabled);
 void dec_updateBlockCycles(RuntimeBlockInfo *block, u16 op);
 
 struct state_t
@@ -4,6 +4,7 @@
 #include "hw/sh4/sh4_interpreter.h"
 #include "hw/sh4/sh4_core.h"
 #include "hw/sh4/sh4_interrupts.h"
+#include "hw/sh4/sh4_opcode_list.h"
 
 #include "hw/sh4/sh4_mem.h"
 #include "hw/sh4/modules/mmu.h"
@@ -13,8 +14,17 @@
 #include "blockmanager.h"
 #include "ngen.h"
 #include "decoder.h"
+#include "blockcache.h"
+#include "profiler/bench.h"
+#include "cfg/option.h"
 
 #include <xxhash.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #if FEAT_SHREC != DYNAREC_NONE
 
@@ -37,10 +47,16 @@ u8* CodeCache;
 static u8* TempCodeCache;
 ptrdiff_t cc_rx_offset;
 
+// Blocks compiled on the emulation thread are allocated upward from the bottom of the code cache.
+// Background compilation takes chunks downward from TopAddr.
+// Both are protected by codeCacheMutex.
 static u32 LastAddr;
+static u32 TopAddr = CODE_SIZE;
+static std::mutex codeCacheMutex;
 static u32 TempLastAddr;
-static u32 *emit_ptr;
-static u32 *emit_ptr_limit;
+// Set when emitting into the temp code cache or into a background compilation chunk
+static thread_local u32 *emit_ptr;
+static thread_local u32 *emit_ptr_limit;
 
 static std::unordered_set<u32> smc_hotspots;
 
@@ -48,6 +64,317 @@ static sh4_if sh4Interp;
 
 void* emit_GetCCPtr() { return emit_ptr==0?(void*)&CodeCache[LastAddr]:(void*)emit_ptr; }
 
+// Runs before retrying when a superblock couldn't be compiled
+constexpr s32 SUPERBLOCK_BACKOFF_RUNS = 10000;
+
+// Hot blocks ending with an unconditional forward branch are recompiled as superblocks
+static bool canBeSuperblock(const RuntimeBlockInfo *block)
+{
+	return config::DynarecSuperblocks && !mmu_enabled() && !block->temp_block && !block->superblock
+			&& (block->BlockType == BET_StaticJump || block->BlockType == BET_StaticCall)
+			&& block->BranchBlock >= block->addr + block->sh4_code_size
+			&& (block->BranchBlock >> 12) <= (block->addr >> 12) + 1
+			&& block->guest_cycles < SH4_TIMESLICE / 2;
+}
+
+// The block is compiled from the main loop dispatcher through the default ngen_FailedToFindBlock
+// and the code generator is reentrant
+#if HOST_CPU == CPU_X64 && FEAT_SHREC == DYNAREC_JIT && !defined(TARGET_UWP)
+#define ASYNC_COMPILE
+
+//
+// Compiles new blocks on a background thread.
+// The emulation thread interprets the code until the block is ready.
+//
+class AsyncCompiler
+{
+public:
+	// Called when no block is found at pc.
+	// Returns false if the block must be compiled synchronously.
+	bool run(u32 pc)
+	{
+		if (resultsReady)
+			drain();
+		if (pending.count(pc) == 0)
+		{
+			if (!canCompile(pc))
+				return false;
+			if (bm_GetBlock(pc) != nullptr)
+				// just installed
+				return true;
+			std::lock_guard<std::mutex> _(mutex);
+			if (!thread.joinable())
+			{
+				stopping = false;
+				thread = std::thread(&AsyncCompiler::workerLoop, this);
+			}
+			// Pages past the window are considered unprotected
+			u32 unprotectedPages = ~0u << WindowPages;
+			for (u32 i = 0; i < WindowPages; i++)
+				if (!bm_IsRamPageProtected((pc & ~PAGE_MASK) + i * PAGE_SIZE))
+					unprotectedPages |= 1u << i;
+			requests.push_back({ pc, fpscr, unprotectedPages });
+			pending.insert(pc);
+			cond.notify_one();
+		}
+		interpret();
+
+		return true;
+	}
+
+	// Discards all pending and compiled blocks and waits for the worker to be idle
+	void cancel()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		generation++;
+		requests.clear();
+		for (const Result& result : results)
+			delete result.block;
+		results.clear();
+		resultsReady = false;
+		idleCond.wait(lock, [this]() { return !busy; });
+		pending.clear();
+		syncBlocks.clear();
+	}
+
+	~AsyncCompiler() {
+		term();
+	}
+
+	void term()
+	{
+		cancel();
+		{
+			std::lock_guard<std::mutex> _(mutex);
+			stopping = true;
+			cond.notify_one();
+		}
+		if (thread.joinable())
+			thread.join();
+	}
+
+private:
+	struct Request
+	{
+		u32 pc;
+		fpscr_t fpuConfig;
+		// Snapshot of the unprotected flags of the pages in the window
+		u32 unprotectedPages;
+	};
+	struct Result
+	{
+		u32 pc;
+		RuntimeBlockInfo *block;	// null if the compilation failed
+		u32 codeAddr;
+		std::vector<u8> guestCode;	// guest memory the block was compiled from
+	};
+
+	// Pages copied before decoding, starting at the page of the block.
+	// Superblocks can extend up to the second next page.
+	static constexpr u32 WindowPages = 3;
+	static constexpr u32 ChunkSize = 128 * 1024;
+	// The x64 main loop writes its unwind info at the top of the code cache
+	static constexpr u32 UnwindInfoSize = 64 * 1024;
+
+	bool canCompile(u32 pc)
+	{
+		return config::DynarecAsyncCompile
+			// Block timing isn't deterministic
+			&& !config::GGPOEnable
+			&& !mmu_enabled()
+			&& (pc & 1) == 0
+			&& sr.FD == 0
+			&& GetMemPtr(pc, 2) != nullptr
+			// These addresses reset the code cache (see rdv_CompilePC)
+			&& pc != 0x8c0000e0 && (pc & 0xFFFFFF) != 0x08300 && (pc & 0xFFFFFF) != 0x10000
+			&& syncBlocks.count(pc) == 0;
+	}
+
+	// Runs the interpreter until the next branch or the end of the time slice
+	void interpret()
+	{
+		try {
+			for (;;)
+			{
+				u32 pc = next_pc;
+				u16 op = IReadMem16(pc);
+				next_pc += 2;
+				if (sr.FD == 1 && OpDesc[op]->IsFloatingPoint())
+					RaiseFPUDisableException();
+				OpPtr[op](op);
+				// Same as a compiled block
+				Sh4cntx.cycle_counter--;
+				if (OpDesc[op]->SetSR())
+				{
+					UpdateINTC();
+					break;
+				}
+				if (OpDesc[op]->SetPC() || next_pc != pc + 2 || Sh4cntx.cycle_counter <= 0)
+					break;
+			}
+		} catch (const SH4ThrownException& ex) {
+			Do_Exception(ex.epc, ex.expEvn, ex.callVect);
+		}
+	}
+
+	void drain()
+	{
+		std::vector<Result> ready;
+		{
+			std::lock_guard<std::mutex> _(mutex);
+			ready.swap(results);
+			resultsReady = false;
+		}
+		for (Result& result : ready)
+			install(result);
+	}
+
+	void install(Result& result)
+	{
+		pending.erase(result.pc);
+		RuntimeBlockInfo *block = result.block;
+		if (block == nullptr)
+		{
+			syncBlocks.insert(result.pc);
+			return;
+		}
+		// The guest code might have been modified during the compilation
+		bool valid = !mmu_enabled()
+				&& bm_GetBlock(block->addr) == nullptr
+				&& memcmp(GetMemPtr(result.codeAddr, result.guestCode.size()), &result.guestCode[0], result.guestCode.size()) == 0;
+		if (valid && block->read_only)
+		{
+			if (block->CanBeProtected())
+				block->Protect();
+			else
+				valid = false;
+		}
+		if (!valid)
+		{
+			syncBlocks.insert(result.pc);
+			delete block;
+			return;
+		}
+		if (!block->cached)
+			bc_Store(block);
+		bm_AddBlock(block);
+		bench::stats.sh4BlocksCompiled++;
+	}
+
+	void workerLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			cond.wait(lock, [this]() { return stopping || !requests.empty(); });
+			if (stopping)
+				break;
+			Request request = requests.front();
+			requests.pop_front();
+			u32 gen = generation;
+			busy = true;
+			lock.unlock();
+
+			Result result = compile(request, gen);
+
+			lock.lock();
+			busy = false;
+			if (gen == generation)
+			{
+				results.push_back(std::move(result));
+				resultsReady = true;
+			}
+			else
+			{
+				delete result.block;
+			}
+			idleCond.notify_all();
+		}
+	}
+
+	Result compile(const Request& request, u32 gen)
+	{
+		Result result { request.pc, nullptr };
+		// Copy the guest code before decoding it so that writes during the compilation are detected
+		const u32 windowAddr = request.pc & ~PAGE_MASK;
+		const u32 windowSize = std::min(WindowPages * PAGE_SIZE, RAM_SIZE - (windowAddr & RAM_MASK));
+		const u8 *ptr = GetMemPtr(windowAddr, windowSize);
+		if (ptr == nullptr)
+			return result;
+		std::vector<u8> window(ptr, ptr + windowSize);
+
+		RuntimeBlockInfo *block = ngen_AllocateBlock();
+		if (!block->SetupAsync(request.pc, request.fpuConfig, request.unprotectedPages) || !reserveCodeSpace(gen))
+		{
+			delete block;
+			return result;
+		}
+		block->staging_runs = 100;
+		ngen_Compile(block, !block->read_only, false, canBeSuperblock(block), true);
+		if (block->code == nullptr)
+		{
+			delete block;
+			return result;
+		}
+		u32 start = block->addr;
+		u32 end = block->addr + block->sh4_code_size;
+		if (block->read_only)
+		{
+			// Constant memory reads in the same pages have been propagated
+			start &= ~PAGE_MASK;
+			end = (end + PAGE_MASK) & ~PAGE_MASK;
+		}
+		// The decoder read the guest memory directly so it must be unchanged
+		if (end - windowAddr > windowSize
+				|| memcmp(ptr + (start - windowAddr), &window[start - windowAddr], end - start) != 0)
+		{
+			delete block;
+			return result;
+		}
+		result.codeAddr = start;
+		result.guestCode.assign(window.begin() + (start - windowAddr), window.begin() + (end - windowAddr));
+		result.block = block;
+
+		return result;
+	}
+
+	// Reserves a code cache chunk for the worker thread if needed
+	bool reserveCodeSpace(u32 gen)
+	{
+		if (emit_ptr != nullptr && chunkGeneration == gen && emit_FreeSpace() >= 16 * 1024)
+			return true;
+		std::lock_guard<std::mutex> _(codeCacheMutex);
+		u32 top = std::min(TopAddr, CODE_SIZE - UnwindInfoSize);
+		// Leave some room to the emulation thread
+		if (top < LastAddr + ChunkSize + 64 * 1024)
+			return false;
+		TopAddr = top - ChunkSize;
+		emit_ptr = (u32 *)&CodeCache[TopAddr];
+		emit_ptr_limit = (u32 *)&CodeCache[top];
+		chunkGeneration = gen;
+
+		return true;
+	}
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::condition_variable idleCond;
+	std::deque<Request> requests;
+	std::vector<Result> results;
+	std::atomic<bool> resultsReady { false };
+	u32 generation = 0;
+	bool busy = false;
+	bool stopping = false;
+	// Emulation thread only
+	std::unordered_set<u32> pending;
+	std::unordered_set<u32> syncBlocks;
+	// Worker thread only
+	u32 chunkGeneration = 0;
+};
+static AsyncCompiler asyncCompiler;
+#endif
+
 static void clear_temp_cache(bool full)
 {
 	//printf("recSh4:Temp Code Cache clear at %08X\n", curr_pc);
@@ -57,9 +384,14 @@ static void clear_temp_cache(bool full)
 
 static void recSh4_ClearCache()
 {
+#ifdef ASYNC_COMPILE
+	asyncCompiler.cancel();
+#endif
 	INFO_LOG(DYNAREC, "recSh4:Dynarec Cache clear at %08X free space %d", next_pc, emit_FreeSpace());
 	LastAddr = 0;
+	TopAddr = CODE_SIZE;
 	bm_ResetCache();
+	bench::stats.sh4CacheFlushes++;
 	smc_hotspots.clear();
 	clear_temp_cache(true);
 }
@@ -90,7 +422,7 @@ u32 emit_FreeSpace()
 	if (emit_ptr)
 		return (emit_ptr_limit - emit_ptr) * sizeof(u32);
 	else
-		return CODE_SIZE - LastAddr;
+		return TopAddr - LastAddr;
 }
 
 void AnalyseBlock(RuntimeBlockInfo* blk);
@@ -117,13 +449,13 @@ const char* RuntimeBlockInfo::hash()
 		hash = XXH32_digest(state);
 		XXH32_freeState(state);
 	}
-	static char block_hash[20];
+	static thread_local char block_hash[20];
 	sprintf(block_hash, ">:1:%02X:%08X", this->guest_opcodes, hash);
 
 	return block_hash;
 }
 
-bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
+void RuntimeBlockInfo::Init(u32 rpc, fpscr_t rfpu_cfg)
 {
 	staging_runs=addr=lookups=runs=host_code_size=0;
 	guest_cycles=guest_opcodes=host_opcodes=0;
@@ -131,13 +463,27 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	pBranchBlock=pNextBlock=0;
 	code=0;
 	has_jcond=false;
+	returnSlot = {};
 	BranchBlock = NullAddress;
 	NextBlock = NullAddress;
 	BlockType = BET_SCL_Intr;
 	has_fpu_op = false;
 	temp_block = false;
-	
+	blockcheck_failures = 0;
+	cached = false;
+	superblock = false;
+	merged_blocks = 0;
+
 	vaddr = rpc;
+	fpu_cfg = rfpu_cfg;
+	oplist.clear();
+}
+
+bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg, bool superblock)
+{
+	Init(rpc, rfpu_cfg);
+	this->superblock = superblock;
+	
 	if (mmu_enabled())
 	{
 		u32 rv = mmu_instruction_translation(vaddr, addr);
@@ -157,12 +503,16 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	{
 		addr = vaddr;
 	}
-	fpu_cfg=rfpu_cfg;
-	
-	oplist.clear();
+
+	if (!superblock && !mmu_enabled() && bc_Lookup(this, sr.FD == 1))
+	{
+		SetProtectedFlags();
+		cached = true;
+		return true;
+	}
 
 	try {
-		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2))
+		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2, sr.FD == 1))
 			return false;
 	}
 	catch (const SH4ThrownException& ex) {
@@ -171,6 +521,35 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	}
 	SetProtectedFlags();
 
+	AnalyseBlock(this);
+	bc_Store(this);
+
+	return true;
+}
+
+bool RuntimeBlockInfo::SetupAsync(u32 rpc, fpscr_t rfpu_cfg, u32 unprotectedMask)
+{
+	Init(rpc, rfpu_cfg);
+	addr = vaddr;
+
+	if (bc_Lookup(this, false, &unprotectedMask))
+	{
+		read_only = CanBeProtected(unprotectedMask);
+		cached = true;
+		return true;
+	}
+
+	try {
+		// Blocks needing the FPU disabled exception are never compiled asynchronously
+		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2, false))
+			return false;
+	} catch (...) {
+		// Let the emulation thread compile it and handle the error
+		return false;
+	}
+	// The pages will be locked when the block is added, if they are still protected
+	read_only = CanBeProtected(unprotectedMask);
+
 	AnalyseBlock(this);
 
 	return true;
@@ -180,8 +559,14 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 {
 	u32 pc=next_pc;
 
+	std::unique_lock<std::mutex> lock(codeCacheMutex);
 	if (emit_FreeSpace()<16*1024 || pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
+	{
+		// Waits for the background compiler, which may need the lock
+		lock.unlock();
 		recSh4_ClearCache();
+		lock.lock();
+	}
 
 	RuntimeBlockInfo* rbi = ngen_AllocateBlock();
 
@@ -204,10 +589,12 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 	bool do_opts = !rbi->temp_block;
 	rbi->staging_runs=do_opts?100:-100;
 	bool block_check = !rbi->read_only;
-	ngen_Compile(rbi, block_check, (pc & 0xFFFFFF) == 0x08300 || (pc & 0xFFFFFF) == 0x10000, false, do_opts);
+	bool reset = (pc & 0xFFFFFF) == 0x08300 || (pc & 0xFFFFFF) == 0x10000;
+	ngen_Compile(rbi, block_check, reset, !reset && canBeSuperblock(rbi), do_opts);
 	verify(rbi->code!=0);
 
 	bm_AddBlock(rbi);
+	bench::stats.sh4BlocksCompiled++;
 
 	if (emit_ptr != NULL)
 	{
@@ -219,6 +606,38 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 	return rbi->code;
 }
 
+void DYNACALL rdv_CompileSuperblock(u32 pc)
+{
+	RuntimeBlockInfoPtr block = bm_GetBlock(pc);
+	if (!block)
+		return;
+	// Try again later if the superblock can't be compiled now.
+	// The counter is decremented on each run and would wrap around otherwise.
+	block->staging_runs = SUPERBLOCK_BACKOFF_RUNS;
+	if (block->superblock || mmu_enabled() || sr.FD == 1)
+		return;
+
+	std::lock_guard<std::mutex> _(codeCacheMutex);
+	// The calling block must not be overwritten, so the cache can't be cleared here
+	if (emit_FreeSpace() < 16 * 1024)
+		return;
+	RuntimeBlockInfo* rbi = ngen_AllocateBlock();
+	if (!rbi->Setup(pc, block->fpu_cfg, true))
+	{
+		delete rbi;
+		return;
+	}
+	rbi->blockcheck_failures = block->blockcheck_failures;
+	rbi->staging_runs = -100;
+	ngen_Compile(rbi, !rbi->read_only, false, false, true);
+	verify(rbi->code != nullptr);
+	DEBUG_LOG(DYNAREC, "Superblock %08x: %d blocks, %d ops", rbi->addr, rbi->merged_blocks + 1, rbi->guest_opcodes);
+
+	bm_DiscardBlock(block.get());
+	bm_AddBlock(rbi);
+	bench::stats.sh4Superblocks++;
+}
+
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc()
 {
 	return rdv_FailedToFindBlock(next_pc);
@@ -237,6 +656,10 @@ DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock(u32 pc)
 }
 
 static void ngen_FailedToFindBlock_internal() {
+#ifdef ASYNC_COMPILE
+	if (asyncCompiler.run(Sh4cntx.pc))
+		return;
+#endif
 	rdv_FailedToFindBlock(Sh4cntx.pc);
 }
 
@@ -419,11 +842,16 @@ static void recSh4_Init()
 	TempCodeCache = CodeCache + CODE_SIZE;
 	ngen_init();
 	bm_ResetCache();
+	bc_Init();
 }
 
 static void recSh4_Term()
 {
 	INFO_LOG(DYNAREC, "recSh4 Term");
+#ifdef ASYNC_COMPILE
+	asyncCompiler.term();
+#endif
+	bc_Term();
 	bm_Term();
 	sh4Interp.Term();
 }
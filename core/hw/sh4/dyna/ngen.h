@@ -76,6 +76,9 @@ DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 addr);
 DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures);
 //Finds or compiles code @pc
 DynarecCodeEntryPtr rdv_FindOrCompile();
+//Called by a block compiled with staging when its run counter expires, before executing it.
+//Replaces the block by a superblock. The calling block must then exit without changing next_pc.
+void DYNACALL rdv_CompileSuperblock(u32 pc);
 
 //code -> pointer to code of block, dpc -> if dynamic block, pc. if cond, 0 for next, 1 for branch
 void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc);
@@ -88,6 +91,7 @@ u32 DYNACALL rdv_DoInterrupts_pc(u32 pc);
 void ngen_init();
 
 //Called to compile a block
+//If staging is set, the block should decrement block->staging_runs on entry and call rdv_CompileSuperblock when it reaches 0
 void ngen_Compile(RuntimeBlockInfo* block, bool smc_checks, bool reset, bool staging, bool optimise);
 
 //Called when blocks are reset
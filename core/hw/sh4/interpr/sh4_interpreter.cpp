@@ -11,7 +11,13 @@
 #include "hw/sh4/sh4_mem.h"
 #include "../sh4_sched.h"
 #include "../sh4_cache.h"
+#include "../modules/mmu.h"
+#include "sh4_opcodes.h"
 #include "debug/gdb_server.h"
+#include "profiler/bench.h"
+#if FEAT_SHREC != DYNAREC_NONE
+#include "../dyna/blockmanager.h"
+#endif
 
 #define CPU_RATIO      (8)
 
@@ -34,6 +40,295 @@ static u16 ReadNexOp()
 	return IReadMem16(addr);
 }
 
+//
+// Pre-decoded block cache
+//
+// Straight-line code is decoded once into an array of DecodedOp with the handler and operands
+// resolved, and executed with threaded dispatch. A block ends after a branch or at a page boundary.
+// The RAM pages holding blocks are write-protected by the block manager. If a page can't be
+// protected, the block opcodes are compared with memory before each run.
+//
+enum DecodedKind : u8
+{
+	DK_Generic,
+	DK_Fpu,
+	DK_Mov,
+	DK_MovImm,
+	DK_Add,
+	DK_AddImm,
+	DK_MovlLoad,
+	DK_MovlStore,
+	DK_MovlPcLoad,
+	DK_CmpEq,
+	DK_Tst,
+	DK_Dt,
+	DK_Bt,
+	DK_Bf,
+	DK_End,
+};
+
+struct DecodedOp
+{
+	OpCallFP *handler;
+	u32 imm;	// m register, immediate value, load address or branch target
+	u16 op;
+	u8 kind;
+	u8 n;
+};
+
+struct DecodedBlock
+{
+	u32 addr;
+	u32 start;	// index of the first op in opArena
+	u32 pageGen;
+	u16 page;
+	u16 count;
+	bool checked;
+};
+
+constexpr u32 BLOCK_TABLE_SIZE = 32768;
+constexpr u32 ARENA_SIZE = 256 * 1024;
+constexpr u32 MAX_BLOCK_OPS = 64;
+// pseudo-page of the boot rom, never invalidated
+constexpr u32 ROM_PAGE = RAM_SIZE_MAX / PAGE_SIZE;
+
+static DecodedBlock blockTable[BLOCK_TABLE_SIZE];
+static DecodedOp opArena[ARENA_SIZE];
+static u32 arenaUsed;
+static u32 pageGen[ROM_PAGE + 1];
+
+static void resetBlockCache()
+{
+	for (DecodedBlock& block : blockTable)
+		block.addr = 1;		// never matches an aligned pc
+	arenaUsed = 0;
+}
+
+#if FEAT_SHREC != DYNAREC_NONE
+// Called by the block manager when a protected page is written to
+static void invalidateCodePage(u32 addr)
+{
+	pageGen[(addr & RAM_MASK) / PAGE_SIZE]++;
+}
+#endif
+
+static void decodeOp(DecodedOp& dop, u16 op, u32 pc)
+{
+	dop.handler = OpPtr[op];
+	dop.op = op;
+	dop.n = GetN(op);
+	dop.imm = GetM(op);
+
+	if (OpDesc[op]->IsFloatingPoint())
+		dop.kind = DK_Fpu;
+	else if (dop.handler == i0110_nnnn_mmmm_0011)
+		dop.kind = DK_Mov;
+	else if (dop.handler == i1110_nnnn_iiii_iiii)
+	{
+		dop.kind = DK_MovImm;
+		dop.imm = (u32)(s32)GetSImm8(op);
+	}
+	else if (dop.handler == i0011_nnnn_mmmm_1100)
+		dop.kind = DK_Add;
+	else if (dop.handler == i0111_nnnn_iiii_iiii)
+	{
+		dop.kind = DK_AddImm;
+		dop.imm = (u32)(s32)GetSImm8(op);
+	}
+	else if (dop.handler == i0110_nnnn_mmmm_0010)
+		dop.kind = DK_MovlLoad;
+	else if (dop.handler == i0010_nnnn_mmmm_0010)
+		dop.kind = DK_MovlStore;
+	else if (dop.handler == i1101_nnnn_iiii_iiii)
+	{
+		dop.kind = DK_MovlPcLoad;
+		dop.imm = (GetImm8(op) << 2) + ((pc + 4) & 0xFFFFFFFC);
+	}
+	else if (dop.handler == i0011_nnnn_mmmm_0000)
+		dop.kind = DK_CmpEq;
+	else if (dop.handler == i0010_nnnn_mmmm_1000)
+		dop.kind = DK_Tst;
+	else if (dop.handler == i0100_nnnn_0001_0000)
+		dop.kind = DK_Dt;
+	else if (dop.handler == i1000_1001_iiii_iiii || dop.handler == i1000_1011_iiii_iiii)
+	{
+		dop.kind = dop.handler == i1000_1001_iiii_iiii ? DK_Bt : DK_Bf;
+		dop.imm = GetSImm8(op) * 2 + 4 + pc;
+	}
+	else
+		dop.kind = DK_Generic;
+}
+
+static const DecodedBlock *decodeBlock(DecodedBlock& block, u32 pc)
+{
+	u32 page;
+	bool checked;
+	if (IsOnRam(pc))
+	{
+		page = (pc & RAM_MASK) / PAGE_SIZE;
+#if FEAT_SHREC != DYNAREC_NONE
+		// Like dynarec blocks, don't protect the bios/IP.BIN area
+		checked = (pc & 0x1FFF0000) == 0x0c000000 || !bm_ProtectCodePage(pc);
+#else
+		checked = true;
+#endif
+	}
+	else if ((pc >> 29) != 7 && (pc & 0x1FFFFFFF) < 0x00200000)
+	{
+		page = ROM_PAGE;
+		checked = false;
+	}
+	else
+	{
+		return nullptr;
+	}
+	if (arenaUsed + MAX_BLOCK_OPS + 1 > ARENA_SIZE)
+	{
+		resetBlockCache();
+		bench::stats.sh4CacheFlushes++;
+	}
+
+	DecodedOp *dop = &opArena[arenaUsed];
+	u32 addr = pc;
+	u32 count = 0;
+	for (;;)
+	{
+		u16 op = IReadMem16(addr);
+		decodeOp(dop[count++], op, addr);
+		addr += 2;
+		if (OpDesc[op]->SetPC() || count == MAX_BLOCK_OPS || (addr & PAGE_MASK) == 0)
+			break;
+	}
+	dop[count].kind = DK_End;
+
+	block.addr = pc;
+	block.start = arenaUsed;
+	block.page = page;
+	block.pageGen = pageGen[page];
+	block.count = count;
+	block.checked = checked;
+	arenaUsed += count + 1;
+
+	return &block;
+}
+
+static bool blockCodeMatches(const DecodedBlock& block)
+{
+	const u16 *code = (const u16 *)GetMemPtr(block.addr, block.count * 2);
+	const DecodedOp *dop = &opArena[block.start];
+	for (u32 i = 0; i < block.count; i++)
+		if (code[i] != dop[i].op)
+			return false;
+	return true;
+}
+
+static const DecodedBlock *getBlock(u32 pc)
+{
+#ifdef STRICT_MODE
+	// instruction fetches go through the emulated i-cache
+	return nullptr;
+#else
+	if (mmu_enabled() || (pc & 1) != 0)
+		return nullptr;
+	DecodedBlock& block = blockTable[(pc >> 1) & (BLOCK_TABLE_SIZE - 1)];
+	if (block.addr == pc)
+	{
+		if (block.checked ? blockCodeMatches(block) : block.pageGen == pageGen[block.page])
+			return &block;
+	}
+	return decodeBlock(block, pc);
+#endif
+}
+
+static void executeBlock(const DecodedOp *dop)
+{
+#ifdef __GNUC__
+	// threaded dispatch
+	static const void * const labels[] = {
+		&&L_Generic, &&L_Fpu, &&L_Mov, &&L_MovImm, &&L_Add, &&L_AddImm, &&L_MovlLoad, &&L_MovlStore,
+		&&L_MovlPcLoad, &&L_CmpEq, &&L_Tst, &&L_Dt, &&L_Bt, &&L_Bf, &&L_End
+	};
+#define OP(kind) L_##kind:
+#define NEXT() p_sh4rcb->cntx.cycle_counter -= CPU_RATIO; goto *labels[(++dop)->kind]
+	goto *labels[dop->kind];
+#else
+#define OP(kind) case DK_##kind:
+#define NEXT() p_sh4rcb->cntx.cycle_counter -= CPU_RATIO; dop++; continue
+	for (;;)
+	{
+		switch (dop->kind)
+		{
+#endif
+	OP(Generic)
+		next_pc += 2;
+		dop->handler(dop->op);
+		NEXT();
+	OP(Fpu)
+		next_pc += 2;
+		if (sr.FD == 1)
+			RaiseFPUDisableException();
+		dop->handler(dop->op);
+		NEXT();
+	OP(Mov)
+		next_pc += 2;
+		r[dop->n] = r[dop->imm];
+		NEXT();
+	OP(MovImm)
+		next_pc += 2;
+		r[dop->n] = dop->imm;
+		NEXT();
+	OP(Add)
+		next_pc += 2;
+		r[dop->n] += r[dop->imm];
+		NEXT();
+	OP(AddImm)
+		next_pc += 2;
+		r[dop->n] += dop->imm;
+		NEXT();
+	OP(MovlLoad)
+		next_pc += 2;
+		r[dop->n] = ReadMem32(r[dop->imm]);
+		NEXT();
+	OP(MovlStore)
+		next_pc += 2;
+		WriteMem32(r[dop->n], r[dop->imm]);
+		NEXT();
+	OP(MovlPcLoad)
+		next_pc += 2;
+		r[dop->n] = ReadMem32(dop->imm);
+		NEXT();
+	OP(CmpEq)
+		next_pc += 2;
+		sr.T = r[dop->n] == r[dop->imm];
+		NEXT();
+	OP(Tst)
+		next_pc += 2;
+		sr.T = (r[dop->n] & r[dop->imm]) == 0;
+		NEXT();
+	OP(Dt)
+		next_pc += 2;
+		sr.T = --r[dop->n] == 0;
+		NEXT();
+	OP(Bt)
+		next_pc += 2;
+		if (sr.T != 0)
+			next_pc = dop->imm;
+		NEXT();
+	OP(Bf)
+		next_pc += 2;
+		if (sr.T == 0)
+			next_pc = dop->imm;
+		NEXT();
+	OP(End)
+		return;
+#ifndef __GNUC__
+		}
+	}
+#endif
+#undef OP
+#undef NEXT
+}
+
 static void Sh4_int_Run()
 {
 	sh4_int_bCpuRun = true;
@@ -45,9 +340,12 @@ static void Sh4_int_Run()
 			try {
 				do
 				{
-					u32 op = ReadNexOp();
-
-					ExecuteOpcode(op);
+					// Like the dynarec, blocks run to completion and the cycle counter is only checked in between
+					const DecodedBlock *block = getBlock(next_pc);
+					if (block != nullptr)
+						executeBlock(&opArena[block->start]);
+					else
+						ExecuteOpcode(ReadNexOp());
 				} while (p_sh4rcb->cntx.cycle_counter > 0);
 				p_sh4rcb->cntx.cycle_counter += SH4_TIMESLICE;
 				UpdateSystem_INTC();
@@ -109,6 +407,7 @@ static void Sh4_int_Reset(bool hard)
 	UpdateFPSCR();
 	icache.Reset(hard);
 	ocache.Reset(hard);
+	resetBlockCache();
 	p_sh4rcb->cntx.cycle_counter = SH4_TIMESLICE;
 
 	INFO_LOG(INTERPRETER, "Sh4 Reset");
@@ -163,6 +462,7 @@ int UpdateSystem_INTC()
 }
 
 static void sh4_int_resetcache() {
+	resetBlockCache();
 }
 
 static void Sh4_int_Init()
@@ -170,6 +470,10 @@ static void Sh4_int_Init()
 	static_assert(sizeof(Sh4cntx) == 448, "Invalid Sh4Cntx size");
 
 	memset(&p_sh4rcb->cntx, 0, sizeof(p_sh4rcb->cntx));
+	resetBlockCache();
+#if FEAT_SHREC != DYNAREC_NONE
+	bm_SetCodePageHandler(invalidateCodePage);
+#endif
 }
 
 static void Sh4_int_Term()
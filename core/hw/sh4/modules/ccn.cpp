@@ -49,10 +49,13 @@ static void CCN_PTEH_write(u32 addr, u32 value)
 {
 	CCN_PTEH_type temp;
 	temp.reg_data = value & 0xfffffcff;
-#ifdef FAST_MMU
 	if (temp.ASID != CCN_PTEH.ASID)
+	{
+		mmuGeneration++;
+#ifdef FAST_MMU
 		mmuAddressLUTFlush(false);
 #endif
+	}
 
 	CCN_PTEH = temp;
 }
@@ -71,6 +74,8 @@ static void CCN_MMUCR_write(u32 addr, u32 value)
 
 		temp.TI = 0;
 	}
+	if (temp.SV != CCN_MMUCR.SV)
+		mmuGeneration++;
 	CCN_MMUCR = temp;
 
 	if (mmu_changed_state)
@@ -48,15 +48,33 @@ static TLB_LinkedEntry full_table[65536];
 static u32 full_table_size;
 static TLB_LinkedEntry *entry_buckets[NBUCKETS];
 
+// Direct-mapped cache of 4K page translations in front of the hash table.
+// Entries are tagged with the ASID so they survive ASID changes.
+struct TLB_CacheEntry {
+	u32 tag;	// 4K virtual page | TLB_CACHE_VALID | TLB_CACHE_SHARED | ASID
+	const TLB_Entry *entry;
+};
+constexpr u32 TLB_CACHE_VALID = 0x100;
+constexpr u32 TLB_CACHE_SHARED = 0x200;
+#define TLB_CACHE_SIZE 4096
+static TLB_CacheEntry tlb_cache[TLB_CACHE_SIZE];
+static bool tlb_cache_used;
+
+// mmuAddressLUT pages that were translated with the current ASID
+static u32 asid_pages[1024];
+static u32 asid_page_count;
+// 4 MB areas of the user space that have mmuAddressLUT entries
+static bool lut_dirty[0x80000 >> 10];
+
 static u16 bucket_index(u32 address, int size, u32 asid)
 {
 	return ((address >> 20) ^ (address >> 12) ^ (address | asid | (size << 8))) & (NBUCKETS - 1);
 }
 
-static void cache_entry(const TLB_Entry &entry)
+static const TLB_Entry *cache_entry(const TLB_Entry &entry)
 {
 	if (entry.Data.SZ0 == 0 && entry.Data.SZ1 == 0)
-		return;
+		return nullptr;
 	verify(full_table_size < ARRAY_SIZE(full_table));
 
 	full_table[full_table_size].entry = entry;
@@ -64,13 +82,101 @@ static void cache_entry(const TLB_Entry &entry)
 	u16 bucket = bucket_index(entry.Address.VPN << 10, entry.Data.SZ1 * 2 + entry.Data.SZ0, entry.Address.ASID);
 	full_table[full_table_size].next_entry = entry_buckets[bucket];
 	entry_buckets[bucket] = &full_table[full_table_size];
-	full_table_size++;
+
+	return &full_table[full_table_size++].entry;
 }
 
 static void flush_cache()
 {
 	full_table_size = 0;
 	memset(entry_buckets, 0, sizeof(entry_buckets));
+	if (tlb_cache_used)
+	{
+		memset(tlb_cache, 0, sizeof(tlb_cache));
+		tlb_cache_used = false;
+	}
+}
+
+static const TLB_Entry *tlb_cache_find(u32 address)
+{
+	const TLB_CacheEntry& cacheEntry = tlb_cache[(address >> 12) & (TLB_CACHE_SIZE - 1)];
+	u32 diff = cacheEntry.tag ^ ((address & ~0xfff) | TLB_CACHE_VALID | CCN_PTEH.ASID);
+	if ((diff & ~(TLB_CACHE_SHARED | 0xff)) != 0)
+		return nullptr;
+	// ASID mismatch
+	if ((diff & 0xff) != 0 && !(cacheEntry.tag & TLB_CACHE_SHARED))
+		return nullptr;
+
+	return cacheEntry.entry;
+}
+
+static void tlb_cache_add(u32 address, const TLB_Entry *entry)
+{
+	TLB_CacheEntry& cacheEntry = tlb_cache[(address >> 12) & (TLB_CACHE_SIZE - 1)];
+	cacheEntry.tag = (address & ~0xfff) | TLB_CACHE_VALID | entry->Address.ASID;
+	if (entry->Data.SH == 1)
+		cacheEntry.tag |= TLB_CACHE_SHARED;
+	cacheEntry.entry = entry;
+	tlb_cache_used = true;
+}
+
+// Adds the translation of a user space page to mmuAddressLUT
+static void lut_add(u32 address, const TLB_Entry *entry)
+{
+	u32 mask = mmu_mask[entry->Data.SZ1 * 2 + entry->Data.SZ0];
+	u32 paddr = ((entry->Data.PPN << 10) | (address & ~mask)) & ~0xfff;
+	// Access permissions aren't enforced on reads
+	u32 access = MMU_LUT_READ;
+	if ((paddr & 0x1C000000) == 0x1C000000)
+		// map 1C000000-1FFFFFFF to P4 memory-mapped registers
+		paddr |= 0xF0000000;
+	else
+		access |= MMU_LUT_EXEC;
+	if (entry->Data.PR & 1)
+		access |= MMU_LUT_WRITE;
+
+	u32 vpn = address >> 12;
+	mmuAddressLUT[vpn] = paddr | access;
+	lut_dirty[vpn >> 10] = true;
+	if (entry->Data.SH == 0)
+	{
+		if (asid_page_count < ARRAY_SIZE(asid_pages))
+			asid_pages[asid_page_count] = vpn;
+		asid_page_count++;
+	}
+}
+
+// Forgets the cached translations of the pages covered by a new TLB entry
+static void invalidate_pages(u32 address, u32 size)
+{
+	address &= ~0xfff;
+	for (u32 i = 0; i < std::max(size >> 12, 1u); i++, address += 0x1000)
+	{
+		TLB_CacheEntry& cacheEntry = tlb_cache[(address >> 12) & (TLB_CACHE_SIZE - 1)];
+		if ((cacheEntry.tag & ~0xfff) == address)
+			cacheEntry.tag = 0;
+		if ((address >> 31) == 0)
+			mmuAddressLUT[address >> 12] = 0;
+	}
+}
+
+void mmuAddressLUTFlush(bool full)
+{
+	if (full || asid_page_count > ARRAY_SIZE(asid_pages))
+	{
+		for (u32 i = 0; i < ARRAY_SIZE(lut_dirty); i++)
+			if (lut_dirty[i])
+			{
+				memset(&mmuAddressLUT[i << 10], 0, sizeof(u32) << 10);
+				lut_dirty[i] = false;
+			}
+	}
+	else
+	{
+		for (u32 i = 0; i < asid_page_count; i++)
+			mmuAddressLUT[asid_pages[i]] = 0;
+	}
+	asid_page_count = 0;
 }
 
 template<u32 size>
@@ -178,6 +284,7 @@ int main(int argc, char *argv[])
 
 bool UTLB_Sync(u32 entry)
 {
+	mmuGeneration++;
 	TLB_Entry& tlb_entry = UTLB[entry];
 	u32 sz = tlb_entry.Data.SZ1 * 2 + tlb_entry.Data.SZ0;
 
@@ -188,6 +295,8 @@ bool UTLB_Sync(u32 entry)
 	lru_mask = mmu_mask[sz];
 	lru_address = tlb_entry.Address.VPN << 10;
 
+	// the new entry may hide older ones
+	invalidate_pages(lru_address, ~mmu_mask[sz] + 1);
 	cache_entry(tlb_entry);
 
 	if (!mmu_enabled() && (tlb_entry.Address.VPN & (0xFC000000 >> 10)) == (0xE0000000 >> 10))
@@ -227,7 +336,10 @@ u32 mmu_full_lookup(u32 va, const TLB_Entry** tlb_entry_ret, u32& rv)
 	if (tlb_entry_ret == nullptr)
 		tlb_entry_ret = &localEntry;
 
-	if (find_entry(va, tlb_entry_ret))
+	*tlb_entry_ret = tlb_cache_find(va);
+	if (*tlb_entry_ret == nullptr && find_entry(va, tlb_entry_ret))
+		tlb_cache_add(va, *tlb_entry_ret);
+	if (*tlb_entry_ret != nullptr)
 	{
 		u32 mask = mmu_mask[(*tlb_entry_ret)->Data.SZ1 * 2 + (*tlb_entry_ret)->Data.SZ0];
 		rv = ((*tlb_entry_ret)->Data.PPN << 10) | (va & ~mask);
@@ -256,7 +368,11 @@ u32 mmu_full_lookup(u32 va, const TLB_Entry** tlb_entry_ret, u32& rv)
 
 		rv = (entry.Data.PPN << 10) | (va & ~mmu_mask[sz]);
 
-		cache_entry(entry);
+		invalidate_pages(lru_address, ~mmu_mask[sz] + 1);
+		const TLB_Entry *cachedEntry = cache_entry(entry);
+		if (cachedEntry != nullptr)
+			tlb_cache_add(va, cachedEntry);
+		mmuGeneration++;
 
 		return MMU_ERROR_NONE;
 	}
@@ -297,10 +413,26 @@ u32 mmu_data_translation(u32 va, u32& rv)
 		return MMU_ERROR_NONE;
 	}
 
-	u32 lookup = mmu_full_lookup(va, nullptr, rv);
-	if (lookup == MMU_ERROR_NONE && (rv & 0x1C000000) == 0x1C000000)
-		// map 1C000000-1FFFFFFF to P4 memory-mapped registers
-		rv |= 0xF0000000;
+	if ((va >> 31) == 0)
+	{
+		u32 lutEntry = mmuAddressLUT[va >> 12];
+		if (lutEntry & (translation_type == MMU_TT_DWRITE ? MMU_LUT_WRITE : MMU_LUT_READ))
+		{
+			rv = (lutEntry & ~0xfff) | (va & 0xfff);
+			return MMU_ERROR_NONE;
+		}
+	}
+
+	const TLB_Entry *entry;
+	u32 lookup = mmu_full_lookup(va, &entry, rv);
+	if (lookup == MMU_ERROR_NONE)
+	{
+		if ((rv & 0x1C000000) == 0x1C000000)
+			// map 1C000000-1FFFFFFF to P4 memory-mapped registers
+			rv |= 0xF0000000;
+		if ((va >> 31) == 0)
+			lut_add(va, entry);
+	}
 #ifdef TRACE_WINCE_SYSCALLS
 	if (unresolved_unicode_string != 0 && lookup == MMU_ERROR_NONE)
 	{
@@ -324,8 +456,36 @@ template u32 mmu_data_translation<MMU_TT_DWRITE, u16>(u32 va, u32& rv);
 template u32 mmu_data_translation<MMU_TT_DWRITE, u32>(u32 va, u32& rv);
 template u32 mmu_data_translation<MMU_TT_DWRITE, u64>(u32 va, u32& rv);
 
+u32 mmu_instruction_translation(u32 va, u32& rv)
+{
+	if (va & 1)
+		return MMU_ERROR_BADADDR;
+	if (fast_reg_lut[va >> 29] != 0)
+	{
+		rv = va;
+		return MMU_ERROR_NONE;
+	}
+	if ((va >> 31) == 0)
+	{
+		u32 lutEntry = mmuAddressLUT[va >> 12];
+		if (lutEntry & MMU_LUT_EXEC)
+		{
+			rv = (lutEntry & ~0xfff) | (va & 0xfff);
+			return MMU_ERROR_NONE;
+		}
+	}
+
+	const TLB_Entry *entry;
+	u32 lookup = mmu_full_lookup(va, &entry, rv);
+	if (lookup == MMU_ERROR_NONE && (va >> 31) == 0)
+		lut_add(va, entry);
+
+	return lookup;
+}
+
 void mmu_flush_table()
 {
+	mmuGeneration++;
 	lru_entry = nullptr;
 	flush_cache();
 	mmuAddressLUTFlush(true);
@@ -55,6 +55,7 @@ constexpr u32 ITLB_LRU_AND[4] =
 //sync mem mapping to mmu , suspend compiled blocks if needed.entry is a UTLB entry # , -1 is for full sync
 bool UTLB_Sync(u32 entry)
 {
+	mmuGeneration++;
 	printf_mmu("UTLB MEM remap %d : 0x%X to 0x%X : %d asid %d size %d", entry, UTLB[entry].Address.VPN << 10, UTLB[entry].Data.PPN << 10, UTLB[entry].Data.V,
 			UTLB[entry].Address.ASID, UTLB[entry].Data.SZ0 + UTLB[entry].Data.SZ1 * 2);
 	if (UTLB[entry].Data.V == 0)
@@ -503,6 +504,7 @@ retry_ITLB_Match:
 
 void mmu_set_state()
 {
+	mmuGeneration++;
 	if (CCN_MMUCR.AT == 1 && config::FullMMU)
 		NOTICE_LOG(SH4, "Enabling Full MMU support");
 
@@ -510,6 +512,7 @@ void mmu_set_state()
 }
 
 u32 mmuAddressLUT[0x100000];
+u32 mmuGeneration;
 
 void MMU_init()
 {
@@ -531,7 +534,7 @@ void MMU_init()
 #ifdef FAST_MMU
 	// pre-fill kernel memory
 	for (u32 vpn = ARRAY_SIZE(mmuAddressLUT) / 2; vpn < ARRAY_SIZE(mmuAddressLUT); vpn++)
-		mmuAddressLUT[vpn] = vpn << 12;
+		mmuAddressLUT[vpn] = (vpn << 12) | MMU_LUT_READ | MMU_LUT_WRITE | MMU_LUT_EXEC;
 #endif
 }
 
@@ -552,6 +555,7 @@ void MMU_term()
 void mmu_flush_table()
 {
 	//printf("MMU tables flushed\n");
+	mmuGeneration++;
 
 	ITLB[0].Data.V = 0;
 	ITLB[1].Data.V = 0;
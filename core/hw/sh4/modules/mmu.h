@@ -75,22 +75,7 @@ u32 mmu_instruction_lookup(u32 va, const TLB_Entry **entry, u32& rv);
 template<u32 translation_type>
 u32 mmu_full_SQ(u32 va, u32& rv);
 
-#ifdef FAST_MMU
-static inline u32 mmu_instruction_translation(u32 va, u32& rv)
-{
-	if (va & 1)
-		return MMU_ERROR_BADADDR;
-	if (fast_reg_lut[va >> 29] != 0)
-	{
-		rv = va;
-		return MMU_ERROR_NONE;
-	}
-
-	return mmu_full_lookup(va, nullptr, rv);
-}
-#else
 u32 mmu_instruction_translation(u32 va, u32& rv);
-#endif
 
 template<u32 translation_type, typename T>
 u32 mmu_data_translation(u32 va, u32& rv);
@@ -120,18 +105,17 @@ template<typename T> void DYNACALL mmu_WriteMem(u32 adr, T data);
 
 bool mmu_TranslateSQW(u32 adr, u32* out);
 
-// maps 4K virtual page number to physical address
+// maps 4K virtual page number to physical address | allowed accesses
+// Only valid for the current ASID. The kernel half is identity-mapped.
 extern u32 mmuAddressLUT[0x100000];
+constexpr u32 MMU_LUT_READ = 1;
+constexpr u32 MMU_LUT_WRITE = 2;
+constexpr u32 MMU_LUT_EXEC = 4;
+// Incremented each time the virtual to physical mappings may have changed
+extern u32 mmuGeneration;
 
-static inline void mmuAddressLUTFlush(bool full) {
-	if (full)
-		memset(mmuAddressLUT, 0, sizeof(mmuAddressLUT) / 2);	// flush user memory
-	else
-	{
-		constexpr u32 slotPages = (32 * 1024 * 1024) >> 12;
-		memset(mmuAddressLUT, 0, slotPages * sizeof(u32));		// flush slot 0
-	}
-}
+// Removes all the user space entries if full, otherwise only those that depend on the ASID
+void mmuAddressLUTFlush(bool full);
 
 static inline u32 mmuDynarecLookup(u32 vaddr, u32 write, u32 pc)
 {
@@ -151,10 +135,6 @@ static inline u32 mmuDynarecLookup(u32 vaddr, u32 write, u32 pc)
 		// not reached
 		return 0;
 	}
-#ifdef FAST_MMU
-	if (vaddr >> 31 == 0)
-		mmuAddressLUT[vaddr >> 12] = paddr & ~0xfff;
-#endif
 
 	return paddr;
 }
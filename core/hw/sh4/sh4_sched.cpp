@@ -1,8 +1,10 @@
 #include "types.h"
 #include "sh4_if.h"
 #include "sh4_sched.h"
+#include "profiler/bench.h"
 
 #include <algorithm>
+#include <iterator>
 #include <vector>
 
 //sh4 scheduler
@@ -25,46 +27,111 @@ u64 sh4_sched_ffb;
 std::vector<sched_list> sch_list;
 int sh4_sched_next_id = -1;
 
+// Ids of the scheduled callbacks, as a binary min-heap ordered by deadline then id
+static std::vector<int> sched_heap;
+
 static u32 sh4_sched_now();
 
-static u32 sh4_sched_remaining(const sched_list& sched, u32 reference)
+static bool sched_before(int id1, int id2)
 {
-	if (sched.end != -1)
-		return sched.end - reference;
-	else
-		return -1;
+	const sched_list& s1 = sch_list[id1];
+	const sched_list& s2 = sch_list[id2];
+	return s1.deadline < s2.deadline || (s1.deadline == s2.deadline && id1 < id2);
 }
 
-void sh4_sched_ffts()
+static void heap_set(size_t pos, int id)
 {
-	u32 diff = -1;
-	int slot = -1;
+	sched_heap[pos] = id;
+	sch_list[id].heapIndex = (int)pos;
+}
 
-	u32 now = sh4_sched_now();
-	for (const sched_list& sched : sch_list)
+static void heap_sift_up(size_t pos)
+{
+	int id = sched_heap[pos];
+	while (pos > 0)
 	{
-		u32 remaining = sh4_sched_remaining(sched, now);
-		if (remaining < diff)
-		{
-			slot = &sched - &sch_list[0];
-			diff = remaining;
-		}
+		size_t parent = (pos - 1) / 2;
+		if (!sched_before(id, sched_heap[parent]))
+			break;
+		heap_set(pos, sched_heap[parent]);
+		pos = parent;
+	}
+	heap_set(pos, id);
+}
+
+static void heap_sift_down(size_t pos)
+{
+	int id = sched_heap[pos];
+	for (;;)
+	{
+		size_t child = pos * 2 + 1;
+		if (child >= sched_heap.size())
+			break;
+		if (child + 1 < sched_heap.size() && sched_before(sched_heap[child + 1], sched_heap[child]))
+			child++;
+		if (!sched_before(sched_heap[child], id))
+			break;
+		heap_set(pos, sched_heap[child]);
+		pos = child;
+	}
+	heap_set(pos, id);
+}
+
+static void heap_remove(int id)
+{
+	int pos = sch_list[id].heapIndex;
+	if (pos == -1)
+		return;
+	sch_list[id].heapIndex = -1;
+	int last = sched_heap.back();
+	sched_heap.pop_back();
+	if (last == id)
+		return;
+	heap_set(pos, last);
+	heap_sift_up(pos);
+	heap_sift_down(sch_list[last].heapIndex);
+}
+
+// Inserts or moves a callback according to its deadline
+static void heap_update(int id)
+{
+	int pos = sch_list[id].heapIndex;
+	if (pos == -1)
+	{
+		sched_heap.push_back(id);
+		heap_sift_up(sched_heap.size() - 1);
+	}
+	else
+	{
+		heap_sift_up(pos);
+		heap_sift_down(sch_list[id].heapIndex);
 	}
+}
+
+void sh4_sched_ffts()
+{
+	u64 now = sh4_sched_now64();
 
 	sh4_sched_ffb -= Sh4cntx.sh4_sched_next;
 
-	sh4_sched_next_id = slot;
-	if (slot != -1)
-		Sh4cntx.sh4_sched_next = diff;
+	if (!sched_heap.empty())
+	{
+		sh4_sched_next_id = sched_heap[0];
+		u64 deadline = sch_list[sh4_sched_next_id].deadline;
+		Sh4cntx.sh4_sched_next = deadline > now ? (int)(deadline - now) : 0;
+	}
 	else
+	{
+		sh4_sched_next_id = -1;
 		Sh4cntx.sh4_sched_next = SH4_MAIN_CLOCK;
+	}
 
 	sh4_sched_ffb += Sh4cntx.sh4_sched_next;
 }
 
 int sh4_sched_register(int tag, sh4_sched_callback* ssc)
 {
-	sched_list t{ ssc, tag, -1, -1};
+	sched_list t{ ssc, tag, -1, -1, 0, -1 };
 	for (sched_list& sched : sch_list)
 		if (sched.cb == nullptr)
 		{
@@ -82,6 +149,7 @@ void sh4_sched_unregister(int id)
 	if (id == -1)
 		return;
 	verify(id < (int)sch_list.size());
+	heap_remove(id);
 	if (id == (int)sch_list.size() - 1)
 		sch_list.resize(sch_list.size() - 1);
 	else
@@ -111,6 +179,8 @@ u64 sh4_sched_now64()
 void sh4_sched_request(int id, int cycles)
 {
 	verify(cycles == -1 || (cycles >= 0 && cycles <= SH4_MAIN_CLOCK));
+	if (unlikely(bench::active))
+		bench::stats.schedRequests++;
 
 	sched_list& sched = sch_list[id];
 	sched.start = sh4_sched_now();
@@ -118,17 +188,35 @@ void sh4_sched_request(int id, int cycles)
 	if (cycles == -1)
 	{
 		sched.end = -1;
+		heap_remove(id);
 	}
 	else
 	{
 		sched.end = sched.start + cycles;
 		if (sched.end == -1)
 			sched.end++;
+		sched.deadline = sh4_sched_now64() + (u32)(sched.end - sched.start);
+		heap_update(id);
 	}
 
 	sh4_sched_ffts();
 }
 
+void sh4_sched_restore()
+{
+	sched_heap.clear();
+	const u64 now = sh4_sched_now64();
+	for (sched_list& sched : sch_list)
+	{
+		sched.heapIndex = -1;
+		if (sched.cb == nullptr || sched.end == -1)
+			continue;
+		// same as the time remaining before the 32-bit end
+		sched.deadline = now + (u32)(sched.end - (u32)now);
+		heap_update(&sched - &sch_list[0]);
+	}
+}
+
 /* Returns how much time has passed for this callback */
 static int sh4_sched_elapsed(sched_list& sched)
 {
@@ -142,17 +230,20 @@ static int sh4_sched_elapsed(sched_list& sched)
 		return -1;
 }
 
-static void handle_cb(sched_list& sched)
+static void handle_cb(int id)
 {
+	sched_list& sched = sch_list[id];
 	int remain = sched.end - sched.start;
 	int elapsd = sh4_sched_elapsed(sched);
 	int jitter = elapsd - remain;
 
 	sched.end = -1;
+	if (unlikely(bench::active))
+		bench::stats.schedCallbacks++;
 	int re_sch = sched.cb(sched.tag, remain, jitter);
 
 	if (re_sch > 0)
-		sh4_sched_request(&sched - &sch_list[0], std::max(0, re_sch - jitter));
+		sh4_sched_request(id, std::max(0, re_sch - jitter));
 }
 
 void sh4_sched_tick(int cycles)
@@ -160,15 +251,22 @@ void sh4_sched_tick(int cycles)
 	if (Sh4cntx.sh4_sched_next >= 0)
 		return;
 
-	u32 fztime = sh4_sched_now() - cycles;
-	if (sh4_sched_next_id != -1)
+	// Each expired callback fires once, in deadline order.
+	// Callbacks requested again for a time already past fire on the next tick.
+	const u64 now = sh4_sched_now64();
+	int due[64];
+	u32 dueCount = 0;
+	while (!sched_heap.empty() && sch_list[sched_heap[0]].deadline <= now && dueCount < std::size(due))
 	{
-		for (sched_list& sched : sch_list)
-		{
-			int remaining = sh4_sched_remaining(sched, fztime);
-			if (remaining >= 0 && remaining <= (int)cycles)
-				handle_cb(sched);
-		}
+		due[dueCount++] = sched_heap[0];
+		heap_remove(sched_heap[0]);
+	}
+	for (u32 i = 0; i < dueCount; i++)
+	{
+		const sched_list& sched = sch_list[due[i]];
+		// Skip the callbacks that have been cancelled or requested again by a previous one
+		if (sched.heapIndex == -1 && sched.end != -1)
+			handle_cb(due[i]);
 	}
 	sh4_sched_ffts();
 }
@@ -180,7 +278,11 @@ void sh4_sched_reset(bool hard)
 		sh4_sched_ffb = 0;
 		sh4_sched_next_id = -1;
 		for (sched_list& sched : sch_list)
+		{
 			sched.start = sched.end = -1;
+			sched.heapIndex = -1;
+		}
+		sched_heap.clear();
 		Sh4cntx.sh4_sched_next = 0;
 	}
 }
@@ -44,12 +44,19 @@ void sh4_sched_tick(int cycles);
 void sh4_sched_ffts();
 void sh4_sched_reset(bool hard);
 
+/*
+	Rebuild the scheduling queue after sch_list has been loaded from a savestate
+*/
+void sh4_sched_restore();
+
 struct sched_list
 {
 	sh4_sched_callback* cb;
 	int tag;
 	int start;
 	int end;
+	u64 deadline;	// 64-bit end
+	int heapIndex;	// position in the scheduling queue, -1 if not scheduled
 };
 
 #endif //SH4_SCHED_H
@@ -1,7 +1,36 @@
 #include "common.h"
 #include "stdclass.h"
+#include "cfg/option.h"
 
 #include <libchdr/chd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// An open CHD file. chd_read isn't thread safe so each thread needs its own.
+struct CHDHandle
+{
+	chd_file *chd = nullptr;
+	FILE *fp = nullptr;
+
+	chd_error open(const char *file)
+	{
+		fp = nowide::fopen(file, "rb");
+		if (fp == nullptr)
+			return CHDERR_FILE_NOT_FOUND;
+		return chd_open_file(fp, CHD_OPEN_READ, 0, &chd);
+	}
+
+	~CHDHandle()
+	{
+		if (chd)
+			chd_close(chd);
+		if (fp)
+			std::fclose(fp);
+	}
+};
 
 struct CHDDisc : Disc
 {
@@ -9,26 +38,62 @@ struct CHDDisc : Disc
 	static constexpr u32 CD_TRACK_PADDING = 4;
 	// lead out, lead in and pregap between 2 sessions of MIL-CDs
 	static constexpr u32 SESSION_GAP = 11400;
+	// reads of more sectors than this are decompressed on multiple threads
+	static constexpr u32 BULK_READ_SECTORS = 1024;
 
+	std::string path;
+	CHDHandle handle;
 	chd_file *chd = nullptr;
-	FILE *fp = nullptr;
-	u8* hunk_mem = nullptr;
-	u32 old_hunk = 0;
 
 	u32 hunkbytes = 0;
 	u32 sph = 0;
+	u32 hunkCount = 0;
 
 	void tryOpen(const char* file);
 
-	~CHDDisc()
-	{
-		delete[] hunk_mem;
+	// Copies the first len bytes of a frame of the image
+	bool readSector(u32 frame, u8 *dst, u32 len);
+	void ReadAhead(u32 FAD, u32 count) override;
 
-		if (chd)
-			chd_close(chd);
-		if (fp)
-			std::fclose(fp);
+	~CHDDisc() override
+	{
+		stopReadAhead();
 	}
+
+private:
+	struct CachedHunk
+	{
+		u32 index = ~0u;
+		u64 lastUse = 0;
+		std::vector<u8> data;
+	};
+
+	// Returns the cached copy of a hunk, or null. cacheMutex must be held.
+	CachedHunk *findHunk(u32 hunk);
+	// Adds a decompressed hunk to the cache, evicting the least recently used one
+	void addHunk(u32 hunk, const u8 *data);
+	void readAheadLoop();
+	void stopReadAhead();
+
+	// Decompressed hunks, least recently used ones are evicted first
+	std::vector<CachedHunk> cache;
+	std::unordered_map<u32, u32> cacheMap;
+	u64 useCounter = 0;
+	std::mutex cacheMutex;
+
+	// Decompression buffer of the main handle
+	std::vector<u8> hunkBuffer;
+	std::mutex chdMutex;
+
+	// Hunks [nextHunk, lastHunk] are decompressed by the read-ahead threads
+	std::vector<std::thread> readAheadThreads;
+	std::condition_variable readAheadCond;
+	u32 nextHunk = 1;
+	u32 lastHunk = 0;
+	u32 rangeStart = ~0u;
+	// last hunk read by the emulator
+	u32 readHunk = 0;
+	bool stopping = false;
 };
 
 struct CHDTrack : TrackFile
@@ -48,18 +113,8 @@ struct CHDTrack : TrackFile
 
 	bool Read(u32 FAD, u8* dst, SectorFormat* sector_type, u8* subcode, SubcodeFormat* subcode_type) override
 	{
-		u32 fad_offs = FAD + Offset;
-		u32 hunk=(fad_offs)/disc->sph;
-		if (disc->old_hunk!=hunk)
-		{
-			if (chd_read(disc->chd,hunk,disc->hunk_mem) != CHDERR_NONE)
-				return false;
-			disc->old_hunk = hunk;
-		}
-
-		u32 hunk_ofs = fad_offs%disc->sph;
-
-		memcpy(dst, disc->hunk_mem + hunk_ofs * (2352+96), fmt);
+		if (!disc->readSector(FAD + Offset, dst, fmt))
+			return false;
 
 		if (swap_bytes)
 		{
@@ -92,6 +147,143 @@ struct CHDTrack : TrackFile
 	}
 };
 
+CHDDisc::CachedHunk *CHDDisc::findHunk(u32 hunk)
+{
+	auto it = cacheMap.find(hunk);
+	if (it == cacheMap.end())
+		return nullptr;
+	CachedHunk& cached = cache[it->second];
+	cached.lastUse = ++useCounter;
+	return &cached;
+}
+
+void CHDDisc::addHunk(u32 hunk, const u8 *data)
+{
+	std::lock_guard<std::mutex> _(cacheMutex);
+	if (cacheMap.count(hunk) != 0)
+		return;
+	auto lru = std::min_element(cache.begin(), cache.end(), [](const CachedHunk& a, const CachedHunk& b) {
+		return a.lastUse < b.lastUse;
+	});
+	if (lru->index != ~0u)
+		cacheMap.erase(lru->index);
+	lru->index = hunk;
+	lru->lastUse = ++useCounter;
+	memcpy(lru->data.data(), data, hunkbytes);
+	cacheMap[hunk] = (u32)(lru - cache.begin());
+}
+
+bool CHDDisc::readSector(u32 frame, u8 *dst, u32 len)
+{
+	const u32 hunk = frame / sph;
+	const u32 offset = (frame % sph) * (2352 + 96);
+	{
+		std::lock_guard<std::mutex> _(cacheMutex);
+		if (hunk != readHunk)
+		{
+			readHunk = hunk;
+			// let the read-ahead threads continue
+			if (nextHunk <= lastHunk)
+				readAheadCond.notify_all();
+		}
+		CachedHunk *cached = findHunk(hunk);
+		if (cached != nullptr)
+		{
+			memcpy(dst, cached->data.data() + offset, len);
+			return true;
+		}
+	}
+	std::lock_guard<std::mutex> _(chdMutex);
+	if (chd_read(chd, hunk, hunkBuffer.data()) != CHDERR_NONE)
+		return false;
+	addHunk(hunk, hunkBuffer.data());
+	memcpy(dst, hunkBuffer.data() + offset, len);
+
+	return true;
+}
+
+void CHDDisc::ReadAhead(u32 FAD, u32 count)
+{
+	if (cache.size() < 2 || count == 0)
+		return;
+	// Map the FAD range to a hunk range
+	u32 first = ~0u;
+	u32 last = 0;
+	for (const Track& track : tracks)
+	{
+		u32 start = std::max(FAD, track.StartFAD);
+		u32 end = std::min(FAD + count - 1, track.EndFAD);
+		if (start > end)
+			continue;
+		s32 offset = ((CHDTrack *)track.file)->Offset;
+		first = std::min(first, (start + offset) / sph);
+		last = std::max(last, (end + offset) / sph);
+	}
+	if (first > last)
+		return;
+	last = std::min(last, hunkCount - 1);
+
+	std::lock_guard<std::mutex> _(cacheMutex);
+	if (first >= rangeStart && first <= lastHunk + 1)
+		// within or continuing the current read-ahead
+		lastHunk = std::max(lastHunk, last);
+	else
+	{
+		nextHunk = first;
+		lastHunk = last;
+		rangeStart = first;
+	}
+	size_t threadCount = 1;
+	if (count >= BULK_READ_SECTORS || config::FastGDRomLoad)
+		threadCount = std::max(std::min(std::thread::hardware_concurrency(), 5u), 2u) - 1;
+	while (readAheadThreads.size() < threadCount)
+		readAheadThreads.emplace_back(&CHDDisc::readAheadLoop, this);
+	readAheadCond.notify_all();
+}
+
+void CHDDisc::readAheadLoop()
+{
+	CHDHandle threadHandle;
+	if (threadHandle.open(path.c_str()) != CHDERR_NONE)
+	{
+		WARN_LOG(GDROM, "chd: read-ahead thread can't open %s", path.c_str());
+		return;
+	}
+	std::vector<u8> buffer(hunkbytes);
+
+	std::unique_lock<std::mutex> lock(cacheMutex);
+	while (!stopping)
+	{
+		// Don't get further ahead than half the cache
+		const u32 window = (u32)cache.size() / 2;
+		if (nextHunk > lastHunk || nextHunk > std::max(readHunk, rangeStart) + window)
+		{
+			readAheadCond.wait(lock);
+			continue;
+		}
+		const u32 hunk = nextHunk++;
+		if (cacheMap.count(hunk) != 0)
+			continue;
+		lock.unlock();
+		bool success = chd_read(threadHandle.chd, hunk, buffer.data()) == CHDERR_NONE;
+		if (success)
+			addHunk(hunk, buffer.data());
+		lock.lock();
+	}
+}
+
+void CHDDisc::stopReadAhead()
+{
+	{
+		std::lock_guard<std::mutex> _(cacheMutex);
+		stopping = true;
+		readAheadCond.notify_all();
+	}
+	for (std::thread& thread : readAheadThreads)
+		thread.join();
+	readAheadThreads.clear();
+}
+
 static u32 getSectorSize(const std::string& type)
 {
 	if (type == "AUDIO")
@@ -110,25 +302,27 @@ static u32 getSectorSize(const std::string& type)
 
 void CHDDisc::tryOpen(const char* file)
 {
-	fp = nowide::fopen(file, "rb");
-	if (fp == nullptr)
+	path = file;
+	chd_error err = handle.open(file);
+	if (handle.fp == nullptr)
 	{
 		WARN_LOG(COMMON, "Cannot open file '%s' errno %d", file, errno);
 		throw FlycastException(std::string("Cannot open CHD file ") + file);
 	}
-
-	chd_error err = chd_open_file(fp, CHD_OPEN_READ, 0, &chd);
-
 	if (err != CHDERR_NONE)
 		throw FlycastException(std::string("Invalid CHD file ") + file);
+	chd = handle.chd;
 
 	INFO_LOG(GDROM, "chd: parsing file %s", file);
 
 	const chd_header* head = chd_get_header(chd);
 
 	hunkbytes = head->hunkbytes;
-	hunk_mem = new u8[hunkbytes];
-	old_hunk=0xFFFFFFF;
+	hunkCount = head->totalhunks;
+	hunkBuffer.resize(hunkbytes);
+	cache.resize(std::max(1, (int)config::ChdHunkCacheSize));
+	for (CachedHunk& cached : cache)
+		cached.data.resize(hunkbytes);
 
 	sph = hunkbytes/(2352+96);
 
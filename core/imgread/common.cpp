@@ -3,6 +3,20 @@
 #include "cfg/option.h"
 #include "stdclass.h"
 
+#if defined(_WIN32) && !defined(TARGET_UWP)
+#include <windows.h>
+#include <io.h>
+#elif !defined(_WIN32) && !defined(__SWITCH__)
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#else
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
+#endif
+
 Disc* chd_parse(const char* file, std::vector<u8> *digest);
 Disc* gdi_parse(const char* file, std::vector<u8> *digest);
 Disc* cdi_parse(const char* file, std::vector<u8> *digest);
@@ -25,7 +39,7 @@ constexpr Disc* (*drivers[])(const char* path, std::vector<u8> *digest)
 
 u8 q_subchannel[96];
 
-static bool convertSector(u8* in_buff , u8* out_buff , int from , int to,int sector)
+static bool convertSector(const u8* in_buff , u8* out_buff , int from , int to,int sector)
 {
 	//get subchannel data, if any
 	if (from == 2448)
@@ -199,6 +213,12 @@ void libGDR_ReadSector(u8 *buff, u32 startSector, u32 sectorCount, u32 sectorSiz
 		disc->ReadSectors(startSector, sectorCount, buff, sectorSize);
 }
 
+void libGDR_ReadAhead(u32 startSector, u32 sectorCount)
+{
+	if (disc != nullptr)
+		disc->ReadAhead(startSector, sectorCount);
+}
+
 void libGDR_GetToc(u32* to, DiskArea area)
 {
 	memset(to, 0xFF, 102 * 4);
@@ -259,6 +279,8 @@ void Disc::ReadSectors(u32 FAD, u32 count, u8* dst, u32 fmt, LoadProgress *progr
 	SectorFormat secfmt;
 	SubcodeFormat subfmt;
 
+	if (count > 1)
+		ReadAhead(FAD, count);
 	for (u32 i = 1; i <= count; i++)
 	{
 		if (progress != nullptr)
@@ -268,28 +290,32 @@ void Disc::ReadSectors(u32 FAD, u32 count, u8* dst, u32 fmt, LoadProgress *progr
 			progress->label = "Loading...";
 			progress->progress = (float)i / count;
 		}
-		if (ReadSector(FAD,temp,&secfmt,q_subchannel,&subfmt))
+		// Use the sector data in place if possible
+		const u8 *sector = GetSector(FAD, &secfmt);
+		if (sector == nullptr && ReadSector(FAD,temp,&secfmt,q_subchannel,&subfmt))
+			sector = temp;
+		if (sector != nullptr)
 		{
 			//TODO: Proper sector conversions
 			if (secfmt==SECFMT_2352)
 			{
-				convertSector(temp,dst,2352,fmt,FAD);
+				convertSector(sector,dst,2352,fmt,FAD);
 			}
 			else if (fmt == 2048 && secfmt==SECFMT_2336_MODE2)
-				memcpy(dst,temp+8,2048);
+				memcpy(dst,sector+8,2048);
 			else if (fmt==2048 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
 			{
-				memcpy(dst,temp,2048);
+				memcpy(dst,sector,2048);
 			}
 			else if (fmt==2352 && (secfmt==SECFMT_2048_MODE1 || secfmt==SECFMT_2048_MODE2_FORM1 ))
 			{
 				INFO_LOG(GDROM, "GDR:fmt=2352;secfmt=2048");
-				memcpy(dst,temp,2048);
+				memcpy(dst,sector,2048);
 			}
 			else if (fmt==2048 && secfmt==SECFMT_2448_MODE2)
 			{
 				// Pier Solar and the Great Architects
-				convertSector(temp, dst, 2448, fmt, FAD);
+				convertSector(sector, dst, 2448, fmt, FAD);
 			}
 			else
 			{
@@ -318,3 +344,167 @@ u32 libGDR_GetDiscType()
 	else
 		return NullDriveDiscType;
 }
+
+RawTrackFile::RawTrackFile(FILE *file, u32 file_offs, u32 first_fad, u32 secfmt)
+{
+	verify(file != nullptr);
+	this->file = file;
+	this->offset = file_offs - first_fad * secfmt;
+	this->fmt = secfmt;
+	map();
+}
+
+RawTrackFile::~RawTrackFile()
+{
+#if defined(_WIN32) && !defined(TARGET_UWP)
+	if (mapping != nullptr)
+		UnmapViewOfFile(mapping);
+	if (mappingHandle != nullptr)
+		CloseHandle((HANDLE)mappingHandle);
+#elif !defined(_WIN32) && !defined(__SWITCH__)
+	if (mapping != nullptr)
+		munmap((void *)mapping, mappingSize);
+#endif
+	std::fclose(file);
+}
+
+// Reading a mapped file raises SIGBUS or an in-page exception instead of returning an error
+// if the storage fails or the file is truncated. Network file systems and removable media
+// are more likely to do that so only files on local fixed disks are mapped.
+static bool isLocalFile(FILE *file)
+{
+#if defined(_WIN32) && !defined(TARGET_UWP)
+	wchar_t path[MAX_PATH + 1];
+	HANDLE fileHandle = (HANDLE)_get_osfhandle(_fileno(file));
+	DWORD len = GetFinalPathNameByHandleW(fileHandle, path, MAX_PATH, VOLUME_NAME_DOS);
+	if (len == 0 || len > MAX_PATH)
+		return false;
+	// \\?\C:\... or \\?\UNC\server\share\...
+	std::wstring filePath(path, len);
+	if (filePath.compare(0, 4, L"\\\\?\\") == 0)
+		filePath = filePath.substr(4);
+	if (filePath.size() < 3 || filePath[1] != L':')
+		return false;
+	return GetDriveTypeW(filePath.substr(0, 3).c_str()) == DRIVE_FIXED;
+#elif defined(__linux__)
+	struct statfs fs;
+	if (fstatfs(fileno(file), &fs) != 0)
+		return false;
+	switch ((u32)fs.f_type)
+	{
+	case 0x6969:		// NFS
+	case 0x517b:		// SMB
+	case 0xff534d42:	// CIFS
+	case 0xfe534d42:	// SMB2
+	case 0x65735546:	// FUSE
+	case 0x4d44:		// FAT
+	case 0x2011bab0:	// exFAT
+	case 0x9660:		// ISO 9660
+	case 0x15013346:	// UDF
+		return false;
+	default:
+		return true;
+	}
+#elif !defined(_WIN32) && !defined(__SWITCH__)
+	struct statfs fs;
+	if (fstatfs(fileno(file), &fs) != 0 || (fs.f_flags & MNT_LOCAL) == 0)
+		return false;
+	return strcmp(fs.f_fstypename, "msdos") != 0 && strcmp(fs.f_fstypename, "exfat") != 0
+			&& strcmp(fs.f_fstypename, "cd9660") != 0 && strcmp(fs.f_fstypename, "udf") != 0;
+#else
+	return false;
+#endif
+}
+
+void RawTrackFile::map()
+{
+	size_t size = flycast::fsize(file);
+	// Don't exhaust the address space of 32-bit hosts
+	if (size == 0 || (sizeof(void *) < 8 && size > 64 * 1024 * 1024))
+		return;
+	if (!isLocalFile(file))
+		return;
+#if defined(_WIN32) && !defined(TARGET_UWP)
+	HANDLE fileHandle = (HANDLE)_get_osfhandle(_fileno(file));
+	HANDLE handle = CreateFileMapping(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (handle == nullptr)
+		return;
+	void *p = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+	if (p == nullptr)
+	{
+		CloseHandle(handle);
+		return;
+	}
+	mappingHandle = handle;
+#elif !defined(_WIN32) && !defined(__SWITCH__)
+	void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileno(file), 0);
+	if (p == MAP_FAILED)
+		return;
+#else
+	return;
+#endif
+	mapping = (const u8 *)p;
+	mappingSize = size;
+	DEBUG_LOG(GDROM, "Track file mapped: %zd bytes", size);
+}
+
+SectorFormat RawTrackFile::getSectorFormat() const
+{
+	//for now hackish
+	if (fmt==2352)
+		return SECFMT_2352;
+	else if (fmt==2048)
+		return SECFMT_2048_MODE2_FORM1;
+	else if (fmt==2336)
+		return SECFMT_2336_MODE2;
+	else if (fmt==2448)
+		return SECFMT_2448_MODE2;
+	verify(false);
+	return SECFMT_2352;
+}
+
+const u8 *RawTrackFile::GetSector(u32 FAD, SectorFormat *sector_type)
+{
+	if (mapping == nullptr)
+		return nullptr;
+	s64 pos = offset + (s64)FAD * fmt;
+	if (pos < 0 || pos + fmt > (s64)mappingSize)
+		return nullptr;
+	*sector_type = getSectorFormat();
+	return mapping + pos;
+}
+
+bool RawTrackFile::Read(u32 FAD, u8 *dst, SectorFormat *sector_type, u8 *subcode, SubcodeFormat *subcode_type)
+{
+	const u8 *sector = GetSector(FAD, sector_type);
+	if (sector != nullptr)
+	{
+		memcpy(dst, sector, fmt);
+		return true;
+	}
+	*sector_type = getSectorFormat();
+
+	std::fseek(file, offset + FAD * fmt, SEEK_SET);
+	if (std::fread(dst, 1, fmt, file) != fmt)
+	{
+		WARN_LOG(GDROM, "Failed or truncated GD-Rom read");
+		return false;
+	}
+	return true;
+}
+
+void RawTrackFile::ReadAhead(u32 FAD, u32 count)
+{
+#if !defined(_WIN32) && !defined(__SWITCH__)
+	if (mapping == nullptr)
+		return;
+	static const uintptr_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+	s64 start = std::max<s64>(offset + (s64)FAD * fmt, 0);
+	s64 end = std::min<s64>(offset + (s64)(FAD + count) * fmt, mappingSize);
+	if (start >= end)
+		return;
+	// Have the kernel fetch the range asynchronously instead of faulting on every page
+	uintptr_t addr = (uintptr_t)(mapping + start) & ~pageMask;
+	madvise((void *)addr, (uintptr_t)(mapping + end) - addr, MADV_WILLNEED);
+#endif
+}
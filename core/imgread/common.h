@@ -1,5 +1,6 @@
 #pragma once
 #include "types.h"
+#include <algorithm>
 #include <vector>
 
 #include "emulator.h"
@@ -74,6 +75,10 @@ struct Session
 struct TrackFile
 {
 	virtual bool Read(u32 FAD, u8 *dst, SectorFormat *sector_type, u8 *subcode, SubcodeFormat *subcode_type) = 0;
+	// Returns a pointer to the sector data if it can be accessed without copying, or null
+	virtual const u8 *GetSector(u32 FAD, SectorFormat *sector_type) { return nullptr; }
+	// Hints that sectors [FAD, FAD + count[ are about to be read
+	virtual void ReadAhead(u32 FAD, u32 count) { }
 	virtual ~TrackFile() = default;
 };
 
@@ -92,6 +97,13 @@ struct Track
 		else
 			return false;
 	}
+	const u8 *GetSector(u32 FAD, SectorFormat *sector_type)
+	{
+		if (FAD >= StartFAD && (FAD <= EndFAD || EndFAD == 0) && file != nullptr)
+			return file->GetSector(FAD, sector_type);
+		else
+			return nullptr;
+	}
 	void Destroy() {
 		delete file;
 		file = nullptr;
@@ -122,7 +134,33 @@ struct Disc
 		return false;
 	}
 
+	const u8 *GetSector(u32 FAD, SectorFormat *sector_type)
+	{
+		for (size_t i = tracks.size(); i-- > 0;)
+		{
+			const u8 *data = tracks[i].GetSector(FAD, sector_type);
+			if (data != nullptr)
+				return data;
+		}
+		return nullptr;
+	}
+
 	void ReadSectors(u32 FAD, u32 count, u8 *dst, u32 fmt, LoadProgress *progress = nullptr);
+	// Hints that sectors [FAD, FAD + count[ are about to be read
+	virtual void ReadAhead(u32 FAD, u32 count)
+	{
+		if (count == 0)
+			return;
+		for (Track& track : tracks)
+		{
+			u32 start = std::max(FAD, track.StartFAD);
+			u32 end = FAD + count - 1;
+			if (track.EndFAD != 0)
+				end = std::min(end, track.EndFAD);
+			if (start <= end && track.file != nullptr)
+				track.file->ReadAhead(start, end - start + 1);
+		}
+	}
 
 	virtual ~Disc() 
 	{
@@ -215,53 +253,31 @@ Disc* OpenDisc(const std::string& path, std::vector<u8> *digest = nullptr);
 
 struct RawTrackFile : TrackFile
 {
-	FILE *file;
-	s32 offset;
-	u32 fmt;
+	RawTrackFile(FILE *file, u32 file_offs, u32 first_fad, u32 secfmt);
+	~RawTrackFile() override;
 
-	RawTrackFile(FILE *file, u32 file_offs, u32 first_fad, u32 secfmt)
-	{
-		verify(file != nullptr);
-		this->file = file;
-		this->offset = file_offs - first_fad * secfmt;
-		this->fmt = secfmt;
-	}
-
-	bool Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type) override
-	{
-		//for now hackish
-		if (fmt==2352)
-			*sector_type=SECFMT_2352;
-		else if (fmt==2048)
-			*sector_type=SECFMT_2048_MODE2_FORM1;
-		else if (fmt==2336)
-			*sector_type=SECFMT_2336_MODE2;
-		else if (fmt==2448)
-			*sector_type=SECFMT_2448_MODE2;
-		else
-		{
-			verify(false);
-		}
+	bool Read(u32 FAD, u8 *dst, SectorFormat *sector_type, u8 *subcode, SubcodeFormat *subcode_type) override;
+	const u8 *GetSector(u32 FAD, SectorFormat *sector_type) override;
+	void ReadAhead(u32 FAD, u32 count) override;
 
-		std::fseek(file, offset + FAD * fmt, SEEK_SET);
-		if (std::fread(dst, 1, fmt, file) != fmt)
-		{
-			WARN_LOG(GDROM, "Failed or truncated GD-Rom read");
-			return false;
-		}
-		return true;
-	}
+private:
+	SectorFormat getSectorFormat() const;
+	void map();
 
-	~RawTrackFile() override
-	{
-		std::fclose(file);
-	}
+	FILE *file;
+	s32 offset;
+	u32 fmt;
+	// read-only mapping of the whole file, if the platform supports it
+	const u8 *mapping = nullptr;
+	size_t mappingSize = 0;
+	void *mappingHandle = nullptr;
 };
 
 DiscType GuessDiscType(bool m1, bool m2, bool da);
 
 //IO
 void libGDR_ReadSector(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz);
+void libGDR_ReadAhead(u32 startSector, u32 sectorCount);
 void libGDR_ReadSubChannel(u8 * buff, u32 len);
 void libGDR_GetToc(u32 *toc, DiskArea area);
 u32 libGDR_GetDiscType();
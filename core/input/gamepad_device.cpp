@@ -24,8 +24,10 @@
 #include "emulator.h"
 #include "hw/maple/maple_devs.h"
 #include "hw/naomi/card_reader.h"
+#include "hw/sh4/sh4_sched.h"
 
 #include <algorithm>
+#include <cstdio>
 #include <mutex>
 #include <vector>
 
@@ -47,8 +49,6 @@ std::vector<std::shared_ptr<GamepadDevice>> GamepadDevice::_gamepads;
 std::mutex GamepadDevice::_gamepads_mutex;
 
 #ifdef TEST_AUTOMATION
-#include "hw/sh4/sh4_sched.h"
-#include <cstdio>
 static FILE *record_input;
 #endif
 
@@ -497,22 +497,43 @@ void GamepadDevice::SaveMaplePorts()
 	}
 }
 
-#ifdef TEST_AUTOMATION
 #include "cfg/option.h"
+static FILE *replay_file;
+static u64 next_event;
+static u32 next_port;
+static u32 next_kcode;
+#ifdef TEST_AUTOMATION
 static bool replay_inited;
-FILE *replay_file;
-u64 next_event;
-u32 next_port;
-u32 next_kcode;
 bool do_screenshot;
+#endif
+
+bool replay_input_open(const std::string& path)
+{
+	if (replay_file != nullptr)
+		fclose(replay_file);
+	replay_file = nowide::fopen(path.c_str(), "r");
+	next_event = 0;
+#ifdef TEST_AUTOMATION
+	replay_inited = true;
+#endif
+	if (replay_file == nullptr)
+	{
+		WARN_LOG(INPUT, "Cannot open input replay file %s", path.c_str());
+		return false;
+	}
+	NOTICE_LOG(INPUT, "Replaying input from %s", path.c_str());
+	return true;
+}
 
 void replay_input()
 {
+#ifdef TEST_AUTOMATION
 	if (!replay_inited)
 	{
 		replay_file = get_record_input(false);
 		replay_inited = true;
 	}
+#endif
 	u64 now = sh4_sched_now64();
 	if (config::UseReios)
 	{
@@ -524,8 +545,10 @@ void replay_input()
 	}
 	if (replay_file == NULL)
 	{
+#ifdef TEST_AUTOMATION
 		if (next_event > 0 && now - next_event > SH4_MAIN_CLOCK * 5)
 			die("Automation time-out after 5 s\n");
+#endif
 		return;
 	}
 	while (next_event <= now)
@@ -539,9 +562,10 @@ void replay_input()
 			fclose(replay_file);
 			replay_file = NULL;
 			NOTICE_LOG(INPUT, "Input replay terminated");
+#ifdef TEST_AUTOMATION
 			do_screenshot = true;
+#endif
 			break;
 		}
 	}
 }
-#endif
@@ -162,9 +162,10 @@ private:
 	static std::mutex _gamepads_mutex;
 };
 
-#ifdef TEST_AUTOMATION
+// Called on vblank to apply the recorded input events that are due
 void replay_input();
-#endif
+// Replay the input recorded in the given file
+bool replay_input_open(const std::string& path);
 
 extern u32 kcode[4];
 extern u8 rt[4], lt[4];
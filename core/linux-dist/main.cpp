@@ -9,9 +9,11 @@
 #include "rend/mainui.h"
 #include "oslib/directory.h"
 #include "oslib/oslib.h"
+#include "profiler/bench.h"
 #include "stdclass.h"
 
 #include <csignal>
+#include <cstring>
 #include <string>
 #include <unistd.h>
 #include <vector>
@@ -329,9 +331,12 @@ int main(int argc, char* argv[])
 	INFO_LOG(BOOT, "Config dir is: %s", get_writable_config_path("").c_str());
 	INFO_LOG(BOOT, "Data dir is:   %s", get_writable_data_path("").c_str());
 
+	// Headless benchmark: no window, no input, no gui
+	const bool benchMode = argc >= 2 && (!strcmp(argv[1], "-bench") || !strcmp(argv[1], "--bench"));
+
 #if defined(USE_SDL)
 	// init video now: on rpi3 it installs a sigsegv handler(?)
-	if (SDL_Init(SDL_INIT_VIDEO) != 0)
+	if (!benchMode && SDL_Init(SDL_INIT_VIDEO) != 0)
 	{
 		die("SDL: Initialization failed!");
 	}
@@ -341,6 +346,13 @@ int main(int argc, char* argv[])
 	common_linux_setup();
 #endif
 
+	if (benchMode)
+	{
+		int rc = bench::main(argc - 1, argv + 1);
+		os_UninstallFaultHandler();
+		return rc;
+	}
+
 	if (flycast_init(argc, argv))
 		die("Flycast initialization failed\n");
 
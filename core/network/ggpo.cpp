@@ -75,7 +75,6 @@ static void getLocalInput(MapleInputState inputState[4])
 #include <chrono>
 #include <thread>
 #include <mutex>
-#include <unordered_map>
 #include <numeric>
 #include "imgui/imgui.h"
 #include "miniupnp.h"
@@ -134,12 +133,60 @@ struct MemPages
 		memwatch::aramWatcher.getPages(aram);
 		memwatch::elanWatcher.getPages(elanram);
 	}
-	memwatch::PageMap ram;
-	memwatch::PageMap vram;
-	memwatch::PageMap aram;
-	memwatch::PageMap elanram;
+	void clear()
+	{
+		ram.clear();
+		vram.clear();
+		aram.clear();
+		elanram.clear();
+	}
+	memwatch::PageList ram;
+	memwatch::PageList vram;
+	memwatch::PageList aram;
+	memwatch::PageList elanram;
+};
+
+// Saved state of a frame, and the memory pages as they were at this frame.
+// Snapshots are reused once ggpo frees them so that no memory is allocated
+// once all of them have been used.
+struct Snapshot
+{
+	int frame = -1;		// -1 if free
+	std::vector<u8> data;
+	MemPages pages;
 };
-static std::unordered_map<int, MemPages> deltaStates;
+// ggpo keeps the states of the prediction window plus the current and confirmed frames
+static std::vector<Snapshot> snapshots;
+// pages modified during a frame whose snapshot has been freed
+static MemPages discardedPages;
+
+static Snapshot *getFreeSnapshot()
+{
+	if (snapshots.empty())
+		snapshots.resize(GGPO_MAX_PREDICTION_FRAMES + 2);
+	for (Snapshot& snapshot : snapshots)
+		if (snapshot.frame == -1)
+			return &snapshot;
+	WARN_LOG(NETWORK, "All %d snapshots in use", (int)snapshots.size());
+	snapshots.emplace_back();
+	return &snapshots.back();
+}
+
+static Snapshot *findSnapshot(int frame)
+{
+	for (Snapshot& snapshot : snapshots)
+		if (snapshot.frame == frame)
+			return &snapshot;
+	return nullptr;
+}
+
+template<typename Watcher>
+static void restorePages(const memwatch::PageList& pages, Watcher& watcher)
+{
+	for (const auto& entry : pages.entries)
+		memcpy(watcher.getMemPage(entry.offset), &pages.page(entry).data[0], PAGE_SIZE);
+}
+
 static int lastSavedFrame = -1;
 
 static int timesyncOccurred;
@@ -288,15 +335,17 @@ static bool load_game_state(unsigned char *buffer, int len)
 	memwatch::unprotect();
 	for (int f = lastSavedFrame - 1; f >= frame; f--)
 	{
-		const MemPages& pages = deltaStates[f];
-		for (const auto& pair : pages.ram)
-			memcpy(memwatch::ramWatcher.getMemPage(pair.first), &pair.second.data[0], PAGE_SIZE);
-		for (const auto& pair : pages.vram)
-			memcpy(memwatch::vramWatcher.getMemPage(pair.first), &pair.second.data[0], PAGE_SIZE);
-		for (const auto& pair : pages.aram)
-			memcpy(memwatch::aramWatcher.getMemPage(pair.first), &pair.second.data[0], PAGE_SIZE);
-		for (const auto& pair : pages.elanram)
-			memcpy(memwatch::elanWatcher.getMemPage(pair.first), &pair.second.data[0], PAGE_SIZE);
+		const Snapshot *snapshot = findSnapshot(f);
+		if (snapshot == nullptr)
+		{
+			WARN_LOG(NETWORK, "Snapshot of frame %d not found", f);
+			continue;
+		}
+		const MemPages& pages = snapshot->pages;
+		restorePages(pages.ram, memwatch::ramWatcher);
+		restorePages(pages.vram, memwatch::vramWatcher);
+		restorePages(pages.aram, memwatch::aramWatcher);
+		restorePages(pages.elanram, memwatch::elanWatcher);
 		DEBUG_LOG(NETWORK, "Restored frame %d pages: %d ram, %d vram, %d eram, %d aica ram", f, (u32)pages.ram.size(),
 					(u32)pages.vram.size(), (u32)pages.elanram.size(), (u32)pages.aram.size());
 	}
@@ -322,74 +371,62 @@ static bool save_game_state(unsigned char **buffer, int *len, int *checksum, int
 {
 	verify(!sh4_cpu.IsCpuRunning());
 	lastSavedFrame = frame;
-	// TODO this is way too much memory
-	size_t allocSize = (settings.platform.isNaomi() ? 20 : 10) * 1024 * 1024;
-	*buffer = (unsigned char *)malloc(allocSize);
-	if (*buffer == nullptr)
-	{
-		WARN_LOG(NETWORK, "Memory alloc failed");
-		*len = 0;
-		return false;
-	}
-	Serializer ser(*buffer, allocSize, true);
+	Snapshot *snapshot = getFreeSnapshot();
+	// The size of the state may vary. Dry runs don't copy anything and are cheap.
+	Serializer dryrun(nullptr, std::numeric_limits<size_t>::max(), true);
+	dryrun << frame;
+	dc_serialize(dryrun);
+	if (snapshot->data.size() < dryrun.size())
+		snapshot->data.resize(dryrun.size());
+	Serializer ser(snapshot->data.data(), dryrun.size(), true);
 	ser << frame;
 	dc_serialize(ser);
-	verify(ser.size() < allocSize);
+	verify(ser.size() == dryrun.size());
+	snapshot->frame = frame;
+	*buffer = snapshot->data.data();
 	*len = ser.size();
 #ifdef SYNC_TEST
-	*checksum = XXH32(*buffer, usedSize, 7);
+	*checksum = XXH32(*buffer, *len, 7);
 #endif
 	memwatch::protect();
 	if (frame > 0)
 	{
+		Snapshot *previous = findSnapshot(frame - 1);
+		MemPages& pages = previous != nullptr ? previous->pages : discardedPages;
 #ifdef SYNC_TEST
-		if (deltaStates.count(frame - 1) != 0)
+		if (previous != nullptr && previous->pages.ram.size() + previous->pages.vram.size() + previous->pages.aram.size() != 0)
 		{
 			MemPages memPages;
 			memPages.load();
-			const MemPages& savedPages = deltaStates[frame - 1];
-			//verify(memPages.ram.size() == savedPages.ram.size());
-			if (memPages.ram.size() != savedPages.ram.size())
+			const MemPages& savedPages = previous->pages;
+			auto checkPages = [](const char *name, const memwatch::PageList& newPages, const memwatch::PageList& oldPages)
 			{
-				ERROR_LOG(NETWORK, "old ram size %d new %d", (u32)savedPages.ram.size(), (u32)memPages.ram.size());
-				if (memPages.ram.size() > savedPages.ram.size())
-					for (const auto& pair : memPages.ram)
-					{
-						if (savedPages.ram.count(pair.first) == 0)
-							ERROR_LOG(NETWORK, "new page @ %x", pair.first);
-						else
-							DEBUG_LOG(NETWORK, "page ok @ %x", pair.first);
-					}
-				die("fatal");
-			}
-			for (const auto& pair : memPages.ram)
-			{
-				verify(savedPages.ram.count(pair.first) == 1);
-				verify(memcmp(&pair.second[0], &savedPages.ram.find(pair.first)->second[0], PAGE_SIZE) == 0);
-			}
-			verify(memPages.vram.size() == savedPages.vram.size());
-			for (const auto& pair : memPages.vram)
-			{
-				verify(savedPages.vram.count(pair.first) == 1);
-				verify(memcmp(&pair.second[0], &savedPages.vram.find(pair.first)->second[0], PAGE_SIZE) == 0);
-			}
-			//verify(memPages.aram.size() == savedPages.aram.size());
-			if (memPages.aram.size() != savedPages.aram.size())
-			{
-				ERROR_LOG(NETWORK, "old aram size %d new %d", (u32)savedPages.aram.size(), (u32)memPages.aram.size());
-				die("fatal");
-			}
-			for (const auto& pair : memPages.aram)
-			{
-				verify(savedPages.aram.count(pair.first) == 1);
-				verify(memcmp(&pair.second[0], &savedPages.aram.find(pair.first)->second[0], PAGE_SIZE) == 0);
-			}
+				if (newPages.size() != oldPages.size())
+				{
+					ERROR_LOG(NETWORK, "old %s size %d new %d", name, (u32)oldPages.size(), (u32)newPages.size());
+					for (const auto& entry : newPages.entries)
+						if (oldPages.find(entry.offset) == nullptr)
+							ERROR_LOG(NETWORK, "new page @ %x", entry.offset);
+					die("fatal");
+				}
+				for (const auto& entry : newPages.entries)
+				{
+					const memwatch::Page *page = oldPages.find(entry.offset);
+					verify(page != nullptr);
+					verify(memcmp(&newPages.page(entry).data[0], &page->data[0], PAGE_SIZE) == 0);
+				}
+			};
+			checkPages("ram", memPages.ram, savedPages.ram);
+			checkPages("vram", memPages.vram, savedPages.vram);
+			checkPages("aram", memPages.aram, savedPages.aram);
+			std::swap(previous->pages, memPages);
 		}
+		else
 #endif
 		// Save the delta to frame-1
-		deltaStates[frame - 1].load();
-		DEBUG_LOG(NETWORK, "Saved frame %d pages: %d ram, %d vram, %d eram, %d aica ram", frame - 1, (u32)deltaStates[frame - 1].ram.size(),
-				(u32)deltaStates[frame - 1].vram.size(), (u32)deltaStates[frame - 1].elanram.size(), (u32)deltaStates[frame - 1].aram.size());
+		pages.load();
+		DEBUG_LOG(NETWORK, "Saved frame %d pages: %d ram, %d vram, %d eram, %d aica ram", frame - 1, (u32)pages.ram.size(),
+				(u32)pages.vram.size(), (u32)pages.elanram.size(), (u32)pages.aram.size());
 	}
 
 	return true;
@@ -428,14 +465,16 @@ static bool log_game_state(char *filename, unsigned char *buffer, int len)
  */
 static void free_buffer(void *buffer)
 {
-	if (buffer != nullptr)
-	{
-		Deserializer deser(buffer, 1024 * 1024, true);
-		int frame;
-		deser >> frame;
-		deltaStates.erase(frame);
-		free(buffer);
-	}
+	if (buffer == nullptr)
+		return;
+	for (Snapshot& snapshot : snapshots)
+		if (snapshot.data.data() == buffer)
+		{
+			snapshot.frame = -1;
+			snapshot.pages.clear();
+			return;
+		}
+	WARN_LOG(NETWORK, "free_buffer: unknown buffer %p", buffer);
 }
 
 static void on_message(u8 *msg, int len)
@@ -599,6 +638,9 @@ void stopSession()
 	emu.setNetworkState(false);
 	memwatch::unprotect();
 	memwatch::reset();
+	// Release the snapshot memory
+	std::vector<Snapshot>().swap(snapshots);
+	discardedPages = MemPages();
 }
 
 void getInput(MapleInputState inputState[4])
@@ -14,6 +14,7 @@
 #include "lua/lua.h"
 #include "stdclass.h"
 #include "serialize.h"
+#include "savestate.h"
 
 int flycast_init(int argc, char* argv[])
 {
@@ -78,6 +79,7 @@ void SaveSettings()
 void flycast_term()
 {
 	gui_cancel_load();
+	savestate::flush();
 	lua::term();
 	emu.term();
 	gui_term();
@@ -89,57 +91,9 @@ void dc_savestate(int index)
 	if (settings.network.online)
 		return;
 
-	Serializer ser;
-	dc_serialize(ser);
-
-	void *data = malloc(ser.size());
-	if (data == nullptr)
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not malloc %d bytes", (int)ser.size());
+	// The state is written asynchronously
+	if (!savestate::save(hostfs::getSavestatePath(index, true)))
 		gui_display_notification("Save state failed - memory full", 2000);
-    	return;
-	}
-
-	ser = Serializer(data, ser.size());
-	dc_serialize(ser);
-
-	std::string filename = hostfs::getSavestatePath(index, true);
-#if 0
-	FILE *f = nowide::fopen(filename.c_str(), "wb");
-
-	if ( f == NULL )
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not open %s for writing", filename.c_str());
-		gui_display_notification("Cannot open save file", 2000);
-		free(data);
-    	return;
-	}
-
-	std::fwrite(data, 1, ser.size(), f);
-	std::fclose(f);
-#else
-	RZipFile zipFile;
-	if (!zipFile.Open(filename, true))
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not open %s for writing", filename.c_str());
-		gui_display_notification("Cannot open save file", 2000);
-		free(data);
-    	return;
-	}
-	if (zipFile.Write(data, ser.size()) != ser.size())
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - error writing %s", filename.c_str());
-		gui_display_notification("Error saving state", 2000);
-		zipFile.Close();
-		free(data);
-    	return;
-	}
-	zipFile.Close();
-#endif
-
-	free(data);
-	NOTICE_LOG(SAVESTATE, "Saved state to %s size %d", filename.c_str(), (int)ser.size());
-	gui_display_notification("State saved", 1000);
 }
 
 void dc_loadstate(int index)
@@ -148,6 +102,7 @@ void dc_loadstate(int index)
 	FILE *f = nullptr;
 
 	emu.stop();
+	savestate::flush();
 
 	std::string filename = hostfs::getSavestatePath(index, false);
 	RZipFile zipFile;
@@ -213,11 +168,19 @@ void dc_loadstate(int index)
 	}
 
 	try {
-		Deserializer deser(data, total_size);
-		dc_loadstate(deser);
-	    NOTICE_LOG(SAVESTATE, "Loaded state ver %d from %s size %d", deser.version(), filename.c_str(), total_size);
-		if (deser.size() != total_size)
-			WARN_LOG(SAVESTATE, "Savestate size %d but only %d bytes used", total_size, (int)deser.size());
+		if (savestate::isPaged(data, total_size))
+		{
+			savestate::load(filename, (const u8 *)data, total_size);
+			NOTICE_LOG(SAVESTATE, "Loaded paged state from %s size %d", filename.c_str(), total_size);
+		}
+		else
+		{
+			Deserializer deser(data, total_size);
+			dc_loadstate(deser);
+			NOTICE_LOG(SAVESTATE, "Loaded state ver %d from %s size %d", deser.version(), filename.c_str(), total_size);
+			if (deser.size() != total_size)
+				WARN_LOG(SAVESTATE, "Savestate size %d but only %d bytes used", total_size, (int)deser.size());
+		}
 	} catch (const Deserializer::Exception& e) {
 		ERROR_LOG(SAVESTATE, "%s", e.what());
 	}
@@ -1,11 +1,152 @@
 #include "audiostream.h"
 #include "cfg/option.h"
 
-struct SoundFrame { s16 l; s16 r; };
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
-static SoundFrame Buffer[SAMPLE_COUNT];
-static u32 writePtr;  // next sample index
+// Linear resampler. The ratio is the number of input frames per output frame.
+class Resampler
+{
+public:
+	void reset()
+	{
+		prev = {};
+		phase = 0.f;
+	}
+
+	void process(const SoundFrame *in, u32 count, float ratio, std::vector<SoundFrame>& out)
+	{
+		// position 0 is the last frame of the previous call, position i is in[i - 1]
+		while (phase < count)
+		{
+			u32 i = (u32)phase;
+			float f = phase - i;
+			const SoundFrame& s0 = i == 0 ? prev : in[i - 1];
+			const SoundFrame& s1 = in[i];
+			out.push_back({ (s16)(s0.l + (s1.l - s0.l) * f), (s16)(s0.r + (s1.r - s0.r) * f) });
+			phase += ratio;
+		}
+		phase -= count;
+		prev = in[count - 1];
+	}
+
+private:
+	SoundFrame prev {};
+	float phase = 0.f;
+};
+
+// Feeds the audio backend from its own thread.
+// The emulator is paced by the audio output, unless AudioSyncToVideo is set. In that case
+// the emulator never waits and the audio is resampled to keep the buffer half full.
+class AudioThread
+{
+public:
+	void start(AudioBackend *backend)
+	{
+		this->backend = backend;
+		ring.setCapacity(RING_FRAMES * sizeof(SoundFrame) + 1);
+		resampler.reset();
+		running = true;
+		thread = std::thread(&AudioThread::run, this);
+	}
 
+	void stop()
+	{
+		if (!thread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> _(mutex);
+			running = false;
+		}
+		dataCond.notify_one();
+		spaceCond.notify_one();
+		thread.join();
+	}
+
+	void write(const SoundFrame *frames, u32 count)
+	{
+		const u32 size = count * sizeof(SoundFrame);
+		if (config::AudioSyncToVideo)
+		{
+			if (!ring.write((const u8 *)frames, size))
+				DEBUG_LOG(AUDIO, "Audio buffer overflow: %d frames dropped", count);
+		}
+		else
+		{
+			// Wait until the backend has consumed enough
+			std::unique_lock<std::mutex> lock(mutex);
+			spaceCond.wait(lock, [this, size]() {
+				return !running || ring.readSize() + size <= PACED_FRAMES * sizeof(SoundFrame);
+			});
+			lock.unlock();
+			ring.write((const u8 *)frames, size);
+		}
+		// Make sure the audio thread isn't about to wait
+		{
+			std::lock_guard<std::mutex> _(mutex);
+		}
+		dataCond.notify_one();
+	}
+
+private:
+	void run()
+	{
+		SoundFrame in[SAMPLE_COUNT];
+		std::vector<SoundFrame> out;
+		constexpr u32 blockSize = sizeof(in);
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				dataCond.wait(lock, [this]() {
+					return !running || ring.readSize() >= blockSize;
+				});
+				if (!running)
+					break;
+			}
+			const u32 fill = ring.readSize() / sizeof(SoundFrame);
+			ring.read((u8 *)in, blockSize);
+			{
+				std::lock_guard<std::mutex> _(mutex);
+			}
+			spaceCond.notify_one();
+
+			if (!config::AudioSyncToVideo)
+			{
+				backend->push(in, SAMPLE_COUNT, config::LimitFPS);
+				continue;
+			}
+			// Dynamic rate control: play faster if the buffer fills up, slower if it drains
+			float error = std::min(std::max(((float)fill - TARGET_FRAMES) / TARGET_FRAMES, -1.f), 1.f);
+			resampler.process(in, SAMPLE_COUNT, 1.f + MAX_RATE_DELTA * error, out);
+			while (out.size() >= SAMPLE_COUNT)
+			{
+				backend->push(out.data(), SAMPLE_COUNT, true);
+				out.erase(out.begin(), out.begin() + SAMPLE_COUNT);
+			}
+		}
+	}
+
+	static constexpr u32 RING_FRAMES = SAMPLE_COUNT * 8;
+	// Frames buffered before the emulator waits, when it's paced by the audio output
+	static constexpr u32 PACED_FRAMES = SAMPLE_COUNT * 2;
+	// Fill level targeted by the resampler
+	static constexpr float TARGET_FRAMES = SAMPLE_COUNT * 4;
+	// Maximum pitch deviation, inaudible
+	static constexpr float MAX_RATE_DELTA = 0.005f;
+
+	AudioBackend *backend = nullptr;
+	RingBuffer ring;
+	Resampler resampler;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable dataCond;
+	std::condition_variable spaceCond;
+	bool running = false;
+};
+
+static AudioThread audioThread;
 static AudioBackend *currentBackend;
 std::vector<AudioBackend *> *AudioBackend::backends;
 
@@ -45,16 +186,29 @@ AudioBackend *AudioBackend::getBackend(const std::string& slug)
 	return nullptr;
 }
 
-void WriteSample(s16 r, s16 l)
+void WriteSamples(const SoundFrame *frames, u32 count)
 {
-	Buffer[writePtr].r = r * config::AudioVolume.dbPower();
-	Buffer[writePtr].l = l * config::AudioVolume.dbPower();
-
-	if (++writePtr == SAMPLE_COUNT)
+	if (currentBackend == nullptr)
+		return;
+	// 1.15 fixed point volume
+	const s32 volume = (s32)(config::AudioVolume.dbPower() * 32768.f);
+	if (volume >= 32768)
+	{
+		audioThread.write(frames, count);
+		return;
+	}
+	SoundFrame buffer[SAMPLE_COUNT];
+	while (count > 0)
 	{
-		if (currentBackend != nullptr)
-			currentBackend->push(Buffer, SAMPLE_COUNT, config::LimitFPS);
-		writePtr = 0;
+		u32 n = std::min(count, SAMPLE_COUNT);
+		for (u32 i = 0; i < n; i++)
+		{
+			buffer[i].l = (frames[i].l * volume) >> 15;
+			buffer[i].r = (frames[i].r * volume) >> 15;
+		}
+		audioThread.write(buffer, n);
+		frames += n;
+		count -= n;
 	}
 }
 
@@ -91,6 +245,7 @@ void InitAudio()
 		WARN_LOG(AUDIO, "Running without audio!");
 		return;
 	}
+	audioThread.start(currentBackend);
 
 	if (audio_recording_started)
 	{
@@ -109,6 +264,7 @@ void TermAudio()
 	bool rec_started = audio_recording_started;
 	StopAudioRecording();
 	audio_recording_started = rec_started;
+	audioThread.stop();
 	currentBackend->term();
 	INFO_LOG(AUDIO, "Terminating audio backend \"%s\" (%s)...", currentBackend->slug.c_str(), currentBackend->name.c_str());
 	currentBackend = nullptr;
@@ -60,7 +60,8 @@ private:
 
 void InitAudio();
 void TermAudio();
-void WriteSample(s16 right, s16 left);
+struct SoundFrame { s16 l; s16 r; };
+void WriteSamples(const SoundFrame *frames, u32 count);
 
 void StartAudioRecording(bool eight_khz);
 u32 RecordAudio(void *buffer, u32 samples);
@@ -74,6 +75,7 @@ class RingBuffer
 	std::atomic_int readCursor { 0 };
 	std::atomic_int writeCursor { 0 };
 
+public:
 	u32 readSize() {
 		return (u32)((writeCursor - readCursor + buffer.size()) % buffer.size());
 	}
@@ -81,7 +83,6 @@ class RingBuffer
 		return (u32)((readCursor - writeCursor + buffer.size() - 1) % buffer.size());
 	}
 
-public:
 	bool write(const u8 *data, u32 size)
 	{
 		if (size > writeSize())
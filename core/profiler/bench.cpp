@@ -0,0 +1,403 @@
+/*
+	Headless benchmark runner
+*/
+#include "bench.h"
+#include "emulator.h"
+#include "cfg/cfg.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/pvr/Renderer_if.h"
+#include "hw/pvr/ta.h"
+#include "hw/pvr/ta_ctx.h"
+#include "rend/TexCache.h"
+#include "hw/sh4/sh4_sched.h"
+#include "input/gamepad_device.h"
+#include "log/LogManager.h"
+#include "json.hpp"
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace nlohmann;
+
+namespace bench
+{
+
+bool active;
+Stats stats;
+thread_local Timer *Timer::current;
+static FILE *taCapture;
+
+void captureTaData(const u8 *data, u32 size)
+{
+	if (taCapture == nullptr || size == 0)
+		return;
+	std::fwrite(&size, sizeof(size), 1, taCapture);
+	std::fwrite(data, 1, size, taCapture);
+}
+
+#ifndef LIBRETRO
+Renderer *rend_norend();
+Renderer *rend_softrend();
+
+static u64 vblankCount;
+
+static void resetStats()
+{
+	for (auto& time : stats.time)
+		time = 0;
+	stats.sh4BlocksCompiled = 0;
+	stats.sh4Superblocks = 0;
+	stats.sh4CacheFlushes = 0;
+	stats.arm7BlocksCompiled = 0;
+	stats.schedCallbacks = 0;
+	stats.schedRequests = 0;
+}
+
+static void onVBlank(Event event, void *)
+{
+	vblankCount++;
+}
+
+static int usage()
+{
+	fprintf(stderr, "Usage: flycast -bench [OPTION]... CONTENT\n\n");
+	fprintf(stderr, "Runs CONTENT headless and prints performance statistics as JSON.\n");
+	fprintf(stderr, "Execution stops at the first frame boundary past the requested budget.\n\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "-frames N                     run for N emulated frames (default 3600)\n");
+	fprintf(stderr, "-cycles N                     run for N SH4 cycles\n");
+	fprintf(stderr, "-replay FILE                  replay the input recorded in FILE\n");
+	fprintf(stderr, "-output FILE                  write the results to FILE instead of stdout\n");
+	fprintf(stderr, "-config section:key=value     add a virtual config value\n");
+	fprintf(stderr, "-tacapture FILE               save the TA data of each render pass to FILE\n");
+	fprintf(stderr, "-softrend                     render the frames with the software renderer\n");
+	fprintf(stderr, "-screenshot FILE              save the last displayed frame to FILE as PNG (implies -softrend)\n\n");
+	fprintf(stderr, "Usage: flycast -bench -tadecode FILE [-iterations N] [-output FILE]\n\n");
+	fprintf(stderr, "Decodes the TA data captured in FILE N times (default 20) with the scalar and SIMD\n");
+	fprintf(stderr, "vertex decoders and compares their results and speed.\n");
+	return 1;
+}
+
+static double toMillis(u64 nanos) {
+	return nanos / 1000000.0;
+}
+
+static int writeResult(const json& result, const std::string& outputFile)
+{
+	std::string out = result.dump(4) + "\n";
+	if (outputFile.empty())
+	{
+		fputs(out.c_str(), stdout);
+		return 0;
+	}
+	FILE *f = nowide::fopen(outputFile.c_str(), "w");
+	if (f == nullptr)
+	{
+		ERROR_LOG(COMMON, "Cannot open %s for writing", outputFile.c_str());
+		return 1;
+	}
+	fputs(out.c_str(), f);
+	fclose(f);
+
+	return 0;
+}
+
+// Saves the framebuffer being displayed
+static bool writeScreenshot(const std::string& path)
+{
+	FramebufferInfo info;
+	info.update();
+	PixelBuffer<u32> pb;
+	int width, height;
+	ReadFramebuffer<RGBAPacker>(info, pb, width, height);
+	if (width <= 0 || height <= 0)
+	{
+		ERROR_LOG(COMMON, "No framebuffer to save");
+		return false;
+	}
+	u32 *p = pb.data();
+	for (int i = 0; i < width * height; i++)
+		p[i] |= 0xff000000;
+	if (!stbi_write_png(path.c_str(), width, height, 4, p, width * 4))
+	{
+		ERROR_LOG(COMMON, "Cannot write %s", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+static int taDecodeBenchmark(const std::string& captureFile, u32 iterations, const std::string& outputFile)
+{
+	FILE *f = nowide::fopen(captureFile.c_str(), "rb");
+	if (f == nullptr)
+	{
+		ERROR_LOG(COMMON, "Cannot open %s", captureFile.c_str());
+		return 1;
+	}
+	std::vector<std::vector<u8>> passes;
+	u32 size;
+	while (std::fread(&size, sizeof(size), 1, f) == 1)
+	{
+		if (size > TA_DATA_SIZE)
+			break;
+		passes.emplace_back(size);
+		if (std::fread(passes.back().data(), 1, size, f) != size)
+		{
+			passes.pop_back();
+			break;
+		}
+	}
+	fclose(f);
+	if (passes.empty())
+	{
+		ERROR_LOG(COMMON, "No TA data in %s", captureFile.c_str());
+		return 1;
+	}
+
+	TA_context ctx;
+	ctx.Alloc();
+	// Both decoders must produce the same vertices
+	u64 vertices = 0;
+	bool identical = true;
+	std::vector<Vertex> scalarVerts;
+	for (const std::vector<u8>& pass : passes)
+	{
+		ctx.rend.Clear();
+		ta_decode(&ctx, pass.data(), (u32)pass.size(), false);
+		scalarVerts.assign(ctx.rend.verts.head(), ctx.rend.verts.head() + ctx.rend.verts.used());
+		ctx.rend.Clear();
+		ta_decode(&ctx, pass.data(), (u32)pass.size(), true);
+		identical = identical && scalarVerts.size() == (size_t)ctx.rend.verts.used()
+				&& memcmp(scalarVerts.data(), ctx.rend.verts.head(), ctx.rend.verts.bytes()) == 0;
+		vertices += scalarVerts.size() - 4;	// background poly
+	}
+
+	auto decodeTime = [&](bool simd) {
+		auto start = std::chrono::steady_clock::now();
+		for (u32 i = 0; i < iterations; i++)
+			for (const std::vector<u8>& pass : passes)
+			{
+				ctx.rend.Clear();
+				ta_decode(&ctx, pass.data(), (u32)pass.size(), simd);
+			}
+		return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	};
+	u64 scalarTime = decodeTime(false);
+	u64 simdTime = decodeTime(true);
+	u64 totalVertices = std::max<u64>(vertices * iterations, 1);
+
+	json result = {
+		{ "capture", captureFile },
+		{ "passes", passes.size() },
+		{ "vertices", vertices },
+		{ "iterations", iterations },
+		{ "identical", identical },
+		{ "scalar_ms", toMillis(scalarTime) },
+		{ "simd_ms", toMillis(simdTime) },
+		{ "scalar_ns_per_vertex", (double)scalarTime / totalVertices },
+		{ "simd_ns_per_vertex", (double)simdTime / totalVertices },
+		{ "speedup", simdTime > 0 ? (double)scalarTime / simdTime : 0.0 },
+	};
+	int rc = writeResult(result, outputFile);
+
+	return identical ? rc : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	u64 maxFrames = 0;
+	u64 maxCycles = 0;
+	std::string replayFile;
+	std::string outputFile;
+	std::string captureFile;
+	std::string decodeFile;
+	std::string screenshotFile;
+	bool softRenderer = false;
+	u32 iterations = 20;
+	// Arguments left for ParseCommandLine
+	std::vector<char *> args { argv[0] };
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "-frames") && hasValue)
+			maxFrames = strtoull(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "-cycles") && hasValue)
+			maxCycles = strtoull(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "-replay") && hasValue)
+			replayFile = argv[++i];
+		else if (!strcmp(argv[i], "-output") && hasValue)
+			outputFile = argv[++i];
+		else if (!strcmp(argv[i], "-tacapture") && hasValue)
+			captureFile = argv[++i];
+		else if (!strcmp(argv[i], "-tadecode") && hasValue)
+			decodeFile = argv[++i];
+		else if (!strcmp(argv[i], "-softrend"))
+			softRenderer = true;
+		else if (!strcmp(argv[i], "-screenshot") && hasValue)
+		{
+			screenshotFile = argv[++i];
+			softRenderer = true;
+		}
+		else if (!strcmp(argv[i], "-iterations") && hasValue)
+			iterations = std::max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-help") || !strcmp(argv[i], "--help"))
+			return usage();
+		else
+			args.push_back(argv[i]);
+	}
+	if (!decodeFile.empty())
+		return taDecodeBenchmark(decodeFile, iterations, outputFile);
+	if (maxFrames == 0 && maxCycles == 0)
+		maxFrames = 3600;
+
+	if (!_vmem_reserve())
+	{
+		ERROR_LOG(VMEM, "Failed to alloc mem");
+		return -1;
+	}
+	args.push_back(nullptr);
+	ParseCommandLine((int)args.size() - 1, &args[0]);
+	if (settings.content.path.empty())
+		return usage();
+
+	config::Settings::instance().reset();
+	LogManager::Shutdown();
+	bool cfgFound = cfgOpen();
+	LogManager::Init();
+	if (cfgFound)
+		config::Settings::instance().load(false);
+
+	// Single-threaded, unthrottled and without any host output
+	config::ThreadedRendering.override(false);
+	config::AudioBackend.override("null");
+	config::AutoLoadState.override(false);
+	config::AutoSaveState.override(false);
+	config::GGPOEnable.override(false);
+	config::NetworkEnable.override(false);
+	config::CustomTextures.override(false);
+	config::DumpTextures.override(false);
+
+	renderer = softRenderer ? rend_softrend() : rend_norend();
+	rend_init_renderer();
+
+	std::string game = settings.content.path;
+	int rc = 0;
+	try {
+		emu.loadGame(game.c_str());
+	} catch (const FlycastException& e) {
+		ERROR_LOG(BOOT, "Cannot load %s: %s", game.c_str(), e.what());
+		rend_term_renderer();
+		emu.term();
+		return 1;
+	}
+	// loadGame() resets it. Skips host audio output and throttling.
+	settings.input.fastForwardMode = true;
+	if (!replayFile.empty() && !replay_input_open(replayFile))
+		rc = 1;
+
+	if (!captureFile.empty())
+	{
+		taCapture = nowide::fopen(captureFile.c_str(), "wb");
+		if (taCapture == nullptr)
+		{
+			ERROR_LOG(COMMON, "Cannot open %s for writing", captureFile.c_str());
+			rc = 1;
+		}
+	}
+	EventManager::listen(Event::VBlank, onVBlank);
+	resetStats();
+	resetFrameSlotStats();
+	vblankCount = 0;
+	const u32 startFrameCount = FrameCount;
+	const u64 startCycles = sh4_sched_now64();
+	active = true;
+	emu.start();
+
+	auto startTime = std::chrono::steady_clock::now();
+	try {
+		while (rc == 0
+				&& (maxFrames == 0 || vblankCount < maxFrames)
+				&& (maxCycles == 0 || sh4_sched_now64() - startCycles < maxCycles))
+		{
+			Timer timer(Sh4);
+			if (!emu.render() && !emu.running())
+				rc = 1;
+		}
+	} catch (const FlycastException& e) {
+		ERROR_LOG(COMMON, "Emulation error: %s", e.what());
+		rc = 1;
+	}
+	double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	active = false;
+	if (!screenshotFile.empty() && !writeScreenshot(screenshotFile))
+		rc = 1;
+
+	json frameSlots = json::array();
+	const FrameSlotStats *slotStats = getFrameSlotStats();
+	for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+		frameSlots.push_back({
+			{ "frames", slotStats[i].frames },
+			{ "avg_latency_ms", slotStats[i].frames > 0 ? toMillis(slotStats[i].totalLatency) / slotStats[i].frames : 0.0 },
+			{ "max_latency_ms", toMillis(slotStats[i].maxLatency) },
+		});
+
+	u64 cycles = sh4_sched_now64() - startCycles;
+	double emuTime = (double)cycles / SH4_MAIN_CLOCK;
+	json result = {
+		{ "content", game },
+		{ "game_id", settings.content.gameId },
+		{ "dynarec", (bool)config::DynarecEnabled },
+		{ "renderer", softRenderer ? "soft" : "none" },
+		{ "completed", rc == 0 },
+		{ "frames", vblankCount },
+		{ "rendered_frames", FrameCount - startFrameCount },
+		{ "sh4_cycles", cycles },
+		{ "emulated_time_s", emuTime },
+		{ "wall_time_s", wallTime },
+		{ "speed_percent", wallTime > 0 ? emuTime / wallTime * 100.0 : 0.0 },
+		{ "fps", wallTime > 0 ? vblankCount / wallTime : 0.0 },
+		{ "time_ms", {
+			{ "sh4", toMillis(stats.time[Sh4]) },
+			{ "arm7", toMillis(stats.time[Arm7]) },
+			{ "aica", toMillis(stats.time[Aica]) },
+			{ "ta_parse", toMillis(stats.time[TaParse]) },
+			{ "render", toMillis(stats.time[Render]) },
+		} },
+		{ "blocks_compiled", {
+			{ "sh4", stats.sh4BlocksCompiled.load() },
+			{ "arm7", stats.arm7BlocksCompiled.load() },
+		} },
+		{ "sh4_superblocks", stats.sh4Superblocks.load() },
+		{ "sh4_cache_flushes", stats.sh4CacheFlushes.load() },
+		{ "scheduler", {
+			{ "callbacks", stats.schedCallbacks.load() },
+			{ "requests", stats.schedRequests.load() },
+			{ "callbacks_per_frame", vblankCount > 0 ? (double)stats.schedCallbacks / vblankCount : 0.0 },
+			{ "requests_per_frame", vblankCount > 0 ? (double)stats.schedRequests / vblankCount : 0.0 },
+		} },
+		{ "frame_slots", frameSlots },
+	};
+	EventManager::unlisten(Event::VBlank, onVBlank);
+	emu.unloadGame();
+	rend_term_renderer();
+	emu.term();
+	if (taCapture != nullptr)
+	{
+		fclose(taCapture);
+		taCapture = nullptr;
+	}
+
+	if (writeResult(result, outputFile) != 0)
+		return 1;
+
+	return rc;
+}
+#endif
+
+}
@@ -0,0 +1,98 @@
+/*
+	Headless benchmark runner
+
+	Runs a game on the null renderer with the null audio backend for a fixed number
+	of emulated frames or SH4 cycles and reports emulated vs. wall-clock speed,
+	per-subsystem host time and dynarec block counts as JSON.
+	The TA data can be captured during the run and used later to benchmark the vertex decoder.
+	Frames can also be rendered with the software renderer and the last one saved as a PNG
+	screenshot for image regression tests.
+*/
+#pragma once
+#include "types.h"
+
+#include <atomic>
+#include <chrono>
+
+namespace bench
+{
+
+enum Subsystem {
+	Sh4,		// SH4 and everything not accounted for below
+	Arm7,
+	Aica,
+	TaParse,
+	Render,		// software renderer only
+	SubsystemCount
+};
+
+// Atomic since the AICA and render threads update them too
+struct Stats
+{
+	std::atomic<u64> time[SubsystemCount];	// nanoseconds
+	std::atomic<u64> sh4BlocksCompiled;
+	std::atomic<u64> sh4Superblocks;
+	std::atomic<u64> sh4CacheFlushes;
+	std::atomic<u64> arm7BlocksCompiled;
+	std::atomic<u64> schedCallbacks;		// sh4 scheduler callbacks fired
+	std::atomic<u64> schedRequests;			// sh4 scheduler (re)schedules
+};
+
+// Set while a benchmark is running. Timers are inert otherwise.
+extern bool active;
+extern Stats stats;
+
+//
+// Accumulates the host time spent in a scope into the given subsystem.
+// Time spent in a nested timer is only accounted to the innermost subsystem.
+//
+class Timer
+{
+	using the_clock = std::chrono::steady_clock;
+
+public:
+	Timer(Subsystem subsystem) : subsystem(subsystem)
+	{
+		if (active)
+		{
+			parent = current;
+			current = this;
+			started = true;
+			startTime = the_clock::now();
+		}
+	}
+
+	~Timer()
+	{
+		if (!started)
+			return;
+		the_clock::duration elapsed = the_clock::now() - startTime;
+		stats.time[subsystem] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+		if (parent != nullptr)
+			// exclude our time from the enclosing scope
+			parent->startTime += elapsed;
+		current = parent;
+	}
+
+	Timer(const Timer&) = delete;
+	Timer& operator=(const Timer&) = delete;
+
+private:
+	Subsystem subsystem;
+	Timer *parent = nullptr;
+	bool started = false;
+	the_clock::time_point startTime;
+
+	static thread_local Timer *current;
+};
+
+// Saves the TA data of a render pass if a capture file is open
+void captureTaData(const u8 *data, u32 size);
+
+#ifndef LIBRETRO
+// Entry point of the `flycast -bench` mode.
+// argv[0] is expected to be the "-bench" argument.
+int main(int argc, char *argv[]);
+#endif
+
+}
@@ -1097,7 +1097,7 @@ static void genMmuLookup(RuntimeBlockInfo* block, const shil_opcode& op, u32 wri
 
 		ass.Lsr(r1, raddr, 12);
 		ass.Ldr(r1, MemOperand(r9, r1, LSL, 2));
-		ass.Cmp(r1, 0);
+		ass.Tst(r1, write ? MMU_LUT_WRITE : MMU_LUT_READ);
 		ass.B(ne, &inCache);
 		if (!raddr.Is(r0))
 			ass.Mov(r0, raddr);
@@ -1106,8 +1106,9 @@ static void genMmuLookup(RuntimeBlockInfo* block, const shil_opcode& op, u32 wri
 		call((void *)mmuDynarecLookup);
 		ass.B(&done);
 		ass.Bind(&inCache);
+		ass.Lsr(r1, r1, 12);
 		ass.And(r0, raddr, 0xFFF);
-		ass.Orr(r0, r0, r1);
+		ass.Orr(r0, r0, Operand(r1, LSL, 12));
 		ass.Bind(&done);
 		raddr = r0;
 	}
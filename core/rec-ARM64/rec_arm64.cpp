@@ -1004,6 +1004,10 @@ public:
 		}
 		regalloc.Cleanup();
 
+		// Without the mmu, returns are already resolved inline with the fpcb table
+		if (mmu_enabled() && (block->BlockType == BET_StaticCall || block->BlockType == BET_DynamicCall))
+			GenReturnStackPush();
+
 		block->relink_offset = (u32)GetBuffer()->GetCursorOffset();
 		block->relink_data = 0;
 
@@ -1289,6 +1293,10 @@ public:
 				Ldr(x15, MemOperand(x2, x1, LSL, 3));	// Get block entry point
 				Br(x15);
 			}
+			else if (block->BlockType == BET_DynamicRet)
+			{
+				GenPredictedReturn();
+			}
 			else
 			{
 				GenBranch(arm64_no_update);
@@ -1322,6 +1330,61 @@ public:
 		return GetBuffer()->GetCursorOffset() - start_offset;
 	}
 
+	// Pushes the return address of a call block on the return address stack
+	void GenReturnStackPush()
+	{
+		static_assert(sizeof(ReturnStackEntry) == 16, "Invalid ReturnStackEntry size");
+		Mov(x9, reinterpret_cast<uintptr_t>(&returnStack));
+		Ldr(w10, MemOperand(x9, offsetof(ReturnStack, top)));
+		Add(w11, w10, 1);
+		And(w11, w11, RETURN_STACK_SIZE - 1);
+		Str(w11, MemOperand(x9, offsetof(ReturnStack, top)));
+		Add(x10, x9, Operand(x10, LSL, 4));
+		// The call and its delay slot end the block
+		Mov(w11, block->vaddr + block->sh4_code_size);
+		Str(w11, MemOperand(x10, offsetof(ReturnStack, entries) + offsetof(ReturnStackEntry, pc)));
+		Mov(x11, reinterpret_cast<uintptr_t>(&block->returnSlot));
+		Str(x11, MemOperand(x10, offsetof(ReturnStack, entries) + offsetof(ReturnStackEntry, slot)));
+	}
+
+	// Pops the return address stack and jumps to the predicted block if the return address matches,
+	// to no_update otherwise. next_pc must be in w29.
+	void GenPredictedReturn()
+	{
+		Label miss;
+		Label notCached;
+		Mov(x9, reinterpret_cast<uintptr_t>(&returnStack));
+		Ldr(w10, MemOperand(x9, offsetof(ReturnStack, top)));
+		Sub(w10, w10, 1);
+		And(w10, w10, RETURN_STACK_SIZE - 1);
+		Str(w10, MemOperand(x9, offsetof(ReturnStack, top)));
+		Add(x10, x9, Operand(x10, LSL, 4));
+		Ldr(w11, MemOperand(x10, offsetof(ReturnStack, entries) + offsetof(ReturnStackEntry, pc)));
+		Cmp(w11, w29);
+		B(&miss, ne);
+
+		Ldr(x0, MemOperand(x10, offsetof(ReturnStack, entries) + offsetof(ReturnStackEntry, slot)));
+		Ldr(w11, MemOperand(x9, offsetof(ReturnStack, epoch)));
+		Ldr(w12, MemOperand(x0, offsetof(ReturnSlot, epoch)));
+		Cmp(w11, w12);
+		B(&notCached, ne);
+		Mov(x11, reinterpret_cast<uintptr_t>(&mmuGeneration));
+		Ldr(w11, MemOperand(x11));
+		Ldr(w12, MemOperand(x0, offsetof(ReturnSlot, mmuGeneration)));
+		Cmp(w11, w12);
+		B(&notCached, ne);
+		// Blocks check the cycle counter on entry
+		Ldr(x15, MemOperand(x0, offsetof(ReturnSlot, code)));
+		Br(x15);
+
+		Bind(&notCached);
+		GenCallRuntime(bm_GetReturnCode);	// slot in x0
+		Br(x0);
+
+		Bind(&miss);
+		GenBranch(arm64_no_update);
+	}
+
 	void Finalize(bool rewrite = false)
 	{
 		Label code_end;
@@ -1706,14 +1769,15 @@ private:
 
 			Lsr(w1, w0, 12);
 			Ldr(w1, MemOperand(x27, x1, LSL, 2));
-			Cbnz(w1, &inCache);
+			Tst(w1, write ? MMU_LUT_WRITE : MMU_LUT_READ);
+			B(&inCache, ne);
 			Mov(w1, write);
 			Mov(w2, block->vaddr + op.guest_offs - (op.delay_slot ? 2 : 0));	// pc
 			GenCallRuntime(mmuDynarecLookup);
 			B(&done);
 			Bind(&inCache);
-			And(w0, w0, 0xFFF);
-			Orr(w0, w0, w1);
+			Bfxil(w1, w0, 0, 12);
+			Mov(w0, w1);
 			Bind(&done);
 		}
 	}
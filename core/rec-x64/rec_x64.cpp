@@ -164,6 +164,20 @@ public:
 
 		sub(rsp, STACK_ALIGN);
 
+		if (staging)
+		{
+			// Profile the block and recompile it as a superblock once hot.
+			// next_pc and the cycle counter are left untouched so that the new block runs next.
+			Xbyak::Label cold;
+			mov(rax, (uintptr_t)&block->staging_runs);
+			dec(dword[rax]);
+			jnz(cold);
+			mov(call_regs[0], block->vaddr);
+			GenCall(rdv_CompileSuperblock);
+			jmp(exit_block, T_NEAR);
+			L(cold);
+		}
+
 		if (mmu_enabled() && block->has_fpu_op)
 		{
 			Xbyak::Label fpu_enabled;
@@ -462,6 +476,9 @@ public:
 		regalloc.Cleanup();
 		current_opid = -1;
 
+		if (block->BlockType == BET_StaticCall || block->BlockType == BET_DynamicCall)
+			genReturnStackPush(block);
+
 		mov(rax, (size_t)&next_pc);
 
 		switch (block->BlockType) {
@@ -502,6 +519,8 @@ public:
 			mov(rdx, (size_t)&Sh4cntx.jdyn);
 			mov(edx, dword[rdx]);
 			mov(dword[rax], edx);
+			if (block->BlockType == BET_DynamicRet)
+				genPredictedReturn();
 			break;
 
 		case BET_DynamicIntr:
@@ -536,6 +555,64 @@ public:
 		emit_Skip(getSize());
 	}
 
+	// Pushes the return address of a call block on the return address stack
+	void genReturnStackPush(RuntimeBlockInfo *block)
+	{
+		static_assert(sizeof(ReturnStackEntry) == 16, "Invalid ReturnStackEntry size");
+		mov(r8, (uintptr_t)&returnStack);
+		mov(ecx, dword[r8 + offsetof(ReturnStack, top)]);
+		mov(edx, ecx);
+		add(edx, 1);
+		and_(edx, RETURN_STACK_SIZE - 1);
+		mov(dword[r8 + offsetof(ReturnStack, top)], edx);
+		shl(ecx, 4);
+		// The call and its delay slot end the block
+		mov(dword[r8 + rcx + offsetof(ReturnStack, entries) + offsetof(ReturnStackEntry, pc)], block->vaddr + block->sh4_code_size);
+		mov(rdx, (uintptr_t)&block->returnSlot);
+		mov(qword[r8 + rcx + offsetof(ReturnStack, entries) + offsetof(ReturnStackEntry, slot)], rdx);
+	}
+
+	// Pops the return address stack and jumps to the predicted block if the return address matches.
+	// Falls through otherwise. edx must hold next_pc.
+	void genPredictedReturn()
+	{
+		Xbyak::Label miss;
+		Xbyak::Label notCached;
+		Xbyak::Label jumpToBlock;
+		mov(r8, (uintptr_t)&returnStack);
+		mov(ecx, dword[r8 + offsetof(ReturnStack, top)]);
+		sub(ecx, 1);
+		and_(ecx, RETURN_STACK_SIZE - 1);
+		mov(dword[r8 + offsetof(ReturnStack, top)], ecx);
+		shl(ecx, 4);
+		cmp(edx, dword[r8 + rcx + offsetof(ReturnStack, entries) + offsetof(ReturnStackEntry, pc)]);
+		jne(miss);
+		// The main loop checks the cycle counter after each block
+		mov(rax, (uintptr_t)&p_sh4rcb->cntx.cycle_counter);
+		cmp(dword[rax], 0);
+		jle(miss);
+
+		mov(rcx, qword[r8 + rcx + offsetof(ReturnStack, entries) + offsetof(ReturnStackEntry, slot)]);
+		mov(eax, dword[r8 + offsetof(ReturnStack, epoch)]);
+		cmp(eax, dword[rcx + offsetof(ReturnSlot, epoch)]);
+		jne(notCached);
+		mov(rax, (uintptr_t)&mmuGeneration);
+		mov(eax, dword[rax]);
+		cmp(eax, dword[rcx + offsetof(ReturnSlot, mmuGeneration)]);
+		jne(notCached);
+		mov(rax, qword[rcx + offsetof(ReturnSlot, code)]);
+		jmp(jumpToBlock);
+
+		L(notCached);
+		mov(call_regs64[0], rcx);
+		GenCall(bm_GetReturnCode);
+
+		L(jumpToBlock);
+		add(rsp, STACK_ALIGN);
+		jmp(rax);
+		L(miss);
+	}
+
 	void ngen_CC_Start(const shil_opcode& op)
 	{
 		CC_pars.clear();
@@ -803,7 +880,7 @@ private:
 			{
 				mov(eax, dword[(uintptr_t)mmuAddressLUT + rax * 4]);
 			}
-			test(eax, eax);
+			test(eax, write ? MMU_LUT_WRITE : MMU_LUT_READ);
 			jne(inCache);
 #endif
 			mov(call_regs[1], write);
@@ -814,6 +891,7 @@ private:
 			jmp(done);
 			L(inCache);
 			and_(call_regs[0], 0xFFF);
+			and_(eax, ~0xFFF);
 			or_(call_regs[0], eax);
 			L(done);
 #endif
@@ -1338,7 +1416,8 @@ void X64RegAlloc::Writeback_FPU(u32 reg, s8 nreg)
 	compiler->RegWriteback_FPU(reg, nreg);
 }
 
-static BlockCompiler* ccCompiler;
+// Blocks can be compiled on a background thread
+static thread_local BlockCompiler* ccCompiler;
 
 void ngen_Compile(RuntimeBlockInfo* block, bool smc_checks, bool reset, bool staging, bool optimise)
 {
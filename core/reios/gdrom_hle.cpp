@@ -14,6 +14,7 @@
 #include "gdrom_hle.h"
 #include "hw/gdrom/gdromv3.h"
 #include "hw/holly/holly_intc.h"
+#include "hw/aica/aica_if.h"
 #include "reios.h"
 #include "imgread/common.h"
 #include "hw/sh4/modules/mmu.h"
@@ -551,6 +552,8 @@ static void GD_HLE_Command(gd_command cc)
 
 void gdrom_hle_op()
 {
+	// The AICA thread plays CDDA
+	libAICA_Sync();
 	if (SYSCALL_GDROM == r[6])		// GDROM SYSCALL
 	{
 		switch(r[7])				// COMMAND CODE
@@ -5,22 +5,24 @@
 #include "hw/mem/_vmem.h"
 
 #include <algorithm>
-#include <mutex>
+#include <thread>
+#define XXH_STATIC_LINKING_ONLY
 #include <xxhash.h>
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
-const u8 *vq_codebook;
-u32 palette_index;
+thread_local const u8 *vq_codebook;
+thread_local u32 palette_index;
 bool KillTex=false;
 u32 palette16_ram[1024];
 u32 palette32_ram[1024];
-u32 pal_hash_256[4];
-u32 pal_hash_16[64];
+u64 pal_hash_256[4];
+u64 pal_hash_16[64];
 bool palette_updated;
 extern bool pal_needs_update;
+extern std::atomic<u64> pal_dirty_banks;
 
 // Rough approximation of LoD bias from D adjust param, only used to increase LoD
 const std::array<f32, 16> D_Adjust_LoD_Bias = {
@@ -82,19 +84,15 @@ static void BuildTwiddleTables()
 
 static OnLoad btt(&BuildTwiddleTables);
 
-void palette_update()
+// Converts palette entries [first, last[ to the host formats
+static void convertPalette(u32 first, u32 last)
 {
-	if (!pal_needs_update)
-		return;
-	pal_needs_update = false;
-	palette_updated = true;
-
 	if (!isDirectX(config::RendererType))
 	{
 		switch(PAL_RAM_CTRL&3)
 		{
 		case 0:
-			for (int i=0;i<1024;i++)
+			for (u32 i = first; i < last; i++)
 			{
 				palette16_ram[i] = Unpacker1555::unpack(PALETTE_RAM[i]);
 				palette32_ram[i] = Unpacker1555_32<RGBAPacker>::unpack(PALETTE_RAM[i]);
@@ -102,7 +100,7 @@ void palette_update()
 			break;
 
 		case 1:
-			for (int i=0;i<1024;i++)
+			for (u32 i = first; i < last; i++)
 			{
 				palette16_ram[i] = UnpackerNop<u16>::unpack(PALETTE_RAM[i]);
 				palette32_ram[i] = Unpacker565_32<RGBAPacker>::unpack(PALETTE_RAM[i]);
@@ -110,7 +108,7 @@ void palette_update()
 			break;
 
 		case 2:
-			for (int i=0;i<1024;i++)
+			for (u32 i = first; i < last; i++)
 			{
 				palette16_ram[i] = Unpacker4444::unpack(PALETTE_RAM[i]);
 				palette32_ram[i] = Unpacker4444_32<RGBAPacker>::unpack(PALETTE_RAM[i]);
@@ -118,7 +116,7 @@ void palette_update()
 			break;
 
 		case 3:
-			for (int i=0;i<1024;i++)
+			for (u32 i = first; i < last; i++)
 				palette32_ram[i] = Unpacker8888<RGBAPacker>::unpack(PALETTE_RAM[i]);
 			break;
 		}
@@ -129,7 +127,7 @@ void palette_update()
 		{
 
 		case 0:
-			for (int i=0;i<1024;i++)
+			for (u32 i = first; i < last; i++)
 			{
 				palette16_ram[i] = UnpackerNop<u16>::unpack(PALETTE_RAM[i]);
 				palette32_ram[i] = Unpacker1555_32<BGRAPacker>::unpack(PALETTE_RAM[i]);
@@ -137,7 +135,7 @@ void palette_update()
 			break;
 
 		case 1:
-			for (int i=0;i<1024;i++)
+			for (u32 i = first; i < last; i++)
 			{
 				palette16_ram[i] = UnpackerNop<u16>::unpack(PALETTE_RAM[i]);
 				palette32_ram[i] = Unpacker565_32<BGRAPacker>::unpack(PALETTE_RAM[i]);
@@ -145,7 +143,7 @@ void palette_update()
 			break;
 
 		case 2:
-			for (int i=0;i<1024;i++)
+			for (u32 i = first; i < last; i++)
 			{
 				palette16_ram[i] = UnpackerNop<u16>::unpack(PALETTE_RAM[i]);
 				palette32_ram[i] = Unpacker4444_32<BGRAPacker>::unpack(PALETTE_RAM[i]);
@@ -153,15 +151,41 @@ void palette_update()
 			break;
 
 		case 3:
-			for (int i=0;i<1024;i++)
+			for (u32 i = first; i < last; i++)
 				palette32_ram[i] = UnpackerNop<u32>::unpack(PALETTE_RAM[i]);
 			break;
 		}
 	}
-	for (int i = 0; i < 64; i++)
-		pal_hash_16[i] = XXH32(&PALETTE_RAM[i << 4], 16 * 4, 7);
-	for (int i = 0; i < 4; i++)
-		pal_hash_256[i] = XXH32(&PALETTE_RAM[i << 8], 256 * 4, 7);
+}
+
+void palette_update()
+{
+	u64 dirtyBanks = pal_dirty_banks.exchange(0, std::memory_order_relaxed);
+	if (pal_needs_update)
+		// Format change: all the banks must be converted again
+		dirtyBanks = ~0ull;
+	pal_needs_update = false;
+	if (dirtyBanks == 0)
+		return;
+	palette_updated = true;
+
+	for (u32 bank = 0; bank < 64; )
+	{
+		if ((dirtyBanks & (1ull << bank)) == 0)
+		{
+			bank++;
+			continue;
+		}
+		u32 end = bank + 1;
+		while (end < 64 && (dirtyBanks & (1ull << end)) != 0)
+			end++;
+		convertPalette(bank * 16, end * 16);
+		for (; bank < end; bank++)
+			pal_hash_16[bank] = XXH3_64bits(&PALETTE_RAM[bank << 4], 16 * 4);
+	}
+	for (u32 i = 0; i < 4; i++)
+		if (((dirtyBanks >> (i * 16)) & 0xffff) != 0)
+			pal_hash_256[i] = XXH3_64bits(&PALETTE_RAM[i << 8], 256 * 4);
 }
 
 void forcePaletteUpdate()
@@ -170,75 +194,82 @@ void forcePaletteUpdate()
 }
 
 
-static std::vector<vram_block*> VramLocks[VRAM_SIZE_MAX / PAGE_SIZE];
+// Write protection state of each vram page
+enum : u8 { PageUnprotected, PageProtecting, PageProtected, PageUnprotecting };
+static std::atomic<u8> VramPageState[VRAM_SIZE_MAX / PAGE_SIZE];
+// Generation of the last write to each page
+static std::atomic<u32> VramPageGen[VRAM_SIZE_MAX / PAGE_SIZE];
+// Incremented each time protected pages are written to
+static std::atomic<u32> VramWriteGen;
 
-//List functions
-//
-static void vramlock_list_remove(vram_block* block)
+// Write-protects pages [first, last].
+// Contiguous pages that aren't protected yet are protected at once.
+// Pages are acquired in ascending order so that concurrent callers can't deadlock.
+static void vramlock_protect_pages(u32 first, u32 last)
 {
-	u32 base = block->start / PAGE_SIZE;
-	u32 end = block->end / PAGE_SIZE;
-
-	for (u32 i = base; i <= end; i++)
+	u32 runStart = first;
+	for (u32 page = first; page <= last + 1; page++)
 	{
-		std::vector<vram_block*>& list = VramLocks[i];
-		for (auto& lock : list)
+		bool acquired = false;
+		while (page <= last)
+		{
+			u8 state = VramPageState[page].load();
+			if (state == PageProtected)
+				break;
+			if (state == PageUnprotected)
+			{
+				if (VramPageState[page].compare_exchange_weak(state, PageProtecting))
+				{
+					acquired = true;
+					break;
+				}
+			}
+			else
+				// Another thread is changing the protection of this page
+				std::this_thread::yield();
+		}
+		if (acquired)
+			continue;
+		if (runStart < page)
 		{
-			if (lock == block)
-				lock = nullptr;
+			_vmem_protect_vram(runStart * PAGE_SIZE, (page - runStart) * PAGE_SIZE);
+			for (u32 i = runStart; i < page; i++)
+				VramPageState[i].store(PageProtected);
 		}
+		runStart = page + 1;
 	}
 }
- 
-static void vramlock_list_add(vram_block* block)
-{
-	u32 base = block->start / PAGE_SIZE;
-	u32 end = block->end / PAGE_SIZE;
 
-	for (u32 i = base; i <= end; i++)
+// Unprotects pages [first, last] and marks them as written
+static void vramlock_unprotect_pages(u32 first, u32 last)
+{
+	for (u32 page = first; page <= last; page++)
 	{
-		std::vector<vram_block*>& list = VramLocks[i];
-		// If the list is empty then we need to protect vram, otherwise it's already been done
-		if (list.empty() || std::all_of(list.begin(), list.end(), [](vram_block *block) { return block == nullptr; }))
-			_vmem_protect_vram(i * PAGE_SIZE, PAGE_SIZE);
-		auto it = std::find(list.begin(), list.end(), nullptr);
-		if (it != list.end())
-			*it = block;
-		else
-			list.push_back(block);
+		while (true)
+		{
+			u8 state = VramPageState[page].load();
+			if (state == PageProtecting || state == PageUnprotecting)
+				std::this_thread::yield();
+			else if (VramPageState[page].compare_exchange_weak(state, PageUnprotecting))
+				break;
+		}
+	}
+	_vmem_unprotect_vram(first * PAGE_SIZE, (last - first + 1) * PAGE_SIZE);
+	const u32 gen = VramWriteGen.fetch_add(1) + 1;
+	for (u32 page = first; page <= last; page++)
+	{
+		VramPageGen[page].store(gen);
+		VramPageState[page].store(PageUnprotected);
 	}
 }
- 
-static std::mutex vramlist_lock;
 
 bool VramLockedWriteOffset(size_t offset)
 {
 	if (offset >= VRAM_SIZE)
 		return false;
 
-	size_t addr_hash = offset / PAGE_SIZE;
-	std::vector<vram_block *>& list = VramLocks[addr_hash];
-
-	{
-		std::lock_guard<std::mutex> lockguard(vramlist_lock);
-
-		for (auto& lock : list)
-		{
-			if (lock != nullptr)
-			{
-				lock->texture->invalidate();
-
-				if (lock != nullptr)
-				{
-					ERROR_LOG(PVR, "Error : pvr is supposed to remove lock");
-					die("Invalid state");
-				}
-			}
-		}
-		list.clear();
-
-		_vmem_unprotect_vram((u32)(offset & ~PAGE_MASK), PAGE_SIZE);
-	}
+	u32 page = (u32)(offset / PAGE_SIZE);
+	vramlock_unprotect_pages(page, page);
 
 	return true;
 }
@@ -251,12 +282,12 @@ bool VramLockedWrite(u8* address)
 	return VramLockedWriteOffset(offset);
 }
 
-//unlocks mem
-//also frees the handle
-static void libCore_vramlock_Unlock_block_wb(vram_block* block)
+void VramLockedWriteRange(u32 offset, u32 size)
 {
-	vramlock_list_remove(block);
-	delete block;
+	if (size == 0 || offset >= VRAM_SIZE)
+		return;
+	u32 end = std::min(offset + size, VRAM_SIZE) - 1;
+	vramlock_unprotect_pages(offset / PAGE_SIZE, end / PAGE_SIZE);
 }
 
 #ifdef _OPENMP
@@ -397,7 +428,10 @@ void BaseTextureCacheData::PrintTextureName()
 
 //true if : dirty or paletted texture and hashes don't match
 bool BaseTextureCacheData::NeedsUpdate() {
-	bool rc = dirty != 0;
+	if (decoded != nullptr)
+		// decoded but not uploaded yet
+		return true;
+	bool rc = IsDirty();
 	if (tex_type != TextureType::_8)
 	{
 		if (tcw.PixelFmt == PixelPal4 && palette_hash != pal_hash_16[tcw.PalSelect])
@@ -423,37 +457,35 @@ void BaseTextureCacheData::protectVRam()
 		WARN_LOG(PVR, "vramlock_Lock: sa_tex > end. Tried to lock negative block");
 		return;
 	}
-
-	vram_block *block = new vram_block();
-	block->end = end;
-	block->start = sa_tex;
-	block->texture = this;
-
-	{
-		std::lock_guard<std::mutex> lock(vramlist_lock);
-
-		if (lock_block == nullptr)
-		{
-			// This also protects vram if needed
-			vramlock_list_add(block);
-			lock_block = block;
-		}
-		else
-			delete block;
-	}
+	lockStart = sa_tex / PAGE_SIZE;
+	lockEnd = end / PAGE_SIZE;
+	vramlock_protect_pages(lockStart, lockEnd);
+	vramLocked = true;
 }
 
 void BaseTextureCacheData::unprotectVRam()
 {
-	std::lock_guard<std::mutex> lock(vramlist_lock);
-	if (lock_block)
-		libCore_vramlock_Unlock_block_wb(lock_block);
-	lock_block = nullptr;
+	// The pages stay protected until written to
+	vramLocked = false;
+}
+
+bool BaseTextureCacheData::IsDirty()
+{
+	if (dirty != 0 || !vramLocked || VramWriteGen.load() == vramGen)
+		return dirty != 0;
+	for (u32 page = lockStart; page <= lockEnd; page++)
+		if (VramPageGen[page].load() > vramGen)
+		{
+			invalidate();
+			return true;
+		}
+	return false;
 }
 
 bool BaseTextureCacheData::Delete()
 {
 	unprotectVRam();
+	decoded.reset();
 
 	if (custom_load_in_progress > 0)
 		return false;
@@ -472,7 +504,9 @@ BaseTextureCacheData::BaseTextureCacheData(TSP tsp, TCW tcw)
 	//Reset state info ..
 	Updates = 0;
 	dirty = FrameCount;
-	lock_block = nullptr;
+	vramLocked = false;
+	vramGen = 0;
+	lockStart = lockEnd = 0;
 	custom_image_data = nullptr;
 	custom_load_in_progress = 0;
 	gpuPalette = false;
@@ -559,15 +593,22 @@ void BaseTextureCacheData::ComputeHash()
 	}
 	texture_hash = XXH32(&vram[sa], hashSize, 7);
 	if (IsPaletted())
-		texture_hash ^= palette_hash;
+	{
+		// Custom texture packs expect the legacy XXH32 palette hash
+		if (tcw.PixelFmt == PixelPal4)
+			texture_hash ^= XXH32(&PALETTE_RAM[tcw.PalSelect << 4], 16 * 4, 7);
+		else
+			texture_hash ^= XXH32(&PALETTE_RAM[(tcw.PalSelect >> 4) << 8], 256 * 4, 7);
+	}
 	old_texture_hash = texture_hash;
 	// Include everything but texaddr, reserved and stride. Palette textures don't have ScanOrder
 	const u32 tcwMask = IsPaletted() ? 0xF8000000 : 0xFC000000;
 	texture_hash ^= tcw.full & tcwMask;
 }
 
-void BaseTextureCacheData::Update()
+void BaseTextureCacheData::Decode()
 {
+	decoded.reset(new Decoded());
 	//texture state tracking stuff
 	Updates++;
 	dirty = 0;
@@ -625,20 +666,20 @@ void BaseTextureCacheData::Update()
 		else
 		{
 			WARN_LOG(RENDERER, "Warning: invalid texture. Address %08X %08X size %d", sa_tex, sa, size);
-			unprotectVRam();
 			return;
 		}
 	}
-	if (config::CustomTextures)
-		custom_texture.LoadCustomTextureAsync(this);
+	// Writes to vram after this point will invalidate the texture
+	vramGen = VramWriteGen.load();
+	protectVRam();
 
 	void *temp_tex_buffer = NULL;
 	u32 upscaled_w = width;
 	u32 upscaled_h = height;
 
-	PixelBuffer<u16> pb16;
-	PixelBuffer<u32> pb32;
-	PixelBuffer<u8> pb8;
+	PixelBuffer<u16>& pb16 = decoded->pb16;
+	PixelBuffer<u32>& pb32 = decoded->pb32;
+	PixelBuffer<u8>& pb8 = decoded->pb8;
 
 	// Figure out if we really need to use a 32-bit pixel buffer
 	bool textureUpscaling = config::TextureUpscale > 1
@@ -782,19 +823,50 @@ void BaseTextureCacheData::Update()
 	// Restore the original texture height if it was constrained to VRAM limits above
 	height = original_h;
 
-	//lock the texture to detect changes in it
-	protectVRam();
+	decoded->data = (u8 *)temp_tex_buffer;
+	decoded->width = upscaled_w;
+	decoded->height = upscaled_h;
+	decoded->mipmapped = mipmapped;
+}
 
-	UploadToGPU(upscaled_w, upscaled_h, (const u8 *)temp_tex_buffer, IsMipmapped(), mipmapped);
+void BaseTextureCacheData::Update()
+{
+	if (decoded == nullptr)
+		Decode();
+	std::unique_ptr<Decoded> result = std::move(decoded);
+	if (result->data == nullptr)
+	{
+		// invalid texture
+		unprotectVRam();
+		return;
+	}
+	if (config::CustomTextures)
+		custom_texture.LoadCustomTextureAsync(this);
+
+	UploadToGPU(result->width, result->height, result->data, IsMipmapped(), result->mipmapped);
 	if (config::DumpTextures)
 	{
 		ComputeHash();
-		custom_texture.DumpTexture(texture_hash, upscaled_w, upscaled_h, tex_type, temp_tex_buffer);
+		custom_texture.DumpTexture(texture_hash, result->width, result->height, tex_type, result->data);
 		NOTICE_LOG(RENDERER, "Dumped texture %x.png. Old hash %x", texture_hash, old_texture_hash);
 	}
 	PrintTextureName();
 }
 
+void decodeTextures(const std::vector<BaseTextureCacheData *>& textures)
+{
+#ifdef _OPENMP
+	// A single texture is decoded by Update()
+	if (textures.size() < 2)
+		return;
+	const int tcount = std::min(getThreadCount(), (int)textures.size());
+#pragma omp parallel for num_threads(tcount) schedule(dynamic, 1)
+	for (int i = 0; i < (int)textures.size(); i++)
+		textures[i]->Decode();
+#endif
+}
+
+
 void BaseTextureCacheData::CheckCustomTexture()
 {
 	if (IsCustomTextureAvailable())
@@ -946,6 +1018,9 @@ void WriteTextureToVRam(u32 width, u32 height, const u8 *data, u16 *dst, FB_W_CT
 	else
 		padding = 0;
 
+	// Unprotect the destination at once instead of faulting on each page
+	VramLockedWriteRange((u32)((u8 *)dst - vram.data), height * (width + padding) * 2);
+
 	const u16 kval_bit = (fb_w_ctrl.fb_kval & 0x80) << 8;
 	const u8 fb_alpha_threshold = fb_w_ctrl.fb_alpha_threshold;
 
@@ -1119,9 +1194,7 @@ template void WriteFramebuffer<2, 1, 0, 3>(u32 width, u32 height, const u8 *data
 void BaseTextureCacheData::invalidate()
 {
 	dirty = FrameCount;
-
-	libCore_vramlock_Unlock_block_wb(lock_block);
-	lock_block = nullptr;
+	vramLocked = false;
 }
 
 void getRenderToTextureDimensions(u32& width, u32& height, u32& pow2Width, u32& pow2Height)
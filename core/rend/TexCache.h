@@ -6,18 +6,27 @@
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <utility>
-
-extern const u8 *vq_codebook;
-extern u32 palette_index;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEX_SIMD_SSE2
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define TEX_SIMD_NEON
+#endif
+
+// Set by the thread decoding a texture
+extern thread_local const u8 *vq_codebook;
+extern thread_local u32 palette_index;
 extern u32 palette16_ram[1024];
 extern u32 palette32_ram[1024];
 extern bool fog_needs_update;
-extern u32 pal_hash_256[4];
-extern u32 pal_hash_16[64];
+extern u64 pal_hash_256[4];
+extern u64 pal_hash_16[64];
 extern bool KillTex;
 extern bool palette_updated;
 
@@ -108,6 +117,11 @@ public:
 		p_current_pixel[y * pixels_per_line + x] = value;
 	}
 
+	pixel_type *rel(u32 y)
+	{
+		return p_current_pixel + y * pixels_per_line;
+	}
+
 	void rmovex(u32 value)
 	{
 		p_current_pixel += value;
@@ -163,6 +177,9 @@ struct UnpackerNop {
 	static Pixel unpack(Pixel word) {
 		return word;
 	}
+	static auto lookup() {
+		return [](Pixel word) { return word; };
+	}
 };
 // ARGB1555 to RGBA5551
 struct Unpacker1555 {
@@ -278,6 +295,48 @@ struct ConvertPlanarYUV
 	}
 };
 
+// Twiddled index of each pixel of a 4x4 block, in row order
+constexpr u8 TwiddledBlock4x4[16] = {
+	0, 2, 8, 10,
+	1, 3, 9, 11,
+	4, 6, 12, 14,
+	5, 7, 13, 15,
+};
+
+// Reorders a 4x4 block of twiddled 16-bit pixels in row order
+static inline void detwiddleBlock16(const u8 *data, u16 out[16])
+{
+#if defined(TEX_SIMD_SSE2)
+	// Even pixels go to rows 0 and 2, odd pixels to rows 1 and 3
+	__m128i a = _mm_loadu_si128((const __m128i *)data);
+	__m128i b = _mm_loadu_si128((const __m128i *)(data + 16));
+	a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+	b = _mm_shufflehi_epi16(_mm_shufflelo_epi16(b, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+	a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+	b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+	__m128i rows02 = _mm_unpacklo_epi32(a, b);
+	__m128i rows13 = _mm_unpackhi_epi32(a, b);
+	_mm_storel_epi64((__m128i *)&out[0], rows02);
+	_mm_storel_epi64((__m128i *)&out[4], rows13);
+	_mm_storel_epi64((__m128i *)&out[8], _mm_unpackhi_epi64(rows02, rows02));
+	_mm_storel_epi64((__m128i *)&out[12], _mm_unpackhi_epi64(rows13, rows13));
+#elif defined(TEX_SIMD_NEON)
+	uint16x8x2_t evenOdd = vuzpq_u16(vld1q_u16((const u16 *)data), vld1q_u16((const u16 *)(data + 16)));
+	uint32x4_t even = vreinterpretq_u32_u16(evenOdd.val[0]);
+	uint32x4_t odd = vreinterpretq_u32_u16(evenOdd.val[1]);
+	uint32x4x2_t rows02 = vuzpq_u32(even, even);
+	uint32x4x2_t rows13 = vuzpq_u32(odd, odd);
+	vst1_u16(&out[0], vreinterpret_u16_u32(vget_low_u32(rows02.val[0])));
+	vst1_u16(&out[4], vreinterpret_u16_u32(vget_low_u32(rows13.val[0])));
+	vst1_u16(&out[8], vreinterpret_u16_u32(vget_low_u32(rows02.val[1])));
+	vst1_u16(&out[12], vreinterpret_u16_u32(vget_low_u32(rows13.val[1])));
+#else
+	const u16 *p_in = (const u16 *)data;
+	for (int i = 0; i < 16; i++)
+		out[i] = p_in[TwiddledBlock4x4[i]];
+#endif
+}
+
 template<typename Unpacker>
 struct ConvertTwiddle
 {
@@ -292,6 +351,18 @@ struct ConvertTwiddle
 		pb->prel(1, 0, Unpacker::unpack(p_in[2]));
 		pb->prel(1, 1, Unpacker::unpack(p_in[3]));
 	}
+	// Converts a 4x4 block
+	static void ConvertBlock(PixelBuffer<unpacked_type> *pb, const u8 *data)
+	{
+		u16 pixels[16];
+		detwiddleBlock16(data, pixels);
+		for (u32 y = 0; y < 4; y++)
+		{
+			unpacked_type *row = pb->rel(y);
+			for (u32 x = 0; x < 4; x++)
+				row[x] = Unpacker::unpack(pixels[y * 4 + x]);
+		}
+	}
 };
 
 template<typename Packer>
@@ -338,6 +409,12 @@ struct UnpackerPalToRgb {
 		u32 *pal = sizeof(Pixel) == 2 ? &palette16_ram[palette_index] : &palette32_ram[palette_index];
 		return pal[col];
 	}
+	// Returns a function that looks up the current palette
+	static auto lookup()
+	{
+		const u32 *pal = sizeof(Pixel) == 2 ? &palette16_ram[palette_index] : &palette32_ram[palette_index];
+		return [pal](u8 col) { return (Pixel)pal[col]; };
+	}
 };
 
 template<typename Unpacker>
@@ -392,6 +469,20 @@ struct ConvertTwiddlePal8
 		pb->prel(1, 2, Unpacker::unpack(p_in[0])); p_in++;
 		pb->prel(1, 3, Unpacker::unpack(p_in[0])); p_in++;
 	}
+	// Converts a 4x4 block
+	static void ConvertBlock(PixelBuffer<unpacked_type> *pb, const u8 *data)
+	{
+		const auto lookup = Unpacker::lookup();
+		for (u32 y = 0; y < 4; y++)
+		{
+			unpacked_type *row = pb->rel(y);
+			const u8 *twiddled = &TwiddledBlock4x4[y * 4];
+			row[0] = lookup(data[twiddled[0]]);
+			row[1] = lookup(data[twiddled[1]]);
+			row[2] = lookup(data[twiddled[2]]);
+			row[3] = lookup(data[twiddled[3]]);
+		}
+	}
 };
 
 //handler functions
@@ -417,6 +508,11 @@ void texture_PL(PixelBuffer<typename PixelConvertor::unpacked_type>* pb, const u
 	}
 }
 
+template<typename PixelConvertor, typename = void>
+struct HasBlockConvert : std::false_type {};
+template<typename PixelConvertor>
+struct HasBlockConvert<PixelConvertor, decltype(PixelConvertor::ConvertBlock(nullptr, nullptr))> : std::true_type {};
+
 template<class PixelConvertor>
 void texture_TW(PixelBuffer<typename PixelConvertor::unpacked_type>* pb, const u8* p_in, u32 Width, u32 Height)
 {
@@ -427,6 +523,27 @@ void texture_TW(PixelBuffer<typename PixelConvertor::unpacked_type>* pb, const u
 	const u32 bcx = bitscanrev(Width);
 	const u32 bcy = bitscanrev(Height);
 
+	if constexpr (HasBlockConvert<PixelConvertor>::value)
+	{
+		// 4x4 blocks are contiguous in twiddled order
+		if (Width >= 4 && Height >= 4)
+		{
+			for (u32 y = 0; y < Height; y += 4)
+			{
+				const u32 rowOffset = detwiddle[1][bcx][y];
+				for (u32 x = 0; x < Width; x += 4)
+				{
+					const u8* p = &p_in[((detwiddle[0][bcy][x] + rowOffset) / divider) << 3];
+					PixelConvertor::ConvertBlock(pb, p);
+
+					pb->rmovex(4);
+				}
+				pb->rmovey(4);
+			}
+			return;
+		}
+	}
+
 	for (u32 y = 0; y < Height; y += PixelConvertor::ypp)
 	{
 		for (u32 x = 0; x < Width; x += PixelConvertor::xpp)
@@ -556,18 +673,10 @@ constexpr TexConvFP32 tex1555_VQ32 = texture_VQ<ConvertTwiddle<Unpacker1555_32<B
 constexpr TexConvFP32 tex4444_VQ32 = texture_VQ<ConvertTwiddle<Unpacker4444_32<BGRAPacker>>>;
 }
 
-class BaseTextureCacheData;
-
-struct vram_block
-{
-	u32 start;
-	u32 end;
-
-	BaseTextureCacheData *texture;
-};
-
 bool VramLockedWriteOffset(size_t offset);
 bool VramLockedWrite(u8* address);
+// Unprotects a vram range that is about to be written to, and invalidates the textures it contains
+void VramLockedWriteRange(u32 offset, u32 size);
 
 void UpscalexBRZ(int factor, u32* source, u32* dest, int width, int height, bool has_alpha);
 
@@ -587,7 +696,11 @@ public:
 		tex_type = other.tex_type;
 		sa_tex = other.sa_tex;
 		dirty = other.dirty;
-		std::swap(lock_block, other.lock_block);
+		vramLocked = other.vramLocked;
+		other.vramLocked = false;
+		vramGen = other.vramGen;
+		lockStart = other.lockStart;
+		lockEnd = other.lockEnd;
 		sa = other.sa;
 		width = other.width;
 		height = other.height;
@@ -605,6 +718,7 @@ public:
 		custom_height = other.custom_height;
 		custom_load_in_progress = 0;
 		gpuPalette = other.gpuPalette;
+		std::swap(decoded, other.decoded);
 	}
 
 	TSP tsp;        	//dreamcast texture parameters
@@ -615,7 +729,10 @@ public:
 	u32 sa_tex;			// texture data start address in vram
 
 	u32 dirty;			// frame number at which texture was overwritten
-	vram_block* lock_block;
+	bool vramLocked;	// vram writes to the texture pages are tracked
+	u32 vramGen;		// vram write generation when the texture was decoded
+	u32 lockStart;		// first and last tracked vram pages
+	u32 lockEnd;
 
 	u32 sa;         	// pixel data start address of max level mipmap
 	u16 width, height;	// width & height of the texture
@@ -629,7 +746,7 @@ public:
 	u32 Updates;
 
 	//used for palette updates
-	u32 palette_hash;			// Palette hash at time of last update
+	u64 palette_hash;			// Palette hash at time of last update
 	u32 texture_hash;			// xxhash of texture data, used for custom textures
 	u32 old_texture_hash;		// legacy hash
 	u8* custom_image_data;		// loaded custom image data
@@ -638,6 +755,19 @@ public:
 	std::atomic_int custom_load_in_progress;
 	bool gpuPalette;
 
+	// Texture data decoded by Decode() and not uploaded yet
+	struct Decoded
+	{
+		PixelBuffer<u16> pb16;
+		PixelBuffer<u32> pb32;
+		PixelBuffer<u8> pb8;
+		u8 *data = nullptr;		// null if the texture is invalid
+		u32 width = 0;
+		u32 height = 0;
+		bool mipmapped = false;
+	};
+	std::unique_ptr<Decoded> decoded;
+
 	void PrintTextureName();
 	virtual std::string GetId() = 0;
 
@@ -672,6 +802,9 @@ public:
 	}
 
 	void ComputeHash();
+	// Decodes the texture data. Can be called on any thread.
+	void Decode();
+	// Decodes the texture if needed and uploads it
 	void Update();
 	virtual void UploadToGPU(int width, int height, const u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) = 0;
 	virtual bool Force32BitTexture(TextureType type) const { return false; }
@@ -683,6 +816,8 @@ public:
 	void protectVRam();
 	void unprotectVRam();
 	void invalidate();
+	// Checks if the vram pages of the texture have been written to since it was decoded
+	bool IsDirty();
 
 	static bool IsGpuHandledPaletted(TSP tsp, TCW tcw)
 	{
@@ -699,6 +834,9 @@ public:
 	static void SetDirectXColorOrder(bool enabled);
 };
 
+// Decodes the textures concurrently, ahead of their Update()
+void decodeTextures(const std::vector<BaseTextureCacheData *>& textures);
+
 // TODO Split the texture cache in a separate header
 #include "CustomTexture.h"
 
@@ -766,15 +904,37 @@ public:
 		return getTextureCacheData(tsp, tcw);
 	}
 
+	// Decodes the textures that need an update on worker threads.
+	// beforeDecode is called on each texture first.
+	template<typename Func>
+	void Prefetch(const std::vector<std::pair<TSP, TCW>>& textures, Func beforeDecode)
+	{
+		std::vector<BaseTextureCacheData *> updates;
+		for (const auto& pair : textures)
+		{
+			Texture *texture = getTextureCacheData(pair.first, pair.second);
+			beforeDecode(texture);
+			if (texture->decoded == nullptr && texture->NeedsUpdate())
+				updates.push_back(texture);
+		}
+		std::sort(updates.begin(), updates.end());
+		updates.erase(std::unique(updates.begin(), updates.end()), updates.end());
+		decodeTextures(updates);
+	}
+
+	void Prefetch(const std::vector<std::pair<TSP, TCW>>& textures) {
+		Prefetch(textures, [](Texture *) {});
+	}
+
 	void CollectCleanup()
 	{
 		std::vector<u64> list;
 
 		u32 TargetFrame = std::max((u32)120, FrameCount) - 120;
 
-		for (const auto& pair : cache)
+		for (auto& pair : cache)
 		{
-			if (pair.second.dirty && pair.second.dirty < TargetFrame)
+			if (pair.second.IsDirty() && pair.second.dirty < TargetFrame)
 				list.push_back(pair.first);
 
 			if (list.size() > 5)
@@ -286,6 +286,11 @@ bool DX11Renderer::ensureBufferSize(ComPtr<ID3D11Buffer>& buffer, D3D11_BIND_FLA
     return SUCCEEDED(device->CreateBuffer(&desc, nullptr, &buffer.get()));
 }
 
+void DX11Renderer::PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures)
+{
+	texCache.Prefetch(textures);
+}
+
 BaseTextureCacheData *DX11Renderer::GetTexture(TSP tsp, TCW tcw)
 {
 	//lookup texture
@@ -53,6 +53,7 @@ struct DX11Renderer : public Renderer
 	bool RenderLastFrame() override;
 	void DrawOSD(bool clear_screen) override;
 	BaseTextureCacheData *GetTexture(TSP tsp, TCW tcw) override;
+	void PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures) override;
 
 protected:
 	struct VertexConstants
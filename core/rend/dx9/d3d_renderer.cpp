@@ -213,6 +213,12 @@ void D3DRenderer::Term()
 	device.reset();
 }
 
+void D3DRenderer::PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures)
+{
+	if (theDXContext.isReady())
+		texCache.Prefetch(textures);
+}
+
 BaseTextureCacheData *D3DRenderer::GetTexture(TSP tsp, TCW tcw)
 {
 	if (!theDXContext.isReady())
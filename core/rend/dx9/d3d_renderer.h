@@ -113,6 +113,7 @@ struct D3DRenderer : public Renderer
 	}
 	void DrawOSD(bool clear_screen) override;
 	BaseTextureCacheData *GetTexture(TSP tsp, TCW tcw) override;
+	void PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures) override;
 	void preReset();
 	void postReset();
 	void RenderFramebuffer(const FramebufferInfo& info) override;
@@ -426,6 +426,7 @@ struct OpenGLRenderer : Renderer
 	void DrawOSD(bool clear_screen) override;
 
 	BaseTextureCacheData *GetTexture(TSP tsp, TCW tcw) override;
+	void PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures) override;
 
 	bool Present() override
 	{
@@ -213,12 +213,7 @@ void ReadRTTBuffer()
 #ifdef TARGET_VIDEOCORE
 		// Remove all vram locks before calling glReadPixels
 		// (deadlock on rpi)
-		u32 size = w * h * 2;
-		u32 page_tex_addr = tex_addr & PAGE_MASK;
-		u32 page_size = size + tex_addr - page_tex_addr;
-		page_size = ((page_size - 1) / PAGE_SIZE + 1) * PAGE_SIZE;
-		for (u32 page = page_tex_addr; page < page_tex_addr + page_size; page += PAGE_SIZE)
-			VramLockedWriteOffset(page);
+		VramLockedWriteRange(tex_addr, w * h * 2);
 #endif
 
 #ifdef GL_PIXEL_PACK_BUFFER
@@ -326,6 +321,13 @@ static int TexCacheLookups;
 static int TexCacheHits;
 //static float LastTexCacheStats;
 
+void OpenGLRenderer::PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures)
+{
+	TexCache.Prefetch(textures, [](TextureCacheData *tf) {
+		readAsyncPixelBuffer(tf->sa_tex);
+	});
+}
+
 BaseTextureCacheData *OpenGLRenderer::GetTexture(TSP tsp, TCW tcw)
 {
 	TexCacheLookups++;
@@ -1948,10 +1948,14 @@ static void gui_display_settings()
 			ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, normal_padding);
 			OptionCheckbox("Enable DSP", config::DSPEnabled,
 					"Enable the Dreamcast Digital Sound Processor. Only recommended on fast platforms");
+			OptionCheckbox("Threaded Sound", config::ThreadedAica,
+					"Run the sound CPU and sound generation on a separate thread. Disabled during netplay");
 			if (OptionSlider("Volume Level", config::AudioVolume, 0, 100, "Adjust the emulator's audio level"))
 			{
 				config::AudioVolume.calcDbPower();
 			};
+			OptionCheckbox("Sync to Video", config::AudioSyncToVideo,
+					"Let the video refresh rate pace the emulation, and resample the audio to match. Requires VSync");
 #ifdef __ANDROID__
 			if (config::AudioBackend.get() == "auto" || config::AudioBackend.get() == "android")
 				OptionCheckbox("Automatic Latency", config::AutoLatency,
@@ -2073,6 +2077,12 @@ static void gui_display_settings()
 		    	ImGui::Spacing();
 		    	header("Dynarec Options");
 		    	OptionCheckbox("Idle Skip", config::DynarecIdleSkip, "Skip wait loops. Recommended");
+		    	OptionCheckbox("Background Compilation", config::DynarecAsyncCompile,
+		    			"Compile new code on a separate thread and interpret it in the meantime. Reduces stuttering");
+		    	OptionCheckbox("Persistent Block Cache", config::DynarecPersistentCache,
+		    			"Save the decoded code of each game to disk and reuse it at the next start");
+		    	OptionCheckbox("Superblocks", config::DynarecSuperblocks,
+		    			"Recompile frequently executed code into larger blocks. x64 only");
 		    }
 	    	ImGui::Spacing();
 		    header("Network");
@@ -2157,6 +2167,10 @@ static void gui_display_settings()
 	            		"Enable full MMU emulation and other Windows CE settings. Do not enable unless necessary");
 	            OptionCheckbox("Multi-threaded emulation", config::ThreadedRendering,
 	            		"Run the emulated CPU and GPU on different threads");
+#ifdef _OPENMP
+	            OptionCheckbox("Multi-threaded TA parsing", config::ParallelTAParsing,
+	            		"Decode the display lists of complex scenes on several threads");
+#endif
 #ifndef __ANDROID
 	            OptionCheckbox("Serial Console", config::SerialConsole,
 	            		"Dump the Dreamcast serial console to stdout");
@@ -0,0 +1,1132 @@
+/*
+	Tile-based software rasterizer
+*/
+#include "soft_raster.h"
+#include "cfg/option.h"
+#include "hw/pvr/pvr_regs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RASTER_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace soft
+{
+
+constexpr u32 NoTag = ~0u;
+constexpr float PI = 3.14159265358979323846f;
+
+// Per-frame TSP state, read-only while tiles are rendered
+static struct
+{
+	float fogColRam[3];
+	float fogColVert[3];
+	float fogDensity;
+	u8 fogTable[128][2];
+	bool colorClamp;
+	float clampMin[4];
+	float clampMax[4];
+	float ptAlphaRef;
+	float shadowScale;
+	float cullValue;
+	// Channel holding red in vertex colors and texels
+	int red;
+} frameState;
+
+static void getColor(const RGBAColorTemplate<RGBColor>& color, float out[3])
+{
+	color.getRGBColor(out);
+	if (frameState.red != 0)
+		std::swap(out[0], out[2]);
+}
+
+static void getColor(const RGBAColorTemplate<RGBAColor>& color, float out[4])
+{
+	color.getRGBAColor(out);
+	if (frameState.red != 0)
+		std::swap(out[0], out[2]);
+}
+
+static inline float clamp01(float v) {
+	return std::min(std::max(v, 0.f), 1.f);
+}
+
+static inline s64 floorDiv(s64 n, s64 d)
+{
+	// d > 0
+	return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+static inline s64 ceilDiv(s64 n, s64 d) {
+	return -floorDiv(-n, d);
+}
+
+// Same lookup as the fog_mode2() shader function of the GL renderers
+static float fogMode2(float z)
+{
+	float fz = std::min(std::max(frameState.fogDensity * z, 1.f), 255.9999f);
+	int exp = (int)std::floor(std::log2(fz));
+	float m = fz * 16.f / (float)(1 << exp) - 16.f;
+	int idx = std::min((int)m + exp * 16, 127);
+	float f = m - std::floor(m);
+	return (frameState.fogTable[idx][1] * (1.f - f) + frameState.fogTable[idx][0] * f) / 255.f;
+}
+
+//
+// Textures
+//
+void SoftTexture::UploadToGPU(int width, int height, const u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded)
+{
+	indexed = tex_type == TextureType::_8;
+	if (tex_type != TextureType::_8888 && !indexed)
+	{
+		// Force32BitTexture() should prevent this
+		WARN_LOG(RENDERER, "Unsupported texture type %d", (int)tex_type);
+		levelCount = 0;
+		return;
+	}
+	const u32 bpp = indexed ? 1 : 4;
+	if (mipmapsIncluded && width == height)
+	{
+		levelCount = 0;
+		for (int dim = width; dim != 0; dim >>= 1)
+			levelCount++;
+		texels.resize((width * width * 4 - 1) / 3);
+		// Levels are provided from the smallest to the largest
+		const u8 *src = temp_tex_buffer;
+		u32 offset = (u32)texels.size();
+		for (int i = 0; i < levelCount; i++)
+		{
+			u32 dim = 1 << i;
+			Level& level = levels[levelCount - 1 - i];
+			offset -= dim * dim;
+			level = { dim, dim, offset };
+			if (indexed)
+				for (u32 p = 0; p < dim * dim; p++)
+					texels[offset + p] = src[p];
+			else
+				memcpy(&texels[offset], src, dim * dim * 4);
+			src += dim * dim * bpp;
+		}
+	}
+	else
+	{
+		levelCount = 1;
+		levels[0] = { (u32)width, (u32)height, 0 };
+		texels.resize(width * height);
+		if (indexed)
+			for (int p = 0; p < width * height; p++)
+				texels[p] = temp_tex_buffer[p];
+		else
+			memcpy(texels.data(), temp_tex_buffer, width * height * 4);
+	}
+}
+
+bool SoftTexture::Delete()
+{
+	if (!BaseTextureCacheData::Delete())
+		return false;
+	std::vector<u32>().swap(texels);
+	levelCount = 0;
+
+	return true;
+}
+
+static inline int wrapCoord(int c, int size, bool clamp, bool flip)
+{
+	if (clamp)
+		return std::min(std::max(c, 0), size - 1);
+	if (flip)
+	{
+		const int period = size * 2;
+		c %= period;
+		if (c < 0)
+			c += period;
+		return c < size ? c : period - 1 - c;
+	}
+	c %= size;
+	return c < 0 ? c + size : c;
+}
+
+static inline void unpackTexel(u32 texel, float out[4])
+{
+	out[0] = (texel & 0xff) / 255.f;
+	out[1] = ((texel >> 8) & 0xff) / 255.f;
+	out[2] = ((texel >> 16) & 0xff) / 255.f;
+	out[3] = (texel >> 24) / 255.f;
+}
+
+//
+// Shading state of a triangle, derived from its polygon parameters
+//
+struct ShadeSetup
+{
+	u32 tri = NoTag;
+	bool volume1 = false;
+	TSP tsp;
+	const SoftTexture *texture;
+	u32 paletteBase;
+	bool gouraud;
+	bool offset;
+	bool bumpMap;
+	bool punchThrough;
+	float lodBias;
+	// Attributes multiplied by 1/w as planes: u, v, base color, offset color
+	float attrA[10];
+	float attrB[10];
+	float attrC[10];
+	float flat[8];
+	float zA, zB, zC;
+};
+
+static void setupShading(ShadeSetup& s, const Triangle& tri, u32 index, bool volume1)
+{
+	const PolyParam *pp = tri.pp;
+	s.tri = index;
+	s.volume1 = volume1;
+	s.tsp = volume1 ? pp->tsp1 : pp->tsp;
+	TCW tcw = volume1 ? pp->tcw1 : pp->tcw;
+	BaseTextureCacheData *texture = volume1 ? pp->texture1 : pp->texture;
+	s.texture = pp->pcw.Texture && texture != nullptr ? (const SoftTexture *)texture : nullptr;
+	if (s.texture != nullptr && s.texture->levelCount == 0)
+		s.texture = nullptr;
+	s.paletteBase = tcw.PixelFmt == PixelPal4 ? tcw.PalSelect << 4 : (tcw.PalSelect >> 4) << 8;
+	s.gouraud = pp->pcw.Gouraud;
+	s.offset = pp->pcw.Offset;
+	s.bumpMap = tcw.PixelFmt == PixelBumpMap;
+	s.punchThrough = tri.listType == ListType_Punch_Through;
+	s.lodBias = D_Adjust_LoD_Bias[s.tsp.MipMapD];
+	s.zA = tri.zA;
+	s.zB = tri.zB;
+	s.zC = tri.zC;
+
+	float attr[3][10];
+	for (int i = 0; i < 3; i++)
+	{
+		const Vertex& v = *tri.v[i];
+		attr[i][0] = volume1 ? v.u1 : v.u;
+		attr[i][1] = volume1 ? v.v1 : v.v;
+		const u8 *col = volume1 ? v.col1 : v.col;
+		const u8 *spc = volume1 ? v.spc1 : v.spc;
+		for (int c = 0; c < 4; c++)
+		{
+			attr[i][2 + c] = col[c] / 255.f;
+			attr[i][6 + c] = spc[c] / 255.f;
+		}
+	}
+	for (int a = 0; a < 10; a++)
+	{
+		s.attrA[a] = s.attrB[a] = s.attrC[a] = 0.f;
+		for (int i = 0; i < 3; i++)
+		{
+			const float za = attr[i][a] * tri.v[i]->z;
+			s.attrA[a] += tri.baryA[i] * za;
+			s.attrB[a] += tri.baryB[i] * za;
+			s.attrC[a] += tri.baryC[i] * za;
+		}
+	}
+	const u8 *col = volume1 ? tri.flat->col1 : tri.flat->col;
+	const u8 *spc = volume1 ? tri.flat->spc1 : tri.flat->spc;
+	for (int c = 0; c < 4; c++)
+	{
+		s.flat[c] = col[c] / 255.f;
+		s.flat[4 + c] = spc[c] / 255.f;
+	}
+}
+
+static inline u32 fetchTexel(const ShadeSetup& s, const SoftTexture::Level& level, int x, int y)
+{
+	x = wrapCoord(x, level.width, s.tsp.ClampU, s.tsp.FlipU);
+	y = wrapCoord(y, level.height, s.tsp.ClampV, s.tsp.FlipV);
+	u32 texel = s.texture->texels[level.offset + y * level.width + x];
+	if (s.texture->indexed)
+		texel = palette32_ram[(s.paletteBase + texel) & 1023];
+	return texel;
+}
+
+static void sampleTexture(const ShadeSetup& s, float u, float v, float lod, float out[4])
+{
+	const SoftTexture& texture = *s.texture;
+	int levelIndex = 0;
+	if (texture.levelCount > 1)
+		levelIndex = std::min(std::max((int)std::floor(lod + 0.5f), 0), texture.levelCount - 1);
+	const SoftTexture::Level& level = texture.levels[levelIndex];
+	constexpr float limit = 1 << 24;
+	float x = std::min(std::max(u * level.width, -limit), limit);
+	float y = std::min(std::max(v * level.height, -limit), limit);
+
+	if (s.tsp.FilterMode == 0 || texture.indexed)
+	{
+		unpackTexel(fetchTexel(s, level, (int)std::floor(x), (int)std::floor(y)), out);
+		return;
+	}
+	x -= 0.5f;
+	y -= 0.5f;
+	const float fx = std::floor(x);
+	const float fy = std::floor(y);
+	const int x0 = (int)fx;
+	const int y0 = (int)fy;
+	const float wx = x - fx;
+	const float wy = y - fy;
+	float t00[4], t10[4], t01[4], t11[4];
+	unpackTexel(fetchTexel(s, level, x0, y0), t00);
+	unpackTexel(fetchTexel(s, level, x0 + 1, y0), t10);
+	unpackTexel(fetchTexel(s, level, x0, y0 + 1), t01);
+	unpackTexel(fetchTexel(s, level, x0 + 1, y0 + 1), t11);
+	for (int c = 0; c < 4; c++)
+	{
+		float top = t00[c] + (t10[c] - t00[c]) * wx;
+		float bottom = t01[c] + (t11[c] - t01[c]) * wx;
+		out[c] = top + (bottom - top) * wy;
+	}
+}
+
+// Returns the texture color at the given pixel center
+static void texturePixel(const ShadeSetup& s, float px, float py, float invZ, float out[4])
+{
+	const float u = (s.attrA[0] * px + s.attrB[0] * py + s.attrC[0]) * invZ;
+	const float v = (s.attrA[1] * px + s.attrB[1] * py + s.attrC[1]) * invZ;
+	float lod = 0.f;
+	if (s.texture->levelCount > 1)
+	{
+		// Screen-space derivatives of u and v in texels
+		const SoftTexture::Level& level = s.texture->levels[0];
+		float dudx = (s.attrA[0] - u * s.zA) * invZ * level.width;
+		float dvdx = (s.attrA[1] - v * s.zA) * invZ * level.height;
+		float dudy = (s.attrB[0] - u * s.zB) * invZ * level.width;
+		float dvdy = (s.attrB[1] - v * s.zB) * invZ * level.height;
+		float rho = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+		lod = rho > 0.f ? 0.5f * std::log2(rho) + s.lodBias : 0.f;
+	}
+	sampleTexture(s, u, v, lod, out);
+}
+
+static float textureAlpha(const ShadeSetup& s, float px, float py)
+{
+	if (s.texture == nullptr || s.tsp.IgnoreTexA || s.bumpMap)
+		return 1.f;
+	const float z = s.zA * px + s.zB * py + s.zC;
+	float texel[4];
+	texturePixel(s, px, py, z != 0.f ? 1.f / z : 0.f, texel);
+	return texel[3];
+}
+
+// Same pipeline as the GL pixel shader
+static void shadePixel(const ShadeSetup& s, float px, float py, float out[4])
+{
+	const float z = s.zA * px + s.zB * py + s.zC;
+	const float invZ = z != 0.f ? 1.f / z : 0.f;
+	float color[4];
+	float offset[4];
+	if (s.gouraud)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			color[c] = clamp01((s.attrA[2 + c] * px + s.attrB[2 + c] * py + s.attrC[2 + c]) * invZ);
+			offset[c] = clamp01((s.attrA[6 + c] * px + s.attrB[6 + c] * py + s.attrC[6 + c]) * invZ);
+		}
+	}
+	else
+	{
+		memcpy(color, &s.flat[0], sizeof(color));
+		memcpy(offset, &s.flat[4], sizeof(offset));
+	}
+	if (!s.tsp.UseAlpha)
+		color[3] = 1.f;
+	if (s.tsp.FogCtrl == 3)
+	{
+		memcpy(color, frameState.fogColRam, sizeof(frameState.fogColRam));
+		color[3] = fogMode2(z);
+	}
+	const int red = frameState.red;
+	const int blue = 2 - red;
+	if (s.texture != nullptr)
+	{
+		float texel[4];
+		texturePixel(s, px, py, invZ, texel);
+		if (s.bumpMap)
+		{
+			float sAngle = PI / 2.f * (texel[3] * 15.f * 16.f + texel[red] * 15.f) / 255.f;
+			float rAngle = 2.f * PI * (texel[1] * 15.f * 16.f + texel[blue] * 15.f) / 255.f;
+			texel[3] = clamp01(offset[3] + offset[red] * std::sin(sAngle)
+					+ offset[1] * std::cos(sAngle) * std::cos(rAngle - 2.f * PI * offset[blue]));
+			texel[0] = texel[1] = texel[2] = 1.f;
+		}
+		else
+		{
+			if (s.tsp.IgnoreTexA || s.punchThrough)
+				texel[3] = 1.f;
+		}
+		switch (s.tsp.ShadInstr)
+		{
+		case 0:	// decal
+			memcpy(color, texel, sizeof(color));
+			break;
+		case 1:	// modulate
+			for (int c = 0; c < 3; c++)
+				color[c] *= texel[c];
+			color[3] = texel[3];
+			break;
+		case 2:	// decal alpha
+			for (int c = 0; c < 3; c++)
+				color[c] += (texel[c] - color[c]) * texel[3];
+			break;
+		case 3:	// modulate alpha
+			for (int c = 0; c < 4; c++)
+				color[c] *= texel[c];
+			break;
+		}
+		if (s.offset && !s.bumpMap)
+			for (int c = 0; c < 3; c++)
+				color[c] += offset[c];
+	}
+	if (s.tsp.ColorClamp && frameState.colorClamp)
+		for (int c = 0; c < 4; c++)
+			color[c] = std::min(std::max(color[c], frameState.clampMin[c]), frameState.clampMax[c]);
+	if (s.tsp.FogCtrl == 0)
+	{
+		const float fog = fogMode2(z);
+		for (int c = 0; c < 3; c++)
+			color[c] += (frameState.fogColRam[c] - color[c]) * fog;
+	}
+	else if (s.tsp.FogCtrl == 1 && s.offset && !s.bumpMap)
+	{
+		for (int c = 0; c < 3; c++)
+			color[c] += (frameState.fogColVert[c] - color[c]) * offset[3];
+	}
+	for (int c = 0; c < 4; c++)
+		out[c] = clamp01(color[c]);
+}
+
+static inline void blendFactor(u32 instr, const float *color, const float src[4], const float dst[4], float factor[4])
+{
+	switch (instr)
+	{
+	case 0:
+		factor[0] = factor[1] = factor[2] = factor[3] = 0.f;
+		break;
+	case 1:
+		factor[0] = factor[1] = factor[2] = factor[3] = 1.f;
+		break;
+	case 2:
+		memcpy(factor, color, sizeof(float) * 4);
+		break;
+	case 3:
+		for (int c = 0; c < 4; c++)
+			factor[c] = 1.f - color[c];
+		break;
+	case 4:
+		factor[0] = factor[1] = factor[2] = factor[3] = src[3];
+		break;
+	case 5:
+		factor[0] = factor[1] = factor[2] = factor[3] = 1.f - src[3];
+		break;
+	case 6:
+		factor[0] = factor[1] = factor[2] = factor[3] = dst[3];
+		break;
+	case 7:
+		factor[0] = factor[1] = factor[2] = factor[3] = 1.f - dst[3];
+		break;
+	}
+}
+
+static void blend(const TSP& tsp, const float src[4], float dst[4])
+{
+	float srcFactor[4], dstFactor[4];
+	// Source instructions 2 and 3 use the destination color and vice versa
+	blendFactor(tsp.SrcInstr, dst, src, dst, srcFactor);
+	blendFactor(tsp.DstInstr, src, src, dst, dstFactor);
+	for (int c = 0; c < 4; c++)
+		dst[c] = clamp01(src[c] * srcFactor[c] + dst[c] * dstFactor[c]);
+}
+
+//
+// ISP span fill: depth test of a row of pixels against the tile depth buffer.
+// Depth modes are a mask of less (1), equal (2) and greater (4), comparing the new z.
+//
+static void depthSpan(float *depth, u32 *tag, int count, float z0, float dz, u32 mode, bool zwrite, u32 tagValue)
+{
+	int i = 0;
+#if defined(RASTER_SIMD_SSE2)
+	const __m128 lessMask = _mm_castsi128_ps(_mm_set1_epi32((mode & 1) ? -1 : 0));
+	const __m128 equalMask = _mm_castsi128_ps(_mm_set1_epi32((mode & 2) ? -1 : 0));
+	const __m128 greaterMask = _mm_castsi128_ps(_mm_set1_epi32((mode & 4) ? -1 : 0));
+	const __m128i tagv = _mm_set1_epi32((int)tagValue);
+	const __m128 z0v = _mm_set1_ps(z0);
+	const __m128 dzv = _mm_set1_ps(dz);
+	__m128 index = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+	const __m128 four = _mm_set1_ps(4.f);
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 z = _mm_add_ps(z0v, _mm_mul_ps(index, dzv));
+		const __m128 old = _mm_loadu_ps(depth + i);
+		const __m128 pass = _mm_or_ps(_mm_or_ps(
+				_mm_and_ps(_mm_cmplt_ps(z, old), lessMask),
+				_mm_and_ps(_mm_cmpeq_ps(z, old), equalMask)),
+				_mm_and_ps(_mm_cmpgt_ps(z, old), greaterMask));
+		if (zwrite)
+			_mm_storeu_ps(depth + i, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+		const __m128i passi = _mm_castps_si128(pass);
+		const __m128i oldTag = _mm_loadu_si128((const __m128i *)(tag + i));
+		_mm_storeu_si128((__m128i *)(tag + i), _mm_or_si128(_mm_and_si128(passi, tagv), _mm_andnot_si128(passi, oldTag)));
+		index = _mm_add_ps(index, four);
+	}
+#elif defined(RASTER_SIMD_NEON)
+	const uint32x4_t lessMask = vdupq_n_u32((mode & 1) ? ~0u : 0);
+	const uint32x4_t equalMask = vdupq_n_u32((mode & 2) ? ~0u : 0);
+	const uint32x4_t greaterMask = vdupq_n_u32((mode & 4) ? ~0u : 0);
+	const uint32x4_t tagv = vdupq_n_u32(tagValue);
+	const float32x4_t z0v = vdupq_n_f32(z0);
+	const float32x4_t dzv = vdupq_n_f32(dz);
+	static const float indices[4] { 0.f, 1.f, 2.f, 3.f };
+	float32x4_t index = vld1q_f32(indices);
+	const float32x4_t four = vdupq_n_f32(4.f);
+	for (; i + 4 <= count; i += 4)
+	{
+		const float32x4_t z = vaddq_f32(z0v, vmulq_f32(index, dzv));
+		const float32x4_t old = vld1q_f32(depth + i);
+		const uint32x4_t pass = vorrq_u32(vorrq_u32(
+				vandq_u32(vcltq_f32(z, old), lessMask),
+				vandq_u32(vceqq_f32(z, old), equalMask)),
+				vandq_u32(vcgtq_f32(z, old), greaterMask));
+		if (zwrite)
+			vst1q_f32(depth + i, vbslq_f32(pass, z, old));
+		vst1q_u32(tag + i, vbslq_u32(pass, tagv, vld1q_u32(tag + i)));
+		index = vaddq_f32(index, four);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		const float z = z0 + (float)i * dz;
+		const u32 cmp = z < depth[i] ? 1 : z == depth[i] ? 2 : 4;
+		if (mode & cmp)
+		{
+			if (zwrite)
+				depth[i] = z;
+			tag[i] = tagValue;
+		}
+	}
+}
+
+//
+// Triangle setup and binning
+//
+bool TileRasterizer::addTriangle(Triangle& tri, const float *p0, const float *p1, const float *p2, u32 cullMode)
+{
+	// Snap to 1/16 pixel
+	auto snap = [](float v) {
+		return (s64)std::floor(std::min(std::max(v, -32768.f), 32768.f) * 16.f + 0.5f);
+	};
+	s64 x[3] { snap(p0[0]), snap(p1[0]), snap(p2[0]) };
+	s64 y[3] { snap(p0[1]), snap(p1[1]), snap(p2[1]) };
+	float z[3] { p0[2], p1[2], p2[2] };
+
+	s64 area2 = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area2 == 0)
+		return false;
+	if (cullMode != 0)
+	{
+		// Same orientation as the GL renderers: mode 2 culls counter-clockwise triangles on screen
+		const float det = area2 / 256.f;
+		if (std::abs(det) < frameState.cullValue
+				|| (cullMode == 2 && area2 < 0)
+				|| (cullMode == 3 && area2 > 0))
+			return false;
+	}
+	if (area2 < 0)
+	{
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(z[1], z[2]);
+		std::swap(tri.v[1], tri.v[2]);
+		area2 = -area2;
+	}
+
+	// Bounding box, clipped to the tile grid and the tile clip rect
+	tri.xmin = (int)std::max<s64>(floorDiv(std::min({ x[0], x[1], x[2] }), 16), 0);
+	tri.xmax = (int)std::min<s64>(floorDiv(std::max({ x[0], x[1], x[2] }), 16), tilesX * TileSize - 1);
+	tri.ymin = (int)std::max<s64>(floorDiv(std::min({ y[0], y[1], y[2] }), 16), 0);
+	tri.ymax = (int)std::min<s64>(floorDiv(std::max({ y[0], y[1], y[2] }), 16), tilesY * TileSize - 1);
+	if (tri.clipMode == 2)
+	{
+		tri.xmin = std::max(tri.xmin, tri.clipX0);
+		tri.xmax = std::min(tri.xmax, tri.clipX1);
+		tri.ymin = std::max(tri.ymin, tri.clipY0);
+		tri.ymax = std::min(tri.ymax, tri.clipY1);
+	}
+	if (tri.xmin > tri.xmax || tri.ymin > tri.ymax)
+		return false;
+
+	const double invArea = 1.0 / (double)area2;
+	double zA = 0, zB = 0, zC = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		const int j = (i + 1) % 3;
+		const int k = (i + 2) % 3;
+		const s64 a = y[j] - y[k];
+		const s64 b = x[k] - x[j];
+		const s64 c = x[j] * y[k] - x[k] * y[j];
+		// Top-left fill rule
+		const bool topLeft = y[k] < y[j] || (y[k] == y[j] && x[k] > x[j]);
+		tri.edgeA[i] = a;
+		tri.edgeB[i] = b;
+		tri.edgeC[i] = topLeft ? c : c - 1;
+		// Barycentric coordinates as functions of the pixel coordinates
+		const double ba = a * 16 * invArea;
+		const double bb = b * 16 * invArea;
+		const double bc = c * invArea;
+		tri.baryA[i] = (float)ba;
+		tri.baryB[i] = (float)bb;
+		tri.baryC[i] = (float)bc;
+		zA += ba * z[i];
+		zB += bb * z[i];
+		zC += bc * z[i];
+	}
+	tri.zA = (float)zA;
+	tri.zB = (float)zB;
+	tri.zC = (float)zC;
+
+	return true;
+}
+
+void TileRasterizer::binTriangle(u32 index, int pass)
+{
+	const Triangle& tri = triangles[index];
+	Bin *passBins = &bins[pass * tilesX * tilesY];
+	for (int ty = tri.ymin / TileSize; ty <= tri.ymax / TileSize; ty++)
+		for (int tx = tri.xmin / TileSize; tx <= tri.xmax / TileSize; tx++)
+		{
+			// Skip the tile if all its pixel centers are outside an edge
+			const s64 x0 = tx * TileSize * 16 + 8;
+			const s64 y0 = ty * TileSize * 16 + 8;
+			const s64 x1 = x0 + (TileSize - 1) * 16;
+			const s64 y1 = y0 + (TileSize - 1) * 16;
+			bool outside = false;
+			for (int e = 0; e < 3 && !outside; e++)
+			{
+				const s64 x = tri.edgeA[e] > 0 ? x1 : x0;
+				const s64 y = tri.edgeB[e] > 0 ? y1 : y0;
+				outside = tri.edgeA[e] * x + tri.edgeB[e] * y + tri.edgeC[e] < 0;
+			}
+			if (outside)
+				continue;
+			Bin& bin = passBins[ty * tilesX + tx];
+			switch (tri.listType)
+			{
+			case ListType_Opaque:
+				bin.op.push_back(index);
+				break;
+			case ListType_Punch_Through:
+				bin.pt.push_back(index);
+				break;
+			case ListType_Translucent:
+				bin.tr.push_back(index);
+				break;
+			default:
+				bin.mv.push_back(index);
+				break;
+			}
+		}
+}
+
+static void setTileClip(Triangle& tri, u32 tileclip)
+{
+	const u32 mode = tileclip >> 28;
+	if (mode < 2)
+	{
+		tri.clipMode = 0;
+		return;
+	}
+	// Odd modes render outside the rect
+	tri.clipMode = (mode & 1) ? 1 : 2;
+	tri.clipX0 = (tileclip & 63) * 32;
+	tri.clipX1 = ((tileclip >> 6) & 63) * 32 + 31;
+	tri.clipY0 = ((tileclip >> 12) & 31) * 32;
+	tri.clipY1 = ((tileclip >> 17) & 31) * 32 + 31;
+}
+
+void TileRasterizer::addStrips(const rend_context& ctx, const PolyParam *pp, const PolyParam *end, int pass, u32 listType)
+{
+	const u32 *idx = ctx.idx.head();
+	const Vertex *verts = ctx.verts.head();
+	for (; pp != end; pp++)
+	{
+		if (pp->count < 3 || pp->isNaomi2())
+			continue;
+		if (listType != ListType_Punch_Through && pp->isp.DepthMode == 0 && !(listType == ListType_Translucent && passes[pass].autosort))
+			// never passes
+			continue;
+		Triangle tri;
+		tri.pp = pp;
+		tri.mvp = nullptr;
+		tri.volume = 0;
+		tri.volumeOr = false;
+		tri.listType = (u8)listType;
+		setTileClip(tri, pp->tileclip);
+		for (u32 i = 2; i < pp->count; i++)
+		{
+			tri.v[0] = &verts[idx[pp->first + i - 2]];
+			tri.v[1] = &verts[idx[pp->first + i - 1]];
+			tri.v[2] = &verts[idx[pp->first + i]];
+			tri.flat = tri.v[2];
+			// Odd triangles of a strip have the opposite winding
+			if (i & 1)
+				std::swap(tri.v[0], tri.v[1]);
+			if (addTriangle(tri, &tri.v[0]->x, &tri.v[1]->x, &tri.v[2]->x, pp->isp.CullMode))
+			{
+				triangles.push_back(tri);
+				binTriangle((u32)triangles.size() - 1, pass);
+			}
+		}
+	}
+}
+
+void TileRasterizer::addSortedTriangles(const rend_context& ctx, u32 first, u32 end, int pass)
+{
+	const u32 *idx = ctx.idx.head();
+	const Vertex *verts = ctx.verts.head();
+	for (u32 s = first; s < end; s++)
+	{
+		const SortedTriangle& sorted = ctx.sortedTriangles[s];
+		const PolyParam *pp = sorted.ppid;
+		if (pp == nullptr || pp->isNaomi2())
+			continue;
+		Triangle tri;
+		tri.pp = pp;
+		tri.mvp = nullptr;
+		tri.volume = 0;
+		tri.volumeOr = false;
+		tri.listType = ListType_Translucent;
+		setTileClip(tri, pp->tileclip);
+		// Triangle lists
+		for (u32 i = 0; i + 2 < sorted.count; i += 3)
+		{
+			tri.v[0] = &verts[idx[sorted.first + i]];
+			tri.v[1] = &verts[idx[sorted.first + i + 1]];
+			tri.v[2] = &verts[idx[sorted.first + i + 2]];
+			tri.flat = tri.v[2];
+			if (addTriangle(tri, &tri.v[0]->x, &tri.v[1]->x, &tri.v[2]->x, pp->isp.CullMode))
+			{
+				triangles.push_back(tri);
+				binTriangle((u32)triangles.size() - 1, pass);
+			}
+		}
+	}
+}
+
+void TileRasterizer::addModVols(const rend_context& ctx, u32 first, u32 end, int pass)
+{
+	const ModifierVolumeParam *params = ctx.global_param_mvo.head();
+	const ModTriangle *modtrig = ctx.modtrig.head();
+	for (u32 p = first; p < end; p++)
+	{
+		const ModifierVolumeParam& mvp = params[p];
+		if (!mvp.isNaomi2())
+		{
+			Triangle tri;
+			tri.pp = nullptr;
+			tri.mvp = &mvp;
+			tri.v[0] = tri.v[1] = tri.v[2] = tri.flat = nullptr;
+			tri.volume = volumeGroup;
+			tri.volumeOr = !mvp.isp.VolumeLast && mvp.isp.DepthMode > 0;
+			tri.listType = ListType_Opaque_Modifier_Volume;
+			tri.clipMode = 0;
+			for (u32 i = 0; i < mvp.count; i++)
+			{
+				const ModTriangle& mt = modtrig[mvp.first + i];
+				if (addTriangle(tri, &mt.x0, &mt.x1, &mt.x2, mvp.isp.CullMode))
+				{
+					triangles.push_back(tri);
+					binTriangle((u32)triangles.size() - 1, pass);
+				}
+			}
+		}
+		// The last param of a volume tells how it applies
+		if (mvp.isp.DepthMode == 1 || mvp.isp.DepthMode == 2)
+		{
+			volumeModes.push_back(mvp.isNaomi2() ? 0 : (u8)mvp.isp.DepthMode);
+			volumeGroup++;
+		}
+	}
+}
+
+void TileRasterizer::setupFrame(const rend_context& ctx)
+{
+	frameState.red = isDirectX(config::RendererType) ? 2 : 0;
+	getColor(FOG_COL_RAM, frameState.fogColRam);
+	getColor(FOG_COL_VERT, frameState.fogColVert);
+	frameState.fogDensity = FOG_DENSITY.get();
+	const u8 *fogTable = (const u8 *)FOG_TABLE;
+	for (int i = 0; i < 128; i++)
+	{
+		frameState.fogTable[i][0] = fogTable[i * 4];
+		frameState.fogTable[i][1] = fogTable[i * 4 + 1];
+	}
+	frameState.colorClamp = ctx.fog_clamp_min.full != 0 || ctx.fog_clamp_max.full != 0xffffffff;
+	getColor(ctx.fog_clamp_min, frameState.clampMin);
+	getColor(ctx.fog_clamp_max, frameState.clampMax);
+	frameState.ptAlphaRef = (PT_ALPHA_REF & 0xff) / 255.f;
+	frameState.shadowScale = FPU_SHAD_SCALE.scale_factor / 256.f;
+	frameState.cullValue = FPU_CULL_VAL;
+
+	tilesX = ctx.ta_GLOB_TILE_CLIP.tile_x_num + 1;
+	tilesY = ctx.ta_GLOB_TILE_CLIP.tile_y_num + 1;
+	triangles.clear();
+	passes.clear();
+	volumeModes.clear();
+	volumeGroup = 0;
+	const u32 passCount = ctx.render_passes.used();
+	bins.resize(std::max<size_t>(bins.size(), passCount * tilesX * tilesY));
+	for (Bin& bin : bins)
+		bin.clear();
+
+	RenderPass previous {};
+	for (u32 p = 0; p < passCount; p++)
+	{
+		const RenderPass& pass = ctx.render_passes.head()[p];
+		passes.push_back({ pass.autosort, pass.z_clear });
+		addStrips(ctx, ctx.global_param_op.head() + previous.op_count, ctx.global_param_op.head() + pass.op_count, p, ListType_Opaque);
+		addStrips(ctx, ctx.global_param_pt.head() + previous.pt_count, ctx.global_param_pt.head() + pass.pt_count, p, ListType_Punch_Through);
+		addModVols(ctx, previous.mvo_count, pass.mvo_count, p);
+		if (pass.autosort && pass.sorted_tr_count != previous.sorted_tr_count)
+			// Triangles sorted by ta_parse. They are sorted again per pixel.
+			addSortedTriangles(ctx, previous.sorted_tr_count, pass.sorted_tr_count, p);
+		else
+			addStrips(ctx, ctx.global_param_tr.head() + previous.tr_count, ctx.global_param_tr.head() + pass.tr_count, p, ListType_Translucent);
+		previous = pass;
+	}
+}
+
+//
+// Tile rendering
+//
+template<typename F>
+void TileRasterizer::rasterize(const Triangle& tri, int tileX, int tileY, F pixelSpan)
+{
+	const int xmin = std::max(tri.xmin, tileX * TileSize);
+	const int xmax = std::min(tri.xmax, tileX * TileSize + TileSize - 1);
+	const int ymin = std::max(tri.ymin, tileY * TileSize);
+	const int ymax = std::min(tri.ymax, tileY * TileSize + TileSize - 1);
+	for (int y = ymin; y <= ymax; y++)
+	{
+		// Find the pixels of the row inside all edges
+		const s64 py = y * 16 + 8;
+		s64 x0 = xmin;
+		s64 x1 = xmax;
+		for (int e = 0; e < 3 && x0 <= x1; e++)
+		{
+			const s64 a = tri.edgeA[e] * 16;
+			const s64 c = tri.edgeA[e] * 8 + tri.edgeB[e] * py + tri.edgeC[e];
+			if (a > 0)
+				x0 = std::max(x0, ceilDiv(-c, a));
+			else if (a < 0)
+				x1 = std::min(x1, floorDiv(c, -a));
+			else if (c < 0)
+				x1 = x0 - 1;
+		}
+		if (x0 > x1)
+			continue;
+		if (tri.clipMode == 1 && y >= tri.clipY0 && y <= tri.clipY1)
+		{
+			// Only outside the clip rect
+			if (x0 < tri.clipX0)
+				pixelSpan(y, (int)x0, (int)std::min<s64>(x1, tri.clipX0 - 1));
+			if (x1 > tri.clipX1)
+				pixelSpan(y, (int)std::max<s64>(x0, tri.clipX1 + 1), (int)x1);
+		}
+		else
+		{
+			pixelSpan(y, (int)x0, (int)x1);
+		}
+	}
+}
+
+void TileRasterizer::drawOpaque(const Triangle& tri, u32 index, int tileX, int tileY, TileState& state)
+{
+	const u32 mode = tri.pp->isp.DepthMode;
+	const bool zwrite = !tri.pp->isp.ZWriteDis;
+	rasterize(tri, tileX, tileY, [&](int y, int x0, int x1) {
+		const int offset = (y - tileY * TileSize) * TileSize + x0 - tileX * TileSize;
+		const float z = tri.zA * (x0 + 0.5f) + tri.zB * (y + 0.5f) + tri.zC;
+		depthSpan(&state.depth[offset], &state.tag[offset], x1 - x0 + 1, z, tri.zA, mode, zwrite, index);
+	});
+}
+
+void TileRasterizer::drawPunchThrough(const Triangle& tri, u32 index, int tileX, int tileY, TileState& state)
+{
+	ShadeSetup setup;
+	setupShading(setup, tri, index, false);
+	if (setup.texture == nullptr || setup.tsp.IgnoreTexA || setup.bumpMap)
+	{
+		// No alpha test: depth greater or equal, always written
+		rasterize(tri, tileX, tileY, [&](int y, int x0, int x1) {
+			const int offset = (y - tileY * TileSize) * TileSize + x0 - tileX * TileSize;
+			const float z = tri.zA * (x0 + 0.5f) + tri.zB * (y + 0.5f) + tri.zC;
+			depthSpan(&state.depth[offset], &state.tag[offset], x1 - x0 + 1, z, tri.zA, 6, true, index);
+		});
+		return;
+	}
+	rasterize(tri, tileX, tileY, [&](int y, int x0, int x1) {
+		const int offset = (y - tileY * TileSize) * TileSize - tileX * TileSize;
+		const float py = y + 0.5f;
+		for (int x = x0; x <= x1; x++)
+		{
+			const float px = x + 0.5f;
+			const float z = tri.zA * px + tri.zB * py + tri.zC;
+			if (z < state.depth[offset + x])
+				continue;
+			if (frameState.ptAlphaRef > textureAlpha(setup, px, py))
+				continue;
+			state.depth[offset + x] = z;
+			state.tag[offset + x] = index;
+		}
+	});
+}
+
+void TileRasterizer::drawModVol(const Triangle& tri, int tileX, int tileY, TileState& state)
+{
+	rasterize(tri, tileX, tileY, [&](int y, int x0, int x1) {
+		const int offset = (y - tileY * TileSize) * TileSize - tileX * TileSize;
+		const float py = y + 0.5f;
+		for (int x = x0; x <= x1; x++)
+		{
+			const float z = tri.zA * (x + 0.5f) + tri.zB * py + tri.zC;
+			if (z > state.depth[offset + x])
+			{
+				if (tri.volumeOr)
+					state.stencil[offset + x] |= 2;
+				else
+					state.stencil[offset + x] ^= 2;
+			}
+		}
+	});
+}
+
+void TileRasterizer::drawTranslucent(const Triangle& tri, u32 index, int tileX, int tileY, TileState& state)
+{
+	ShadeSetup setup;
+	setupShading(setup, tri, index, false);
+	const u32 mode = tri.pp->isp.DepthMode;
+	const bool zwrite = !tri.pp->isp.ZWriteDis;
+	rasterize(tri, tileX, tileY, [&](int y, int x0, int x1) {
+		const int offset = (y - tileY * TileSize) * TileSize - tileX * TileSize;
+		const float py = y + 0.5f;
+		for (int x = x0; x <= x1; x++)
+		{
+			const float px = x + 0.5f;
+			const float z = tri.zA * px + tri.zB * py + tri.zC;
+			float& depth = state.depth[offset + x];
+			const u32 cmp = z < depth ? 1 : z == depth ? 2 : 4;
+			if ((mode & cmp) == 0)
+				continue;
+			if (zwrite)
+				depth = z;
+			float color[4];
+			shadePixel(setup, px, py, color);
+			blend(setup.tsp, color, state.color[offset + x]);
+		}
+	});
+}
+
+void TileRasterizer::collectTranslucent(const Triangle& tri, u32 index, int tileX, int tileY, TileState& state)
+{
+	rasterize(tri, tileX, tileY, [&](int y, int x0, int x1) {
+		const int offset = (y - tileY * TileSize) * TileSize - tileX * TileSize;
+		const float py = y + 0.5f;
+		for (int x = x0; x <= x1; x++)
+		{
+			const float z = tri.zA * (x + 0.5f) + tri.zB * py + tri.zC;
+			if (z >= state.depth[offset + x])
+				state.fragments.push_back({ z, index, (u32)(offset + x) });
+		}
+	});
+}
+
+void TileRasterizer::resolveTranslucent(int tileX, int tileY, TileState& state)
+{
+	if (state.fragments.empty())
+		return;
+	// Group the fragments by pixel, keeping the submission order
+	state.pixelCount.assign(TileSize * TileSize + 1, 0);
+	for (const Fragment& fragment : state.fragments)
+		state.pixelCount[fragment.pixel + 1]++;
+	for (int i = 0; i < TileSize * TileSize; i++)
+		state.pixelCount[i + 1] += state.pixelCount[i];
+	state.sorted.resize(state.fragments.size());
+	{
+		std::vector<u32>& next = state.pixelCount;
+		for (const Fragment& fragment : state.fragments)
+			state.sorted[next[fragment.pixel]++] = fragment;
+	}
+	// pixelCount[i] is now the end of the fragments of pixel i
+	ShadeSetup setup;
+	u32 start = 0;
+	for (int pixel = 0; pixel < TileSize * TileSize; pixel++)
+	{
+		const u32 end = state.pixelCount[pixel];
+		if (start == end)
+			continue;
+		// Back to front. Stable so that coplanar polygons are drawn in order.
+		Fragment *first = &state.sorted[start];
+		Fragment *last = &state.sorted[end];
+		for (Fragment *f = first + 1; f < last; f++)
+		{
+			Fragment fragment = *f;
+			Fragment *g = f;
+			for (; g > first && (g - 1)->z > fragment.z; g--)
+				*g = *(g - 1);
+			*g = fragment;
+		}
+		const float px = tileX * TileSize + pixel % TileSize + 0.5f;
+		const float py = tileY * TileSize + pixel / TileSize + 0.5f;
+		for (Fragment *f = first; f < last; f++)
+		{
+			if (setup.tri != f->tri)
+				setupShading(setup, triangles[f->tri], f->tri, false);
+			float color[4];
+			shadePixel(setup, px, py, color);
+			blend(setup.tsp, color, state.color[pixel]);
+		}
+		start = end;
+	}
+	state.fragments.clear();
+}
+
+void TileRasterizer::renderTile(int tileX, int tileY, TileState& state, u32 *frame)
+{
+	constexpr int PixelCount = TileSize * TileSize;
+	const int tile = tileY * tilesX + tileX;
+	std::fill(std::begin(state.depth), std::end(state.depth), 0.f);
+	memset(state.color, 0, sizeof(state.color));
+	ShadeSetup setup[2];
+
+	for (u32 p = 0; p < passes.size(); p++)
+	{
+		const Bin& bin = bins[p * tilesX * tilesY + tile];
+		if (p > 0 && passes[p].zClear)
+			std::fill(std::begin(state.depth), std::end(state.depth), 0.f);
+
+		// Hidden surface removal
+		std::fill(std::begin(state.tag), std::end(state.tag), NoTag);
+		for (u32 index : bin.op)
+			drawOpaque(triangles[index], index, tileX, tileY, state);
+		for (u32 index : bin.pt)
+			drawPunchThrough(triangles[index], index, tileX, tileY, state);
+
+		// Modifier volumes. Bit 0 is the result, bit 1 the current volume.
+		memset(state.stencil, 0, sizeof(state.stencil));
+		auto closeVolume = [&](u32 volume) {
+			const u8 mode = volume < volumeModes.size() ? volumeModes[volume] : 0;
+			for (int i = 0; i < PixelCount; i++)
+			{
+				u8& stencil = state.stencil[i];
+				if (mode == 1)
+					stencil |= stencil >> 1;	// inclusion
+				else if (mode == 2)
+					stencil &= ~(stencil >> 1);	// exclusion
+				stencil &= 1;
+			}
+		};
+		if (!bin.mv.empty())
+		{
+			u32 volume = triangles[bin.mv[0]].volume;
+			for (u32 index : bin.mv)
+			{
+				const Triangle& tri = triangles[index];
+				if (tri.volume != volume)
+				{
+					closeVolume(volume);
+					volume = tri.volume;
+				}
+				drawModVol(tri, tileX, tileY, state);
+			}
+			closeVolume(volume);
+		}
+
+		// Shade the visible opaque and punch-through pixels
+		for (int i = 0; i < PixelCount; i++)
+		{
+			const u32 tag = state.tag[i];
+			if (tag == NoTag)
+				continue;
+			const Triangle& tri = triangles[tag];
+			const bool shadowed = tri.pp->pcw.Shadow && (state.stencil[i] & 1);
+			const bool twoVolumes = tri.pp->tsp1.full != 0xffffffff;
+			const bool volume1 = shadowed && twoVolumes;
+			ShadeSetup& s = setup[volume1];
+			if (s.tri != tag)
+				setupShading(s, tri, tag, volume1);
+			shadePixel(s, tileX * TileSize + i % TileSize + 0.5f, tileY * TileSize + i / TileSize + 0.5f, state.color[i]);
+			if (shadowed && !twoVolumes)
+				for (int c = 0; c < 3; c++)
+					state.color[i][c] *= frameState.shadowScale;
+		}
+
+		// Translucent polygons
+		if (passes[p].autosort)
+		{
+			for (u32 index : bin.tr)
+				collectTranslucent(triangles[index], index, tileX, tileY, state);
+			resolveTranslucent(tileX, tileY, state);
+		}
+		else
+		{
+			for (u32 index : bin.tr)
+				drawTranslucent(triangles[index], index, tileX, tileY, state);
+		}
+	}
+
+	const u32 stride = tilesX * TileSize;
+	u32 *dst = frame + tileY * TileSize * stride + tileX * TileSize;
+	for (int y = 0; y < TileSize; y++, dst += stride)
+		for (int x = 0; x < TileSize; x++)
+		{
+			const float *color = state.color[y * TileSize + x];
+			dst[x] = (u32)(color[0] * 255.f + 0.5f)
+					| ((u32)(color[1] * 255.f + 0.5f) << 8)
+					| ((u32)(color[2] * 255.f + 0.5f) << 16)
+					| ((u32)(color[3] * 255.f + 0.5f) << 24);
+		}
+}
+
+void TileRasterizer::render(const rend_context& ctx, std::vector<u32>& frame, u32& width, u32& height)
+{
+	setupFrame(ctx);
+	width = tilesX * TileSize;
+	height = tilesY * TileSize;
+	frame.resize(width * height);
+
+	const int tileCount = tilesX * tilesY;
+#ifdef _OPENMP
+	const int threads = std::min(omp_get_num_procs(), tileCount);
+#else
+	const int threads = 1;
+#endif
+	if ((int)tileStates.size() < threads)
+		tileStates.resize(threads);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+	for (int tile = 0; tile < tileCount; tile++)
+	{
+#ifdef _OPENMP
+		TileState& state = tileStates[omp_get_thread_num()];
+#else
+		TileState& state = tileStates[0];
+#endif
+		renderTile(tile % tilesX, tile / tilesX, state, frame.data());
+	}
+}
+
+}
@@ -0,0 +1,162 @@
+/*
+	Tile-based software rasterizer
+
+	Renders a TA context the way the PowerVR2 does: the frame is split in 32x32 tiles
+	and each tile goes through hidden surface removal (ISP) then shading (TSP).
+	Opaque and punch-through polygons are shaded once per pixel after depth sorting,
+	modifier volumes are resolved per tile against the opaque depth, and translucent
+	polygons are sorted per pixel when the pass uses auto-sort.
+	Tiles are independent and rendered in parallel.
+*/
+#pragma once
+#include "types.h"
+#include "hw/pvr/ta_ctx.h"
+#include "rend/TexCache.h"
+
+#include <vector>
+
+namespace soft
+{
+
+constexpr int TileSize = 32;
+
+//
+// Decoded texture, always 32-bit RGBA or palette indices
+//
+class SoftTexture final : public BaseTextureCacheData
+{
+public:
+	SoftTexture(TSP tsp = {}, TCW tcw = {}) : BaseTextureCacheData(tsp, tcw) {}
+	SoftTexture(SoftTexture&& other) : BaseTextureCacheData(std::move(other)) {
+		std::swap(texels, other.texels);
+		std::swap(levels, other.levels);
+		levelCount = other.levelCount;
+		indexed = other.indexed;
+	}
+
+	std::string GetId() override { return std::to_string((uintptr_t)this); }
+	void UploadToGPU(int width, int height, const u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) override;
+	// 16-bit textures would need per-format unpacking at sampling time
+	bool Force32BitTexture(TextureType type) const override { return type != TextureType::_8; }
+	bool Delete() override;
+
+	struct Level
+	{
+		u32 width;
+		u32 height;
+		u32 offset;
+	};
+	// Level 0 is the largest
+	std::vector<u32> texels;
+	Level levels[11] {};
+	int levelCount = 0;
+	// texels are indices in palette32_ram
+	bool indexed = false;
+};
+
+class SoftTextureCache final : public BaseTextureCache<SoftTexture>
+{
+public:
+	~SoftTextureCache() {
+		Clear();
+	}
+};
+
+struct Triangle
+{
+	// Edge functions in 1/16 pixel units, positive inside.
+	// Edge i is opposite to vertex i.
+	s64 edgeA[3];
+	s64 edgeB[3];
+	s64 edgeC[3];
+	// Barycentric coordinates and 1/w as functions of the pixel center
+	float baryA[3];
+	float baryB[3];
+	float baryC[3];
+	float zA, zB, zC;
+
+	const Vertex *v[3];
+	const Vertex *flat;		// provoking vertex for flat shading
+	const PolyParam *pp;
+	const ModifierVolumeParam *mvp;
+	u32 volume;				// modifier volume group
+	bool volumeOr;			// open volume
+	u8 listType;
+	int xmin, ymin, xmax, ymax;	// inclusive pixel bounds
+	int clipMode;			// 0: none, 1: inside the rect, 2: outside the rect
+	int clipX0, clipY0, clipX1, clipY1;
+};
+
+class TileRasterizer
+{
+public:
+	// Renders the context into an RGBA buffer of the size of the tile grid.
+	// Colors are stored in the byte order of the TA vertices.
+	void render(const rend_context& ctx, std::vector<u32>& frame, u32& width, u32& height);
+
+private:
+	struct Bin
+	{
+		std::vector<u32> op;
+		std::vector<u32> pt;
+		std::vector<u32> tr;
+		std::vector<u32> mv;
+
+		void clear() {
+			op.clear();
+			pt.clear();
+			tr.clear();
+			mv.clear();
+		}
+	};
+	struct PassInfo
+	{
+		bool autosort;
+		bool zClear;
+	};
+	struct Fragment
+	{
+		float z;
+		u32 tri;
+		u32 pixel;
+	};
+	struct TileState
+	{
+		float depth[TileSize * TileSize];
+		u32 tag[TileSize * TileSize];
+		u8 stencil[TileSize * TileSize];
+		float color[TileSize * TileSize][4];
+		std::vector<Fragment> fragments;
+		std::vector<Fragment> sorted;
+		std::vector<u32> pixelCount;
+	};
+
+	void setupFrame(const rend_context& ctx);
+	void addStrips(const rend_context& ctx, const PolyParam *pp, const PolyParam *end, int pass, u32 listType);
+	void addSortedTriangles(const rend_context& ctx, u32 first, u32 end, int pass);
+	void addModVols(const rend_context& ctx, u32 first, u32 end, int pass);
+	bool addTriangle(Triangle& tri, const float *p0, const float *p1, const float *p2, u32 cullMode);
+	void binTriangle(u32 index, int pass);
+
+	void renderTile(int tileX, int tileY, TileState& state, u32 *frame);
+	template<typename F>
+	void rasterize(const Triangle& tri, int tileX, int tileY, F pixelSpan);
+	void drawOpaque(const Triangle& tri, u32 index, int tileX, int tileY, TileState& state);
+	void drawPunchThrough(const Triangle& tri, u32 index, int tileX, int tileY, TileState& state);
+	void drawModVol(const Triangle& tri, int tileX, int tileY, TileState& state);
+	void drawTranslucent(const Triangle& tri, u32 index, int tileX, int tileY, TileState& state);
+	void collectTranslucent(const Triangle& tri, u32 index, int tileX, int tileY, TileState& state);
+	void resolveTranslucent(int tileX, int tileY, TileState& state);
+
+	std::vector<Triangle> triangles;
+	std::vector<Bin> bins;		// [pass][tile]
+	std::vector<PassInfo> passes;
+	std::vector<TileState> tileStates;
+	int tilesX = 0;
+	int tilesY = 0;
+	// Mode of each volume group. 0: none, 1: inclusion, 2: exclusion
+	std::vector<u8> volumeModes;
+	u32 volumeGroup = 0;
+};
+
+}
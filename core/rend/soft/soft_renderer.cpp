@@ -0,0 +1,151 @@
+/*
+	Software renderer
+
+	Renders each frame with the tile rasterizer and writes it to the emulated framebuffer
+	in VRAM, like the hardware does. Nothing is presented to the host: the output is read
+	back from VRAM, for instance by `flycast -bench -screenshot`.
+*/
+#include "soft_raster.h"
+#include "cfg/option.h"
+#include "hw/pvr/ta.h"
+#include "hw/pvr/Renderer_if.h"
+#include "profiler/bench.h"
+
+#include <cmath>
+
+class SoftRenderer final : public Renderer
+{
+public:
+	bool Init() override
+	{
+		// Vertex colors and palettes use the DirectX order with DirectX renderers
+		BaseTextureCacheData::SetDirectXColorOrder(isDirectX(config::RendererType));
+		return true;
+	}
+
+	void Term() override
+	{
+		texCache.Clear();
+		BaseTextureCacheData::SetDirectXColorOrder(false);
+	}
+
+	bool Process(TA_context *ctx) override
+	{
+		if (KillTex)
+			texCache.Clear();
+		texCache.CollectCleanup();
+
+		return ta_parse(ctx, false);
+	}
+
+	bool Render() override
+	{
+		bench::Timer timer(bench::Render);
+		u32 width, height;
+		rasterizer.render(pvrrc, frame, width, height);
+		writeFramebuffer(width, height);
+
+		return !pvrrc.isRTT;
+	}
+
+	void RenderFramebuffer(const FramebufferInfo& info) override { }
+
+	void PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures) override
+	{
+		texCache.Prefetch(textures);
+	}
+
+	BaseTextureCacheData *GetTexture(TSP tsp, TCW tcw) override
+	{
+		soft::SoftTexture *tf = texCache.getTextureCacheData(tsp, tcw);
+		if (tf->NeedsUpdate())
+			tf->Update();
+		else
+			tf->CheckCustomTexture();
+
+		return tf;
+	}
+
+private:
+	// Applies SCALER_CTL to the rendered frame
+	void scaleFrame(u32& width, u32& height)
+	{
+		float yscale = pvrrc.scaler_ctl.vscalefactor != 0 ? 1024.f / pvrrc.scaler_ctl.vscalefactor : 1.f;
+		if (std::abs(yscale - 1.f) < 0.01f)
+			yscale = 1.f;
+		const bool halfWidth = pvrrc.scaler_ctl.hscale == 1;
+		if (!halfWidth && yscale == 1.f)
+			return;
+
+		const u32 scaledW = halfWidth ? width / 2 : width;
+		const u32 scaledH = (u32)(height * yscale);
+		scaled.resize(scaledW * scaledH);
+		auto lerp = [](u32 a, u32 b, float w) {
+			u32 rv = 0;
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				float ca = (float)((a >> shift) & 0xff);
+				float cb = (float)((b >> shift) & 0xff);
+				rv |= (u32)(ca + (cb - ca) * w + 0.5f) << shift;
+			}
+			return rv;
+		};
+		for (u32 y = 0; y < scaledH; y++)
+		{
+			const float sy = std::max((y + 0.5f) / yscale - 0.5f, 0.f);
+			const u32 y0 = std::min((u32)sy, height - 1);
+			const u32 y1 = std::min(y0 + 1, height - 1);
+			const float wy = sy - y0;
+			const u32 *row0 = &frame[y0 * width];
+			const u32 *row1 = &frame[y1 * width];
+			u32 *dst = &scaled[y * scaledW];
+			for (u32 x = 0; x < scaledW; x++)
+			{
+				if (halfWidth)
+					dst[x] = lerp(lerp(row0[x * 2], row0[x * 2 + 1], 0.5f), lerp(row1[x * 2], row1[x * 2 + 1], 0.5f), wy);
+				else
+					dst[x] = lerp(row0[x], row1[x], wy);
+			}
+		}
+		frame.swap(scaled);
+		width = scaledW;
+		height = scaledH;
+	}
+
+	void writeFramebuffer(u32 width, u32 height)
+	{
+		FB_X_CLIP_type xClip = pvrrc.fb_X_CLIP;
+		FB_Y_CLIP_type yClip = pvrrc.fb_Y_CLIP;
+		if (!pvrrc.isRTT)
+		{
+			const u32 renderedH = height;
+			scaleFrame(width, height);
+			// FB_Y_CLIP is applied before vscalefactor if > 1, so it must be scaled here
+			if (height > renderedH)
+			{
+				const float yscale = (float)height / renderedH;
+				yClip.min = std::round(yClip.min * yscale);
+				yClip.max = std::round(yClip.max * yscale);
+			}
+		}
+		xClip.min = std::min(xClip.min, width - 1);
+		xClip.max = std::min(xClip.max, width - 1);
+		yClip.min = std::min(yClip.min, height - 1);
+		yClip.max = std::min(yClip.max, height - 1);
+		if (isDirectX(config::RendererType))
+			WriteFramebuffer<2, 1, 0, 3>(width, height, (const u8 *)frame.data(), pvrrc.fb_W_SOF1 & VRAM_MASK,
+					pvrrc.fb_W_CTRL, pvrrc.fb_W_LINESTRIDE * 8, xClip, yClip);
+		else
+			WriteFramebuffer(width, height, (const u8 *)frame.data(), pvrrc.fb_W_SOF1 & VRAM_MASK,
+					pvrrc.fb_W_CTRL, pvrrc.fb_W_LINESTRIDE * 8, xClip, yClip);
+	}
+
+	soft::SoftTextureCache texCache;
+	soft::TileRasterizer rasterizer;
+	std::vector<u32> frame;
+	std::vector<u32> scaled;
+};
+
+Renderer *rend_softrend() {
+	return new SoftRenderer();
+}
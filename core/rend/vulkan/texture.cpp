@@ -439,9 +439,9 @@ void TextureCache::Cleanup()
 
 	u32 TargetFrame = std::max((u32)120, FrameCount) - 120;
 
-	for (const auto& pair : cache)
+	for (auto& pair : cache)
 	{
-		if (pair.second.dirty && pair.second.dirty < TargetFrame)
+		if (pair.second.IsDirty() && pair.second.dirty < TargetFrame)
 			list.push_back(pair.first);
 
 		if (list.size() > 5)
@@ -99,6 +99,11 @@ public:
 		shaderManager.term();
 	}
 
+	void PrefetchTextures(const std::vector<std::pair<TSP, TCW>>& textures) override
+	{
+		textureCache.Prefetch(textures);
+	}
+
 	BaseTextureCacheData *GetTexture(TSP tsp, TCW tcw) override
 	{
 		Texture* tf = textureCache.getTextureCacheData(tsp, tcw);
@@ -0,0 +1,379 @@
+/*
+	Paged savestates
+*/
+#ifndef LIBRETRO
+#include "savestate.h"
+#include "serialize.h"
+#include "emulator.h"
+#include "stdclass.h"
+#include "archive/rzip.h"
+#include "hw/aica/aica_if.h"
+#include "hw/pvr/elan.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/sh4/sh4_mem.h"
+#include "rend/gui.h"
+
+#include <array>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <memory>
+// XXH3 is only exported as experimental in this version
+#define XXH_STATIC_LINKING_ONLY
+#include <xxhash.h>
+#include <zlib.h>
+
+namespace savestate
+{
+
+constexpr u32 Magic = 0x54535046;	// "FPST", never a valid serializer version
+constexpr u32 FormatVersion = 1;
+constexpr u32 PageSize = 4096;
+constexpr int RegionCount = 4;
+
+struct Header
+{
+	u32 magic;
+	u32 version;
+	u64 baseId;			// identifies the full snapshot
+	u32 delta;			// only the pages that differ from the base are included
+	u32 coreSize;		// size of the state serialized without the memory regions
+	u32 regionCount;
+	u32 reserved;
+};
+
+// Followed by pageCount page indices then the page data
+struct RegionHeader
+{
+	u32 size;
+	u32 pageCount;
+};
+
+struct Region
+{
+	u8 *data;
+	u32 size;
+
+	u32 pageCount() const {
+		return size / PageSize;
+	}
+};
+
+static std::array<Region, RegionCount> getRegions()
+{
+	return {{
+		{ mem_b.data, mem_b.size },
+		{ vram.data, vram.size },
+		{ aica_ram.data, aica_ram.size },
+		{ elan::RAM, settings.platform.isNaomi2() ? elan::ERAM_SIZE : 0 },
+	}};
+}
+
+// Full snapshot the next saves are compared to
+static struct
+{
+	std::string path;
+	u64 id = 0;
+	// set once the snapshot has been moved to its .base file
+	bool moved = false;
+	std::array<std::vector<u64>, RegionCount> hashes;
+} base;
+
+struct Job
+{
+	std::string path;
+	std::unique_ptr<u8[]> payload;
+	size_t size;
+	bool delta;
+	bool moveBase;
+	u32 pages;
+	// New base snapshot, committed once the state is written
+	u64 baseId;
+	std::array<std::vector<u64>, RegionCount> hashes;	// full saves only
+};
+
+static std::future<bool> pending;
+static std::shared_ptr<Job> pendingJob;
+
+static std::string basePath(const std::string& path) {
+	return path + ".base";
+}
+
+// Replaces the destination file if it exists
+static bool renameFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+	nowide::remove(to.c_str());
+#endif
+	return nowide::rename(from.c_str(), to.c_str()) == 0;
+}
+
+// The state is written to a temporary file first so that the current slot and base
+// are left untouched if writing fails.
+static bool writeState(const std::shared_ptr<Job>& job)
+{
+	const std::string tmpFile = job->path + ".tmp";
+	RZipFile zipFile;
+	if (!zipFile.Open(tmpFile, true, Z_BEST_SPEED))
+	{
+		WARN_LOG(SAVESTATE, "Failed to save state - could not open %s for writing", tmpFile.c_str());
+		gui_display_notification("Cannot open save file", 2000);
+		return false;
+	}
+	if (zipFile.Write(job->payload.get(), job->size) != job->size)
+	{
+		zipFile.Close();
+		nowide::remove(tmpFile.c_str());
+		WARN_LOG(SAVESTATE, "Failed to save state - error writing %s", tmpFile.c_str());
+		gui_display_notification("Error saving state", 2000);
+		return false;
+	}
+	zipFile.Close();
+	job->payload.reset();
+
+	const std::string baseFile = basePath(job->path);
+	if (job->moveBase && !renameFile(job->path, baseFile))
+	{
+		nowide::remove(tmpFile.c_str());
+		WARN_LOG(SAVESTATE, "Failed to save state - cannot rename %s", job->path.c_str());
+		gui_display_notification("Error saving state", 2000);
+		return false;
+	}
+	if (!renameFile(tmpFile, job->path))
+	{
+		if (job->moveBase)
+			// Restore the previous state
+			renameFile(baseFile, job->path);
+		nowide::remove(tmpFile.c_str());
+		WARN_LOG(SAVESTATE, "Failed to save state - cannot rename %s", tmpFile.c_str());
+		gui_display_notification("Error saving state", 2000);
+		return false;
+	}
+	if (!job->delta)
+		// Previous base, no longer used
+		nowide::remove(baseFile.c_str());
+
+	NOTICE_LOG(SAVESTATE, "Saved %s state to %s size %d (%d pages)", job->delta ? "incremental" : "full",
+			job->path.c_str(), (int)job->size, job->pages);
+	gui_display_notification("State saved", 1000);
+
+	return true;
+}
+
+void flush()
+{
+	if (!pending.valid())
+		return;
+	if (pending.get())
+	{
+		base.path = pendingJob->path;
+		base.id = pendingJob->baseId;
+		// a delta save moves the base to its .base file if needed
+		base.moved = pendingJob->delta;
+		if (!pendingJob->delta)
+			base.hashes = std::move(pendingJob->hashes);
+	}
+	// otherwise the previous slot and base files are unchanged
+	pendingJob.reset();
+}
+
+void reset()
+{
+	base.path.clear();
+	base.id = 0;
+	base.moved = false;
+	for (auto& hashes : base.hashes)
+		std::vector<u64>().swap(hashes);
+}
+
+bool save(const std::string& path)
+{
+	flush();
+
+	Serializer dryrun(nullptr, std::numeric_limits<size_t>::max(), false, true);
+	dc_serialize(dryrun);
+	const size_t coreSize = dryrun.size();
+
+	const auto regions = getRegions();
+	std::array<std::vector<u64>, RegionCount> hashes;
+	bool delta = base.id != 0 && base.path == path
+			&& file_exists(base.moved ? basePath(path) : path);
+	u32 totalPages = 0;
+	u32 changedPages = 0;
+	for (int r = 0; r < RegionCount; r++)
+	{
+		const Region& region = regions[r];
+		hashes[r].resize(region.pageCount());
+		for (u32 p = 0; p < region.pageCount(); p++)
+			hashes[r][p] = XXH3_64bits(region.data + p * PageSize, PageSize);
+		totalPages += region.pageCount();
+		if (base.hashes[r].size() != hashes[r].size())
+			delta = false;
+		else if (delta)
+			for (u32 p = 0; p < region.pageCount(); p++)
+				changedPages += hashes[r][p] != base.hashes[r][p];
+	}
+	// Start over when the delta gets too big
+	if (changedPages * 2 > totalPages)
+		delta = false;
+	const u32 pageCount = delta ? changedPages : totalPages;
+
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->path = path;
+	job->size = sizeof(Header) + coreSize + sizeof(RegionHeader) * RegionCount + (sizeof(u32) + PageSize) * pageCount;
+	job->payload.reset(new (std::nothrow) u8[job->size]);
+	if (job->payload == nullptr)
+	{
+		WARN_LOG(SAVESTATE, "Failed to save state - could not malloc %d bytes", (int)job->size);
+		return false;
+	}
+	job->delta = delta;
+	job->moveBase = delta && !base.moved;
+	job->pages = pageCount;
+	if (delta)
+		job->baseId = base.id;
+	else
+		job->baseId = (u64)std::chrono::system_clock::now().time_since_epoch().count() ^ ((u64)totalPages << 48);
+
+	u8 *p = job->payload.get();
+	Header header {};
+	header.magic = Magic;
+	header.version = FormatVersion;
+	header.baseId = job->baseId;
+	header.delta = delta;
+	header.coreSize = (u32)coreSize;
+	header.regionCount = RegionCount;
+	memcpy(p, &header, sizeof(header));
+	p += sizeof(header);
+
+	Serializer ser(p, coreSize, false, true);
+	dc_serialize(ser);
+	p += coreSize;
+
+	for (int r = 0; r < RegionCount; r++)
+	{
+		const Region& region = regions[r];
+		u32 *indices = (u32 *)(p + sizeof(RegionHeader));
+		u32 count = 0;
+		for (u32 page = 0; page < region.pageCount(); page++)
+			if (!delta || hashes[r][page] != base.hashes[r][page])
+				indices[count++] = page;
+		RegionHeader regionHeader { region.size, count };
+		memcpy(p, &regionHeader, sizeof(regionHeader));
+		p += sizeof(RegionHeader) + count * sizeof(u32);
+		for (u32 i = 0; i < count; i++)
+		{
+			memcpy(p, region.data + indices[i] * PageSize, PageSize);
+			p += PageSize;
+		}
+	}
+	verify(p == job->payload.get() + job->size);
+	if (!delta)
+		job->hashes = std::move(hashes);
+
+	pendingJob = job;
+	pending = std::async(std::launch::async, writeState, job);
+
+	return true;
+}
+
+bool isPaged(const void *data, size_t size)
+{
+	u32 magic;
+	if (size < sizeof(Header))
+		return false;
+	memcpy(&magic, data, sizeof(magic));
+
+	return magic == Magic;
+}
+
+struct ParsedState
+{
+	Header header;
+	const u8 *core;
+	std::array<u32, RegionCount> pageCount;
+	std::array<const u32 *, RegionCount> indices;
+	std::array<const u8 *, RegionCount> pages;
+};
+
+static ParsedState parse(const u8 *data, size_t size, const std::array<Region, RegionCount>& regions)
+{
+	ParsedState state;
+	if (size < sizeof(Header))
+		throw Deserializer::Exception("Invalid savestate");
+	memcpy(&state.header, data, sizeof(Header));
+	if (state.header.magic != Magic || state.header.version > FormatVersion)
+		throw Deserializer::Exception("Unsupported savestate format");
+	if (state.header.regionCount != RegionCount)
+		throw Deserializer::Exception("Invalid savestate");
+	size_t offset = sizeof(Header);
+	if (state.header.coreSize > size - offset)
+		throw Deserializer::Exception("Invalid savestate");
+	state.core = data + offset;
+	offset += state.header.coreSize;
+
+	for (int r = 0; r < RegionCount; r++)
+	{
+		RegionHeader regionHeader;
+		if (sizeof(RegionHeader) > size - offset)
+			throw Deserializer::Exception("Invalid savestate");
+		memcpy(&regionHeader, data + offset, sizeof(RegionHeader));
+		offset += sizeof(RegionHeader);
+		if (regionHeader.size != regions[r].size || regionHeader.pageCount > regions[r].pageCount()
+				|| (size_t)regionHeader.pageCount * (sizeof(u32) + PageSize) > size - offset)
+			throw Deserializer::Exception("Savestate doesn't match the current system");
+		state.pageCount[r] = regionHeader.pageCount;
+		state.indices[r] = (const u32 *)(data + offset);
+		offset += regionHeader.pageCount * sizeof(u32);
+		for (u32 i = 0; i < regionHeader.pageCount; i++)
+			if (state.indices[r][i] >= regions[r].pageCount())
+				throw Deserializer::Exception("Invalid savestate");
+		state.pages[r] = data + offset;
+		offset += regionHeader.pageCount * PageSize;
+	}
+
+	return state;
+}
+
+static void loadPages(const ParsedState& state, const std::array<Region, RegionCount>& regions)
+{
+	for (int r = 0; r < RegionCount; r++)
+		for (u32 i = 0; i < state.pageCount[r]; i++)
+			memcpy(regions[r].data + state.indices[r][i] * PageSize, state.pages[r] + i * PageSize, PageSize);
+}
+
+void load(const std::string& path, const u8 *data, size_t size)
+{
+	flush();
+	const auto regions = getRegions();
+	ParsedState state = parse(data, size, regions);
+
+	std::vector<u8> baseData;
+	ParsedState baseState;
+	if (state.header.delta)
+	{
+		const std::string baseFile = basePath(path);
+		RZipFile zipFile;
+		if (!zipFile.Open(baseFile, false))
+			throw Deserializer::Exception("Base savestate not found");
+		baseData.resize(zipFile.Size());
+		if (zipFile.Read(baseData.data(), baseData.size()) != baseData.size())
+			throw Deserializer::Exception("Base savestate I/O error");
+		zipFile.Close();
+		baseState = parse(baseData.data(), baseData.size(), regions);
+		if (baseState.header.delta || baseState.header.baseId != state.header.baseId)
+			throw Deserializer::Exception("Base savestate doesn't match");
+	}
+	// Checks the version before changing anything
+	Deserializer deser(state.core, state.header.coreSize, false, true);
+
+	if (state.header.delta)
+		loadPages(baseState, regions);
+	loadPages(state, regions);
+	dc_loadstate(deser);
+	if (deser.size() != state.header.coreSize)
+		WARN_LOG(SAVESTATE, "Savestate size %d but only %d bytes used", state.header.coreSize, (int)deser.size());
+}
+
+}
+#endif
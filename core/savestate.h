@@ -0,0 +1,35 @@
+/*
+	Paged savestates
+
+	The memory regions (system RAM, VRAM, AICA RAM and Elan RAM) are stored as pages,
+	separately from the rest of the state which is serialized without them.
+	The first save to a slot writes a full snapshot. The following saves to the same slot
+	only store the pages that differ from it and the full snapshot is kept as the base
+	in a ".base" file next to it. Pages are compared by hash so nothing needs to be tracked
+	while the game runs.
+	The state is captured on the calling thread, compressed and written on a worker thread.
+*/
+#pragma once
+#include "types.h"
+
+namespace savestate
+{
+
+// Captures the current state and starts writing it to path.
+// Returns false if the state couldn't be captured.
+bool save(const std::string& path);
+
+// Returns true if data starts with a paged savestate header
+bool isPaged(const void *data, size_t size);
+
+// Loads a paged savestate read from path.
+// Throws Deserializer::Exception if the state or its base is invalid.
+void load(const std::string& path, const u8 *data, size_t size);
+
+// Waits until the pending save, if any, is written
+void flush();
+
+// Forgets the base snapshot. The next save will be a full one.
+void reset();
+
+}
@@ -4,6 +4,7 @@
 #include "hw/aica/dsp.h"
 #include "hw/aica/aica.h"
 #include "hw/aica/sgc_if.h"
+#include "hw/aica/aica_if.h"
 #include "hw/arm7/arm7.h"
 #include "hw/holly/sb.h"
 #include "hw/flashrom/flashrom.h"
@@ -153,6 +154,9 @@ static const std::array<int, 11> getSchedulerIds() {
 
 void dc_serialize(Serializer& ser)
 {
+	libAICA_Sync();
+	// Pending samples depend on the DSP, aica ram and register state saved below
+	AICA_FlushSamples();
 	ser << aica_interr;
 	ser << aica_reg_L;
 	ser << e68k_out;
@@ -174,7 +178,7 @@ void dc_serialize(Serializer& ser)
 		ser << timers[i].m_step;
 	}
 
-	if (!ser.rollback())
+	if (!ser.skipRam())
 		ser.serialize(aica_ram.data, aica_ram.size);
 	ser << VREG;
 	ser << ARMRST;
@@ -214,7 +218,7 @@ void dc_serialize(Serializer& ser)
 	icache.Serialize(ser);
 	ocache.Serialize(ser);
 
-	if (!ser.rollback())
+	if (!ser.skipRam())
 		ser.serialize(mem_b.data, mem_b.size);
 
 	ser << InterruptEnvId;
@@ -493,6 +497,7 @@ static void dc_deserialize_libretro(Deserializer& deser)
 	deser >> sch_list[modem_sched].tag;
     deser >> sch_list[modem_sched].start;
     deser >> sch_list[modem_sched].end;
+	sh4_sched_restore();
 
 	deser >> SCIF_SCFSR2;
 	if (deser.version() < Deserializer::V9_LIBRETRO)
@@ -588,6 +593,7 @@ static void dc_deserialize_libretro(Deserializer& deser)
 
 void dc_deserialize(Deserializer& deser)
 {
+	libAICA_Sync();
 	if (deser.version() >= Deserializer::V5_LIBRETRO && deser.version() <= Deserializer::VLAST_LIBRETRO)
 	{
 		dc_deserialize_libretro(deser);
@@ -621,7 +627,7 @@ void dc_deserialize(Deserializer& deser)
 		deser >> timers[i].m_step;
 	}
 
-	if (!deser.rollback())
+	if (!deser.skipRam())
 	{
 		deser.deserialize(aica_ram.data, aica_ram.size);
 		if (settings.platform.isAtomiswave())
@@ -688,7 +694,7 @@ void dc_deserialize(Deserializer& deser)
 	else
 		ocache.Reset(true);
 
-	if (!deser.rollback())
+	if (!deser.skipRam())
 		deser.deserialize(mem_b.data, mem_b.size);
 
 	if (deser.version() < Deserializer::V5)
@@ -774,6 +780,7 @@ void dc_deserialize(Deserializer& deser)
 		deser >> sch_list[modem_sched].start;
 		deser >> sch_list[modem_sched].end;
 	}
+	sh4_sched_restore();
 	if (deser.version() < Deserializer::V19)
 		sh4_sched_ffts();
 	ModemDeserialize(deser);
@@ -74,14 +74,17 @@ public:
 
 	size_t size() const { return _size; }
 	bool rollback() const { return _rollback; }
+	// RAM, VRAM, AICA RAM and Elan RAM aren't serialized. Always true for rollback states.
+	bool skipRam() const { return _skipRam; }
 
 protected:
-	SerializeBase(size_t limit, bool rollback)
-		: _size(0), limit(limit), _rollback(rollback) {}
+	SerializeBase(size_t limit, bool rollback, bool skipRam)
+		: _size(0), limit(limit), _rollback(rollback), _skipRam(rollback || skipRam) {}
 
 	size_t _size;
 	size_t limit;
 	bool _rollback;
+	bool _skipRam;
 };
 
 class Deserializer : public SerializeBase
@@ -93,8 +96,8 @@ public:
 		Exception(const char *msg) : std::runtime_error(msg) {}
 	};
 
-	Deserializer(const void *data, size_t limit, bool rollback = false)
-		: SerializeBase(limit, rollback), data((const u8 *)data)
+	Deserializer(const void *data, size_t limit, bool rollback = false, bool skipRam = false)
+		: SerializeBase(limit, rollback, skipRam), data((const u8 *)data)
 	{
 		deserialize(_version);
 		if (_version > V13_LIBRETRO && _version < V5)
@@ -157,8 +160,8 @@ public:
 	Serializer()
 		: Serializer(nullptr, std::numeric_limits<size_t>::max(), false) {}
 
-	Serializer(void *data, size_t limit, bool rollback = false)
-		: SerializeBase(limit, rollback), data((u8 *)data)
+	Serializer(void *data, size_t limit, bool rollback = false, bool skipRam = false)
+		: SerializeBase(limit, rollback, skipRam), data((u8 *)data)
 	{
 		Version v = Current;
 		serialize(v);
@@ -3,6 +3,7 @@
 #include "md5/md5.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <condition_variable>
 #include <cstring>
@@ -52,6 +53,62 @@ public :
 	void Wait();	//Wait for signal , then reset[if auto]
 };
 
+//
+// Bounded lock-free queue with a single producer thread and a single consumer thread
+//
+template<typename T, u32 Size>
+class SPSCQueue
+{
+	static_assert((Size & (Size - 1)) == 0, "Size must be a power of 2");
+
+public:
+	// Producer. Returns false if the queue is full.
+	bool push(const T& v)
+	{
+		u32 w = writeIdx.load(std::memory_order_relaxed);
+		if (w - readIdx.load(std::memory_order_acquire) == Size)
+			return false;
+		data[w & (Size - 1)] = v;
+		writeIdx.store(w + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer. Returns nullptr if the queue is empty.
+	T *front()
+	{
+		u32 r = readIdx.load(std::memory_order_relaxed);
+		if (r == writeIdx.load(std::memory_order_acquire))
+			return nullptr;
+		return &data[r & (Size - 1)];
+	}
+
+	// Consumer. Removes the front element.
+	void pop() {
+		readIdx.store(readIdx.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	u32 size() const {
+		return writeIdx.load(std::memory_order_acquire) - readIdx.load(std::memory_order_acquire);
+	}
+	bool empty() const { return size() == 0; }
+	bool full() const { return size() == Size; }
+
+	// Sequence number of the front element, and of the next pushed element
+	u32 readIndex() const { return readIdx.load(std::memory_order_acquire); }
+	u32 writeIndex() const { return writeIdx.load(std::memory_order_acquire); }
+
+	// Must not be called concurrently with the consumer
+	void clear() {
+		readIdx.store(writeIdx.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+private:
+	T data[Size];
+	// on separate cache lines to avoid false sharing between the two threads
+	alignas(64) std::atomic<u32> writeIdx { 0 };
+	alignas(64) std::atomic<u32> readIdx { 0 };
+};
+
 void set_user_config_dir(const std::string& dir);
 void set_user_data_dir(const std::string& dir);
 void add_system_config_dir(const std::string& dir);
@@ -209,14 +209,14 @@ void retro_audio_upload(void)
 	}
 }
 
-void WriteSample(s16 r, s16 l)
+void WriteSamples(const SoundFrame *frames, u32 count)
 {
 	const std::lock_guard<std::mutex> lock(audio_buffer_mutex);
 
 	if (drop_samples)
 		return;
 
-	if (audio_buffer.size() < audio_buffer_idx + 2)
+	if (audio_buffer.size() < audio_buffer_idx + count * 2)
 	{
 		/* Audio buffer overflow...
 		 * > Drop any existing samples
@@ -227,8 +227,8 @@ void WriteSample(s16 r, s16 l)
 		return;
 	}
 
-	audio_buffer[audio_buffer_idx++] = l;
-	audio_buffer[audio_buffer_idx++] = r;
+	memcpy(&audio_buffer[audio_buffer_idx], frames, count * sizeof(SoundFrame));
+	audio_buffer_idx += count * 2;
 }
 
 void InitAudio()
@@ -25,6 +25,9 @@ namespace config {
 
 Option<bool> DynarecEnabled("", true);
 Option<bool> DynarecIdleSkip("", true);
+Option<bool> DynarecAsyncCompile("");
+Option<bool> DynarecPersistentCache("");
+Option<bool> DynarecSuperblocks("");
 
 // General
 
@@ -50,6 +53,8 @@ Option<int> AudioBufferSize("", 2822);	// 64 ms
 Option<bool> AutoLatency("");
 
 OptionString AudioBackend("", "auto");
+Option<bool> AudioSyncToVideo("", false);
+Option<bool> ThreadedAica("", false);
 
 // Rendering
 
@@ -85,6 +90,7 @@ Option<int> AutoSkipFrame(CORE_OPTION_NAME "_auto_skip_frame", 0);
 Option<int> RenderResolution("", 480);
 Option<bool> VSync("", true);
 Option<bool> ThreadedRendering(CORE_OPTION_NAME "_threaded_rendering", true);
+Option<bool> ParallelTAParsing("");
 Option<int> AnisotropicFiltering(CORE_OPTION_NAME "_anisotropic_filtering");
 Option<int> TextureFiltering(CORE_OPTION_NAME "_texture_filtering");
 Option<bool> PowerVR2Filter(CORE_OPTION_NAME "_pvr2_filtering");
@@ -101,6 +107,7 @@ Option<bool> UseReios(CORE_OPTION_NAME "_hle_bios");
 
 Option<bool> OpenGlChecks("", false);
 Option<bool> FastGDRomLoad(CORE_OPTION_NAME "_gdrom_fast_loading", false);
+Option<int> ChdHunkCacheSize("", 64);
 
 //Option<std::vector<std::string>, false> ContentPath("");
 //Option<bool, false> HideLegacyNaomiRoms("", true);
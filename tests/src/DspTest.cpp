@@ -0,0 +1,310 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/aica/aica.h"
+#include "hw/aica/aica_if.h"
+#include "hw/aica/dsp.h"
+#include "emulator.h"
+
+#include <iterator>
+#include <random>
+#include <vector>
+
+// Runs DSP microprograms with and without dead step elimination and checks that
+// the visible state (TEMP, MEMS, EFREG and wave memory) is the same.
+class DspTest : public ::testing::Test {
+protected:
+	// Memory accessed by the programs: the ring buffer and table reads are limited to 64K words
+	static constexpr u32 RamSize = 0x20000;
+
+	struct Result
+	{
+		s32 TEMP[128];
+		s32 MEMS[32];
+		u32 EFREG[16];
+		std::vector<u8> ram;
+		int liveSteps;
+	};
+
+	void SetUp() override {
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		emu.init();
+		dc_reset(true);
+		memset(DSPData->MPRO, 0, sizeof(DSPData->MPRO));
+		memset(DSPData->COEF, 0, sizeof(DSPData->COEF));
+		memset(DSPData->MADRS, 0, sizeof(DSPData->MADRS));
+	}
+
+	void setStep(int step, const dsp::Instruction& op, u16 coef = 0)
+	{
+		u32 *mpro = &DSPData->MPRO[step * 4];
+		mpro[0] = (op.TRA << 9) | (op.TWT << 8) | (op.TWA << 1);
+		mpro[1] = (op.XSEL << 15) | (op.YSEL << 13) | (op.IRA << 7) | (op.IWT << 6) | (op.IWA << 1);
+		mpro[2] = (op.TABLE << 15) | (op.MWT << 14) | (op.MRD << 13) | (op.EWT << 12) | (op.EWA << 8)
+				| (op.ADRL << 7) | (op.FRCL << 6) | (op.SHIFT << 4) | (op.YRL << 3) | (op.NEGB << 2)
+				| (op.ZERO << 1) | op.BSEL;
+		mpro[3] = (op.NOFL << 15) | (op.MASA << 9) | (op.ADREB << 8) | (op.NXADR << 7);
+		DSPData->COEF[step] = coef;
+	}
+
+	Result run(bool eliminate, int samples = 16)
+	{
+		dsp::init();
+		// Same inputs for both runs
+		std::mt19937 random(42);
+		for (s32& v : dsp::state.TEMP)
+			v = (s32)(random() << 8) >> 8;
+		for (s32& v : dsp::state.MEMS)
+			v = (s32)(random() << 8) >> 8;
+		for (s32& v : dsp::state.MIXS)
+			v = (s32)(random() << 12) >> 12;
+		DSPData->EXTS[0] = random() & 0xffff;
+		DSPData->EXTS[1] = random() & 0xffff;
+		memset(DSPData->EFREG, 0, sizeof(DSPData->EFREG));
+		for (u32 i = 0; i < RamSize; i++)
+			aica_ram[i] = (u8)random();
+
+		Result result;
+		if (eliminate)
+		{
+			for (int i = 0; i < samples; i++)
+				dsp::step();
+		}
+		else
+		{
+			dsp::state.dirty = false;
+			dsp::state.stopped = false;
+			for (dsp::StepInfo& info : dsp::state.steps)
+			{
+				info.live = true;
+				info.accLive = true;
+				info.coef = dsp::CoefValue::Any;
+			}
+			dsp::recompile();
+			for (int i = 0; i < samples; i++)
+				dsp::runStep();
+		}
+		result.liveSteps = 0;
+		for (const dsp::StepInfo& info : dsp::state.steps)
+			result.liveSteps += info.live;
+		memcpy(result.TEMP, dsp::state.TEMP, sizeof(result.TEMP));
+		memcpy(result.MEMS, dsp::state.MEMS, sizeof(result.MEMS));
+		memcpy(result.EFREG, DSPData->EFREG, sizeof(result.EFREG));
+		result.ram.assign(&aica_ram[0], &aica_ram[0] + RamSize);
+
+		return result;
+	}
+
+	// Returns the number of live steps found by the analysis
+	int compare()
+	{
+		const Result reference = run(false);
+		const Result actual = run(true);
+		for (int i = 0; i < 128; i++)
+			EXPECT_EQ(reference.TEMP[i], actual.TEMP[i]) << "TEMP[" << i << "]";
+		for (int i = 0; i < 32; i++)
+			EXPECT_EQ(reference.MEMS[i], actual.MEMS[i]) << "MEMS[" << i << "]";
+		for (int i = 0; i < 16; i++)
+			EXPECT_EQ(reference.EFREG[i], actual.EFREG[i]) << "EFREG[" << i << "]";
+		EXPECT_TRUE(reference.ram == actual.ram) << "wave memory differs";
+
+		return actual.liveSteps;
+	}
+};
+
+TEST_F(DspTest, DeadSteps)
+{
+	dsp::Instruction op {};
+	// ACC = MEMS[1] * COEF + TEMP[3], overwritten by the next step: dead
+	op.XSEL = true;
+	op.IRA = 1;
+	op.YSEL = 1;
+	op.TRA = 3;
+	setStep(10, op, 0x1230);
+	// Y_REG = MEMS[2], overwritten below before being used: dead
+	op = {};
+	op.XSEL = true;
+	op.IRA = 2;
+	op.YSEL = 1;
+	op.YRL = true;
+	setStep(11, op, 0x4560);
+	// Y_REG = MEMS[4], ACC = MEMS[4] * COEF + TEMP[0]
+	op = {};
+	op.XSEL = true;
+	op.IRA = 4;
+	op.YSEL = 1;
+	op.YRL = true;
+	setStep(12, op, 0x2000);
+	// ACC = TEMP[5] * Y_REG, TEMP[6] = previous ACC
+	op = {};
+	op.TRA = 5;
+	op.YSEL = 2;
+	op.ZERO = true;
+	op.TWT = true;
+	op.TWA = 6;
+	setStep(13, op);
+	// EFREG[2] = previous ACC
+	op = {};
+	op.ZERO = true;
+	op.YSEL = 1;
+	op.EWT = true;
+	op.EWA = 2;
+	setStep(14, op);
+	// FRC_REG is written but never read: dead
+	op = {};
+	op.FRCL = true;
+	setStep(40, op);
+
+	int live = compare();
+	EXPECT_LT(live, 128);
+	// Steps 0 to 9 are empty instructions whose result is overwritten by step 10
+	EXPECT_FALSE(dsp::state.steps[0].live);
+	EXPECT_FALSE(dsp::state.steps[10].live);
+	EXPECT_FALSE(dsp::state.steps[11].live);
+	EXPECT_TRUE(dsp::state.steps[12].live);
+	EXPECT_TRUE(dsp::state.steps[13].live);
+	EXPECT_TRUE(dsp::state.steps[14].live);
+	EXPECT_FALSE(dsp::state.steps[40].live);
+}
+
+TEST_F(DspTest, CoefFolding)
+{
+	dsp::Instruction op {};
+	// ACC = MEMS[0] * -1 + TEMP[1]
+	op.XSEL = true;
+	op.IRA = 0;
+	op.YSEL = 1;
+	op.TRA = 1;
+	setStep(0, op, 0x8000);
+	// TEMP[2] = previous ACC, ACC = MIXS[3] * 0 - TEMP[4]
+	op = {};
+	op.TWT = true;
+	op.TWA = 2;
+	op.XSEL = true;
+	op.IRA = 0x23;
+	op.YSEL = 1;
+	op.TRA = 4;
+	op.NEGB = true;
+	setStep(1, op, 0x0007);
+	// EFREG[0] = previous ACC, ACC = TEMP[5] * -1 + ACC
+	op = {};
+	op.EWT = true;
+	op.EWA = 0;
+	op.TRA = 5;
+	op.YSEL = 1;
+	op.BSEL = true;
+	setStep(2, op, 0x8007);
+	// ACC = EXTS[0] * 0 + ACC
+	op = {};
+	op.XSEL = true;
+	op.IRA = 0x30;
+	op.YSEL = 1;
+	op.BSEL = true;
+	setStep(3, op, 0x0000);
+	// TEMP[7] = previous ACC saturated and doubled
+	op = {};
+	op.TWT = true;
+	op.TWA = 7;
+	op.SHIFT = 1;
+	op.ZERO = true;
+	setStep(4, op);
+
+	compare();
+	EXPECT_EQ(dsp::CoefValue::MinusOne, dsp::state.steps[0].coef);
+	EXPECT_EQ(dsp::CoefValue::Zero, dsp::state.steps[1].coef);
+	EXPECT_EQ(dsp::CoefValue::MinusOne, dsp::state.steps[2].coef);
+	EXPECT_EQ(dsp::CoefValue::Zero, dsp::state.steps[3].coef);
+}
+
+TEST_F(DspTest, MemoryAccess)
+{
+	dsp::Instruction op {};
+	DSPData->MADRS[0] = 0x100;
+	DSPData->MADRS[1] = 0x200;
+	DSPData->MADRS[2] = 0x300;
+	// ADRS_REG = MEMS[3] >> 16
+	op.XSEL = true;
+	op.IRA = 3;
+	op.ADRL = true;
+	setStep(0, op);
+	// MEMVAL[3] = ram[MADRS[0] + ADRS_REG]
+	op = {};
+	op.MRD = true;
+	op.MASA = 0;
+	op.ADREB = true;
+	setStep(1, op);
+	// MEMS[5] = MEMVAL[3]
+	op = {};
+	op.IWT = true;
+	op.IWA = 5;
+	setStep(3, op);
+	// MEMVAL[1] = table[MADRS[1]]: overwritten by step 11 before being read, dead
+	op = {};
+	op.MRD = true;
+	op.TABLE = true;
+	op.MASA = 1;
+	setStep(7, op);
+	// ACC = MEMS[5] * COEF
+	op = {};
+	op.XSEL = true;
+	op.IRA = 5;
+	op.YSEL = 1;
+	op.ZERO = true;
+	setStep(8, op, 0x1000);
+	// ram[MADRS[2] + 1] = previous ACC
+	op = {};
+	op.MWT = true;
+	op.MASA = 2;
+	op.NXADR = true;
+	setStep(9, op);
+	// MEMVAL[1] = table[MADRS[1] + 1]
+	op = {};
+	op.MRD = true;
+	op.TABLE = true;
+	op.MASA = 1;
+	op.NXADR = true;
+	setStep(11, op);
+	// Memory accesses are ignored on even steps: dead
+	op = {};
+	op.MWT = true;
+	op.MASA = 2;
+	setStep(20, op);
+
+	compare();
+	EXPECT_TRUE(dsp::state.steps[0].live);
+	EXPECT_TRUE(dsp::state.steps[1].live);
+	EXPECT_TRUE(dsp::state.steps[3].live);
+	EXPECT_FALSE(dsp::state.steps[7].live);
+	EXPECT_TRUE(dsp::state.steps[8].live);
+	EXPECT_TRUE(dsp::state.steps[9].live);
+	EXPECT_TRUE(dsp::state.steps[11].live);
+	EXPECT_FALSE(dsp::state.steps[20].live);
+}
+
+TEST_F(DspTest, RandomPrograms)
+{
+	std::mt19937 random(1234);
+	const u16 coefs[] { 0x0000, 0x0007, 0x8000, 0x8007, 0x1000, 0xf000 };
+	for (int program = 0; program < 50; program++)
+	{
+		for (int step = 0; step < 128; step++)
+		{
+			u32 *mpro = &DSPData->MPRO[step * 4];
+			for (int i = 0; i < 4; i++)
+				mpro[i] = random() & 0xffff;
+			// Keep most writes out to get dead steps
+			if (random() % 4 != 0)
+			{
+				mpro[0] &= ~0x100;		// TWT
+				mpro[1] &= ~0x40;		// IWT
+				mpro[2] &= ~0x5000;		// MWT, EWT
+			}
+			DSPData->COEF[step] = random() % 2 ? coefs[random() % std::size(coefs)] : random() & 0xfff8;
+		}
+		for (u32& madrs : DSPData->MADRS)
+			madrs = random() & 0xffff;
+		SCOPED_TRACE("program " + std::to_string(program));
+		compare();
+	}
+}
@@ -19,6 +19,17 @@
 #include "sh4_ops.h"
 #include "emulator.h"
 #include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/sh4_interpreter.h"
+#include "hw/sh4/sh4_sched.h"
+#include "oslib/oslib.h"
+
+static sh4_if *runningCpu;
+
+static int stopCpu(int tag, int cycles, int jitter)
+{
+	runningCpu->Stop();
+	return 0;
+}
 
 class Sh4InterpreterTest : public Sh4OpTest {
 protected:
@@ -46,6 +57,16 @@ protected:
 		for (int i = 0; i < numOp; i++)
 			sh4.Step();
 	}
+	// Runs the code at pc for a few time slices
+	void RunCode(u32 pc)
+	{
+		ctx->pc = pc;
+		runningCpu = &sh4;
+		int id = sh4_sched_register(0, stopCpu);
+		sh4_sched_request(id, SH4_TIMESLICE * 10);
+		sh4.Run();
+		sh4_sched_unregister(id);
+	}
 };
 
 TEST_F(Sh4InterpreterTest, MovRmRnTest)
@@ -92,3 +113,31 @@ TEST_F(Sh4InterpreterTest, StatusRegTest)
 {
 	Sh4OpTest::StatusRegTest();
 }
+TEST_F(Sh4InterpreterTest, BlockCacheTest)
+{
+	// needed to catch writes to protected code pages
+	static bool faultHandlerInstalled;
+	if (!faultHandlerInstalled)
+	{
+		os_InstallFaultHandler();
+		faultHandlerInstalled = true;
+	}
+	// mov #10, r1; mov #0, r2; loop: add #1, r2; dt r1; bf loop; bra .; nop
+	const u16 code[] = { 0xE10A, 0xE200, 0x7201, 0x4110, 0x8BFC, 0xAFFE, 0x0009 };
+	// blocks in the first 64 KB of RAM are checked, the others are write-protected
+	for (u32 pc : { START_PC, START_PC + 0x10000 })
+	{
+		for (u32 i = 0; i < sizeof(code) / sizeof(code[0]); i++)
+			_vmem_WriteMem16(pc + i * 2, code[i]);
+		RunCode(pc);
+		ASSERT_EQ(0u, ctx->r[1]);
+		ASSERT_EQ(10u, ctx->r[2]);
+		ASSERT_EQ(pc + 10, ctx->pc);
+
+		// the modified block must be decoded again
+		_vmem_WriteMem16(pc, 0xE114);	// mov #20, r1
+		RunCode(pc);
+		ASSERT_EQ(0u, ctx->r[1]);
+		ASSERT_EQ(20u, ctx->r[2]);
+	}
+}
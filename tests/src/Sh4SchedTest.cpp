@@ -0,0 +1,88 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_sched.h"
+
+#include <vector>
+
+static std::vector<int> fired;
+
+static int schedCallback(int tag, int cycles, int jitter)
+{
+	fired.push_back(tag);
+	return 0;
+}
+
+class Sh4SchedTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		sh4_sched_reset(true);
+		fired.clear();
+	}
+
+	void TearDown() override {
+		for (int id : ids)
+			sh4_sched_unregister(id);
+	}
+
+	int registerCb(int tag)
+	{
+		int id = sh4_sched_register(tag, schedCallback);
+		ids.push_back(id);
+		return id;
+	}
+
+	void run(int cycles)
+	{
+		Sh4cntx.sh4_sched_next -= cycles;
+		sh4_sched_tick(cycles);
+	}
+
+	std::vector<int> ids;
+};
+
+TEST_F(Sh4SchedTest, DeadlineOrder)
+{
+	int id1 = registerCb(1);
+	int id2 = registerCb(2);
+	int id3 = registerCb(3);
+	sh4_sched_request(id1, 300);
+	sh4_sched_request(id2, 100);
+	sh4_sched_request(id3, 200);
+	ASSERT_EQ(100, Sh4cntx.sh4_sched_next);
+
+	run(1000);
+	ASSERT_EQ((std::vector<int>{ 2, 3, 1 }), fired);
+}
+
+TEST_F(Sh4SchedTest, Cancel)
+{
+	int id1 = registerCb(1);
+	int id2 = registerCb(2);
+	sh4_sched_request(id1, 100);
+	sh4_sched_request(id2, 200);
+	sh4_sched_request(id1, -1);
+	ASSERT_EQ(200, Sh4cntx.sh4_sched_next);
+
+	run(250);
+	ASSERT_EQ((std::vector<int>{ 2 }), fired);
+}
+
+TEST_F(Sh4SchedTest, Reschedule)
+{
+	int id1 = registerCb(1);
+	int id2 = registerCb(2);
+	sh4_sched_request(id1, 100);
+	sh4_sched_request(id2, 200);
+	sh4_sched_request(id1, 300);
+	ASSERT_EQ(200, Sh4cntx.sh4_sched_next);
+
+	run(250);
+	ASSERT_EQ((std::vector<int>{ 2 }), fired);
+	ASSERT_EQ(50, Sh4cntx.sh4_sched_next);
+	run(100);
+	ASSERT_EQ((std::vector<int>{ 2, 1 }), fired);
+}
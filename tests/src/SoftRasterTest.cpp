@@ -0,0 +1,162 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "rend/soft/soft_raster.h"
+
+#include <vector>
+
+// Renders small TA frames with the tile rasterizer and compares them against
+// reference colors computed by hand.
+class SoftRasterTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		ctx.verts.Init(64, &overrun, "verts");
+		ctx.idx.Init(64, &overrun, "idx");
+		ctx.modtrig.Init(8, &overrun, "modtrig");
+		ctx.global_param_mvo.Init(8, &overrun, "mvo");
+		ctx.global_param_mvo_tr.Init(8, &overrun, "mvo_tr");
+		ctx.global_param_op.Init(8, &overrun, "op");
+		ctx.global_param_pt.Init(8, &overrun, "pt");
+		ctx.global_param_tr.Init(8, &overrun, "tr");
+		ctx.render_passes.Init(4, &overrun, "passes");
+		ctx.matrices.Init(1, &overrun, "matrices");
+		ctx.lightModels.Init(1, &overrun, "lightModels");
+		// 64x64 pixels
+		ctx.ta_GLOB_TILE_CLIP.tile_x_num = 1;
+		ctx.ta_GLOB_TILE_CLIP.tile_y_num = 1;
+		ctx.fog_clamp_max.full = 0xffffffff;
+	}
+
+	void TearDown() override {
+		ctx.verts.Free();
+		ctx.idx.Free();
+		ctx.modtrig.Free();
+		ctx.global_param_mvo.Free();
+		ctx.global_param_mvo_tr.Free();
+		ctx.global_param_op.Free();
+		ctx.global_param_pt.Free();
+		ctx.global_param_tr.Free();
+		ctx.render_passes.Free();
+		ctx.matrices.Free();
+		ctx.lightModels.Free();
+	}
+
+	// Adds a flat-shaded rectangle as a 4-vertex strip. z is 1/w.
+	void addRect(List<PolyParam>& list, float x0, float y0, float x1, float y1, float z, u32 color, bool translucent)
+	{
+		PolyParam *pp = list.Append();
+		pp->init();
+		pp->first = ctx.idx.used();
+		pp->count = 4;
+		pp->isp.DepthMode = 6;		// greater or equal
+		pp->isp.ZWriteDis = translucent;
+		pp->tsp.FogCtrl = 2;		// no fog
+		pp->tsp.UseAlpha = translucent;
+		if (translucent)
+		{
+			pp->tsp.SrcInstr = 4;	// src alpha
+			pp->tsp.DstInstr = 5;	// 1 - src alpha
+		}
+		const float xy[4][2] { { x0, y0 }, { x1, y0 }, { x0, y1 }, { x1, y1 } };
+		for (const auto& p : xy)
+		{
+			*ctx.idx.Append() = ctx.verts.used();
+			Vertex *v = ctx.verts.Append();
+			memset(v, 0, sizeof(Vertex));
+			v->x = p[0];
+			v->y = p[1];
+			v->z = z;
+			memcpy(v->col, &color, sizeof(v->col));
+		}
+	}
+
+	void endPass(bool autosort)
+	{
+		RenderPass *pass = ctx.render_passes.Append();
+		memset(pass, 0, sizeof(RenderPass));
+		pass->autosort = autosort;
+		pass->op_count = ctx.global_param_op.used();
+		pass->pt_count = ctx.global_param_pt.used();
+		pass->tr_count = ctx.global_param_tr.used();
+	}
+
+	void render()
+	{
+		rasterizer.render(ctx, frame, width, height);
+		ASSERT_EQ(64u, width);
+		ASSERT_EQ(64u, height);
+	}
+
+	// Compares each channel with a tolerance of 1 for rounding
+	void expectPixel(u32 x, u32 y, u32 expected)
+	{
+		const u32 pixel = frame[y * width + x];
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			int actual = (pixel >> shift) & 0xff;
+			int wanted = (expected >> shift) & 0xff;
+			EXPECT_NEAR(wanted, actual, 1) << "pixel (" << x << ", " << y << ") is " << std::hex << pixel
+					<< " instead of " << expected;
+		}
+	}
+
+	rend_context ctx {};
+	bool overrun = false;
+	soft::TileRasterizer rasterizer;
+	std::vector<u32> frame;
+	u32 width = 0;
+	u32 height = 0;
+};
+
+// Colors are R, G, B, A from the least significant byte
+constexpr u32 Red = 0xff0000ff;
+constexpr u32 Green = 0xff00ff00;
+constexpr u32 Blue = 0xffff0000;
+constexpr u32 HalfBlue = 0x80ff0000;
+constexpr u32 HalfGreen = 0x8000ff00;
+
+TEST_F(SoftRasterTest, OpaqueDepth)
+{
+	addRect(ctx.global_param_op, 0, 0, 64, 64, 1.f, Red, false);
+	// nearer, drawn
+	addRect(ctx.global_param_op, 16, 16, 48, 48, 2.f, Green, false);
+	// farther, hidden
+	addRect(ctx.global_param_op, 8, 8, 56, 56, 0.5f, Blue, false);
+	endPass(false);
+	render();
+
+	expectPixel(0, 0, Red);
+	expectPixel(63, 63, Red);
+	expectPixel(10, 10, Red);
+	expectPixel(16, 16, Green);
+	expectPixel(32, 32, Green);
+	expectPixel(47, 47, Green);
+	expectPixel(48, 48, Red);
+	expectPixel(15, 40, Red);
+}
+
+TEST_F(SoftRasterTest, TranslucentBlending)
+{
+	addRect(ctx.global_param_op, 0, 0, 64, 64, 1.f, Red, false);
+	addRect(ctx.global_param_tr, 0, 0, 32, 32, 2.f, HalfBlue, true);
+	endPass(false);
+	render();
+
+	expectPixel(40, 40, Red);
+	// red * (1 - a) + blue * a, alpha = a * a + (1 - a)
+	expectPixel(8, 8, 0xbf80007f);
+	expectPixel(31, 31, 0xbf80007f);
+	expectPixel(32, 8, Red);
+}
+
+TEST_F(SoftRasterTest, TranslucentAutoSort)
+{
+	// Submitted front to back, blended back to front
+	addRect(ctx.global_param_tr, 0, 0, 64, 64, 3.f, HalfBlue, true);
+	addRect(ctx.global_param_tr, 0, 0, 64, 64, 2.f, HalfGreen, true);
+	endPass(true);
+	render();
+
+	// green over black: (0, a, 0, a * a)
+	// then blue: (0, a * (1 - a), a, a * a + a * a * (1 - a))
+	expectPixel(20, 20, 0x60804000);
+}